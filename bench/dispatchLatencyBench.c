@@ -0,0 +1,109 @@
+/* Measures the time from enqueuing an event on a session to its callback running, for the
+ * blocking, polling and adaptive dispatch modes. Events are sent one at a time with a pause
+ * between them, so that each finds the dispatcher idle as a sparse feed would.
+ */
+#include "mmeBench.h"
+#include "mama/mamaManagedEnvironment.h"
+#include "mama/mamaEnvSession.h"
+
+/* The number of events timed, the pause between them in nanoseconds, and the adaptive spin time,
+ * which is longer than the pause so that the adaptive dispatcher is still spinning.
+ */
+#define LATENCY_SAMPLES 20000
+#define LATENCY_PAUSE 200000
+#define LATENCY_SPIN_TIME 0.001
+
+
+typedef struct latencyBenchRun
+{
+    uint64_t m_sent;
+    uint64_t m_latency;
+    int m_done;
+
+} latencyBenchRun;
+
+
+static int latencyBench_compare(const void* left, const void* right)
+{
+    uint64_t l = *(const uint64_t*)left;
+    uint64_t r = *(const uint64_t*)right;
+    return (l < r) ? -1 : ((l > r) ? 1 : 0);
+}
+
+
+static void MAMACALLTYPE latencyBench_onEvent(mamaQueue queue, void* closure)
+{
+    latencyBenchRun* run = (latencyBenchRun*)closure;
+    run->m_latency = mmeBench_now() - run->m_sent;
+    __atomic_store_n(&run->m_done, 1, __ATOMIC_RELEASE);
+}
+
+
+static mama_status latencyBench_run(mamaEnvConnection connection, mamaEnvDispatchMode mode, const char* variant)
+{
+    mamaEnvSessionAttributes attributes;
+    mamaEnv_initSessionAttributes(&attributes);
+    attributes.m_dispatchMode = mode;
+    attributes.m_spinTime = LATENCY_SPIN_TIME;
+
+    mamaEnvSession session = NULL;
+    mama_status status = mamaEnv_createSessionWithAttributes(connection, &attributes, &session);
+    if (status != MAMA_STATUS_OK) {
+        return status;
+    }
+
+    uint64_t* samples = (uint64_t*)calloc(LATENCY_SAMPLES, sizeof(uint64_t));
+    latencyBenchRun run = { 0 };
+    const struct timespec pause = { 0, LATENCY_PAUSE };
+    uint64_t total = 0;
+    for (size_t i = 0; (i < LATENCY_SAMPLES) && (status == MAMA_STATUS_OK); i++) {
+        nanosleep(&pause, NULL);
+
+        __atomic_store_n(&run.m_done, 0, __ATOMIC_RELAXED);
+        run.m_sent = mmeBench_now();
+        status = mamaQueue_enqueueEvent(session->m_queue, latencyBench_onEvent, (void*)&run);
+        while ((status == MAMA_STATUS_OK) && (__atomic_load_n(&run.m_done, __ATOMIC_ACQUIRE) == 0)) {
+        }
+
+        samples[i] = run.m_latency;
+        total += run.m_latency;
+    }
+
+    if (status == MAMA_STATUS_OK) {
+        mmeBench_report("dispatch latency", variant, "idle", total, LATENCY_SAMPLES);
+
+        qsort(samples, LATENCY_SAMPLES, sizeof(uint64_t), latencyBench_compare);
+        printf("%-20s %-16s p50=%.1f p99=%.1f p99.9=%.1f ns\n", "dispatch latency", variant,
+               (double)samples[LATENCY_SAMPLES / 2],
+               (double)samples[(LATENCY_SAMPLES * 99) / 100],
+               (double)samples[(LATENCY_SAMPLES * 999) / 1000]);
+    }
+    else {
+        fprintf(stderr, "Enqueuing on a %s session failed, status %d\n", variant, (int)status);
+    }
+
+    free(samples);
+    mamaEnv_destroySession(connection, session);
+    return status;
+}
+
+
+int main(int argc, char** argv)
+{
+    mamaBridge bridge = NULL;
+    if (mmeBench_openBridge(argc, argv, &bridge) != MAMA_STATUS_OK) {
+        return 1;
+    }
+
+    mamaEnvConnection connection = NULL;
+    mama_status status = mamaEnv_createConnection(bridge, &connection);
+    if (status == MAMA_STATUS_OK) {
+        latencyBench_run(connection, mamaEnvDispatchBlocking, "blocking");
+        latencyBench_run(connection, mamaEnvDispatchPolling, "polling");
+        latencyBench_run(connection, mamaEnvDispatchAdaptive, "adaptive");
+        mamaEnv_destroyConnection(connection);
+    }
+
+    mama_close();
+    return (status == MAMA_STATUS_OK) ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+/* Measures the cost of guarding a callback, as done for every message, with the gate and with
+ * the wlock that the gate replaced. The time per operation is taken over blocks of operations
+ * so that the clock is not read on every one, and the percentiles are of those blocks.
+ */
+#include "mmeBench.h"
+#include "mamaEnvGatePrivate.h"
+#include <wlock.h>
+
+/* The number of blocks timed, and the operations in each. */
+#define GATEBENCH_BLOCKS 100000
+#define GATEBENCH_BLOCK_SIZE 100
+
+
+static int gateBench_compare(const void* left, const void* right)
+{
+    uint64_t l = *(const uint64_t*)left;
+    uint64_t r = *(const uint64_t*)right;
+    return (l < r) ? -1 : ((l > r) ? 1 : 0);
+}
+
+
+static void gateBench_report(const char* variant, uint64_t* blocks)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < GATEBENCH_BLOCKS; i++) {
+        total += blocks[i];
+    }
+    mmeBench_report("callback guard", variant, "uncontended", total, (uint64_t)GATEBENCH_BLOCKS * GATEBENCH_BLOCK_SIZE);
+
+    qsort(blocks, GATEBENCH_BLOCKS, sizeof(uint64_t), gateBench_compare);
+    printf("%-20s %-16s p50=%.1f p99=%.1f p99.9=%.1f ns/op\n", "callback guard", variant,
+           (double)blocks[GATEBENCH_BLOCKS / 2] / GATEBENCH_BLOCK_SIZE,
+           (double)blocks[(GATEBENCH_BLOCKS * 99) / 100] / GATEBENCH_BLOCK_SIZE,
+           (double)blocks[(GATEBENCH_BLOCKS * 999) / 1000] / GATEBENCH_BLOCK_SIZE);
+}
+
+
+int main(int argc, char** argv)
+{
+    uint64_t* blocks = (uint64_t*)calloc(GATEBENCH_BLOCKS, sizeof(uint64_t));
+    volatile int callbacks = 0;
+
+    /* The gate, entered and left around each callback. */
+    mmeGate gate = { 0 };
+    for (size_t b = 0; b < GATEBENCH_BLOCKS; b++) {
+        uint64_t start = mmeBench_now();
+        for (size_t i = 0; i < GATEBENCH_BLOCK_SIZE; i++) {
+            mmeGate* previous = NULL;
+            if (mamaEnvGate_enter(&gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+                callbacks++;
+                mamaEnvGate_exit(&gate, previous);
+            }
+        }
+        blocks[b] = mmeBench_now() - start;
+    }
+    gateBench_report("gate", blocks);
+
+    /* The lock, taken and released around each callback. */
+    wLock lock = wlock_create();
+    for (size_t b = 0; b < GATEBENCH_BLOCKS; b++) {
+        uint64_t start = mmeBench_now();
+        for (size_t i = 0; i < GATEBENCH_BLOCK_SIZE; i++) {
+            wlock_lock(lock);
+            callbacks++;
+            wlock_unlock(lock);
+        }
+        blocks[b] = mmeBench_now() - start;
+    }
+    gateBench_report("wlock", blocks);
+    wlock_destroy(lock);
+
+    free(blocks);
+
+    return 0;
+}
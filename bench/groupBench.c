@@ -0,0 +1,121 @@
+/* Measures event throughput through a session group as the number of sessions grows, producers
+ * resolving each symbol's session with mamaEnv_getGroupSession and enqueuing on its queue.
+ */
+#include "mmeBench.h"
+#include "mama/mamaManagedEnvironment.h"
+#include "mama/mamaEnvSession.h"
+#include <pthread.h>
+#include <sched.h>
+
+/* The producing threads, the events each enqueues, and the symbols the events are spread over. */
+#define GROUP_PRODUCERS 4
+#define GROUP_EVENTS 500000
+#define GROUP_SYMBOLS 10000
+
+/* The group sizes measured. */
+static const mama_u32_t sg_groupSessions[] = { 1, 2, 4, 8, 16 };
+
+static char sg_symbols[GROUP_SYMBOLS][16];
+
+
+typedef struct groupBenchRun
+{
+    mamaEnvSessionGroup m_group;
+    pthread_barrier_t m_start;
+    mama_u64_t m_delivered;
+    mama_status m_status;
+
+} groupBenchRun;
+
+
+static void MAMACALLTYPE groupBench_onEvent(mamaQueue queue, void* closure)
+{
+    __atomic_add_fetch(&((groupBenchRun*)closure)->m_delivered, 1, __ATOMIC_RELAXED);
+}
+
+
+static void* groupBench_producer(void* closure)
+{
+    groupBenchRun* run = (groupBenchRun*)closure;
+    pthread_barrier_wait(&run->m_start);
+
+    for (size_t i = 0; i < GROUP_EVENTS; i++) {
+        mamaEnvSession session = NULL;
+        mama_status status = mamaEnv_getGroupSession(run->m_group, sg_symbols[i % GROUP_SYMBOLS], &session);
+        if (status == MAMA_STATUS_OK) {
+            status = mamaQueue_enqueueEvent(session->m_queue, groupBench_onEvent, (void*)run);
+        }
+        if (status != MAMA_STATUS_OK) {
+            __atomic_store_n(&run->m_status, status, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+
+static mama_status groupBench_run(mamaEnvConnection connection, mama_u32_t numberSessions)
+{
+    groupBenchRun run = { NULL };
+    mama_status status = mamaEnv_createSessionGroup(connection, numberSessions, &run.m_group);
+    if (status != MAMA_STATUS_OK) {
+        return status;
+    }
+
+    pthread_t producers[GROUP_PRODUCERS];
+    pthread_barrier_init(&run.m_start, NULL, GROUP_PRODUCERS + 1);
+    for (int p = 0; p < GROUP_PRODUCERS; p++) {
+        pthread_create(&producers[p], NULL, groupBench_producer, (void*)&run);
+    }
+
+    /* The run ends once every event has been dispatched, not when the producers finish enqueuing. */
+    pthread_barrier_wait(&run.m_start);
+    uint64_t begin = mmeBench_now();
+    for (int p = 0; p < GROUP_PRODUCERS; p++) {
+        pthread_join(producers[p], NULL);
+    }
+    const mama_u64_t expected = (mama_u64_t)GROUP_PRODUCERS * GROUP_EVENTS;
+    while ((__atomic_load_n(&run.m_status, __ATOMIC_RELAXED) == MAMA_STATUS_OK) && (__atomic_load_n(&run.m_delivered, __ATOMIC_RELAXED) < expected)) {
+        sched_yield();
+    }
+    uint64_t elapsed = mmeBench_now() - begin;
+
+    if (run.m_status == MAMA_STATUS_OK) {
+        char parameters[32];
+        snprintf(parameters, sizeof(parameters), "sessions=%u", numberSessions);
+        mmeBench_report("group dispatch", "getGroupSession", parameters, elapsed, expected);
+    }
+    else {
+        fprintf(stderr, "Enqueuing on a group of %u sessions failed, status %d\n", numberSessions, (int)run.m_status);
+    }
+
+    pthread_barrier_destroy(&run.m_start);
+    mamaEnv_destroySessionGroup(run.m_group);
+    return run.m_status;
+}
+
+
+int main(int argc, char** argv)
+{
+    mamaBridge bridge = NULL;
+    if (mmeBench_openBridge(argc, argv, &bridge) != MAMA_STATUS_OK) {
+        return 1;
+    }
+
+    for (size_t s = 0; s < GROUP_SYMBOLS; s++) {
+        snprintf(sg_symbols[s], sizeof(sg_symbols[s]), "SYM%05zu", s);
+    }
+
+    mamaEnvConnection connection = NULL;
+    mama_status status = mamaEnv_createConnection(bridge, &connection);
+    if (status == MAMA_STATUS_OK) {
+        for (size_t g = 0; g < sizeof(sg_groupSessions) / sizeof(sg_groupSessions[0]); g++) {
+            groupBench_run(connection, sg_groupSessions[g]);
+        }
+        mamaEnv_destroyConnection(connection);
+    }
+
+    mama_close();
+    return (status == MAMA_STATUS_OK) ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+/* Measures insert, lookup and remove on a SynchronizedMap keyed by object pointers, as the
+ * session maps are, for the red black tree and the open addressing hash table.
+ */
+#include "mmeBench.h"
+#include "mama/mamaSynchronizedMap.h"
+
+/* The map sizes measured. */
+static const size_t sg_sizes[] = { 1000, 10000, 100000, 1000000 };
+
+
+static mama_status mapBench_onFind(void* data, void* closure)
+{
+    (*(size_t*)closure)++;
+    return MAMA_STATUS_OK;
+}
+
+
+static void mapBench_run(SynchronizedMapType type, const char* variant, void** keys, size_t count)
+{
+    SynchronizedMap* map = synchronizedMap_createWithType(type);
+    if (map == NULL) {
+        fprintf(stderr, "mapBench - failed to create the %s map.\n", variant);
+        exit(1);
+    }
+
+    char parameters[32];
+    snprintf(parameters, sizeof(parameters), "n=%zu", count);
+
+    /* Insert in one order, then look up and remove in another, as objects are created and
+     * destroyed in different orders by an application.
+     */
+    uint64_t start = mmeBench_now();
+    for (size_t i = 0; i < count; i++) {
+        synchronizedMap_insert(keys[i], keys[i], map);
+    }
+    mmeBench_report("map insert", variant, parameters, mmeBench_now() - start, count);
+
+    mmeBench_shuffle(keys, count);
+
+    size_t found = 0;
+    start = mmeBench_now();
+    for (size_t i = 0; i < count; i++) {
+        synchronizedMap_for(mapBench_onFind, keys[i], map, (void*)&found);
+    }
+    mmeBench_report("map find", variant, parameters, mmeBench_now() - start, count);
+
+    void* data = NULL;
+    start = mmeBench_now();
+    for (size_t i = 0; i < count; i++) {
+        synchronizedMap_remove(keys[i], map, &data);
+    }
+    mmeBench_report("map remove", variant, parameters, mmeBench_now() - start, count);
+
+    if (found != count) {
+        fprintf(stderr, "mapBench - %s map found %zu of %zu keys.\n", variant, found, count);
+    }
+
+    synchronizedMap_destroy(map);
+}
+
+
+int main(int argc, char** argv)
+{
+    for (size_t s = 0; s < sizeof(sg_sizes) / sizeof(sg_sizes[0]); s++) {
+        size_t count = sg_sizes[s];
+
+        /* The keys are real heap addresses, like the mama objects the session maps are keyed on. */
+        void** keys = (void**)malloc(count * sizeof(void*));
+        for (size_t i = 0; i < count; i++) {
+            keys[i] = malloc(64);
+        }
+
+        mmeBench_shuffle(keys, count);
+        mapBench_run(RedBlackTreeMap, "rbtree", keys, count);
+        mmeBench_shuffle(keys, count);
+        mapBench_run(HashTableMap, "hashtable", keys, count);
+
+        for (size_t i = 0; i < count; i++) {
+            free(keys[i]);
+        }
+        free(keys);
+    }
+
+    return 0;
+}
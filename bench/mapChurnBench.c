@@ -0,0 +1,99 @@
+/* Measures concurrent churn on one session's subscription map, each thread repeatedly
+ * inserting and removing its own keys, for a single locked map and the sharded map.
+ */
+#include "mmeBench.h"
+#include "mama/mamaSynchronizedMap.h"
+#include "mama/mamaEnvSession.h"
+#include <pthread.h>
+
+/* The number of keys each thread churns, and how many times it churns them. */
+#define MAPCHURN_KEYS 1000
+#define MAPCHURN_ROUNDS 200
+
+/* The thread counts measured. */
+static const size_t sg_threads[] = { 1, 2, 4, 8, 16, 32 };
+
+
+typedef struct mapChurnThread
+{
+    SynchronizedMap* m_map;
+    void** m_keys;
+    pthread_barrier_t* m_start;
+
+} mapChurnThread;
+
+
+static void* mapChurn_thread(void* closure)
+{
+    mapChurnThread* thread = (mapChurnThread*)closure;
+
+    pthread_barrier_wait(thread->m_start);
+    void* data = NULL;
+    for (size_t round = 0; round < MAPCHURN_ROUNDS; round++) {
+        for (size_t i = 0; i < MAPCHURN_KEYS; i++) {
+            synchronizedMap_insert(thread->m_keys[i], thread->m_keys[i], thread->m_map);
+        }
+        for (size_t i = 0; i < MAPCHURN_KEYS; i++) {
+            synchronizedMap_remove(thread->m_keys[i], thread->m_map, &data);
+        }
+    }
+
+    return NULL;
+}
+
+
+static void mapChurn_run(SynchronizedMap* map, const char* variant, size_t numberThreads)
+{
+    pthread_t* threads = (pthread_t*)calloc(numberThreads, sizeof(pthread_t));
+    mapChurnThread* closures = (mapChurnThread*)calloc(numberThreads, sizeof(mapChurnThread));
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)(numberThreads + 1));
+
+    for (size_t t = 0; t < numberThreads; t++) {
+        closures[t].m_map = map;
+        closures[t].m_start = &start;
+        closures[t].m_keys = (void**)malloc(MAPCHURN_KEYS * sizeof(void*));
+        for (size_t i = 0; i < MAPCHURN_KEYS; i++) {
+            closures[t].m_keys[i] = malloc(64);
+        }
+        pthread_create(&threads[t], NULL, mapChurn_thread, (void*)&closures[t]);
+    }
+
+    /* Time from releasing the threads until the last one has finished. */
+    pthread_barrier_wait(&start);
+    uint64_t begin = mmeBench_now();
+    for (size_t t = 0; t < numberThreads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    uint64_t elapsed = mmeBench_now() - begin;
+
+    char parameters[32];
+    snprintf(parameters, sizeof(parameters), "threads=%zu", numberThreads);
+    mmeBench_report("map churn", variant, parameters, elapsed, (uint64_t)numberThreads * MAPCHURN_ROUNDS * MAPCHURN_KEYS * 2);
+
+    for (size_t t = 0; t < numberThreads; t++) {
+        for (size_t i = 0; i < MAPCHURN_KEYS; i++) {
+            free(closures[t].m_keys[i]);
+        }
+        free(closures[t].m_keys);
+    }
+    pthread_barrier_destroy(&start);
+    free(closures);
+    free(threads);
+}
+
+
+int main(int argc, char** argv)
+{
+    for (size_t t = 0; t < sizeof(sg_threads) / sizeof(sg_threads[0]); t++) {
+        SynchronizedMap* single = synchronizedMap_createWithType(HashTableMap);
+        mapChurn_run(single, "single", sg_threads[t]);
+        synchronizedMap_destroy(single);
+
+        SynchronizedMap* sharded = synchronizedMap_createSharded(HashTableMap, MMES_SUBSCRIPTION_SHARDS);
+        mapChurn_run(sharded, "sharded", sg_threads[t]);
+        synchronizedMap_destroy(sharded);
+    }
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef MMEBENCH_H
+#define MMEBENCH_H
+
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mama/mamaEnvGeneral.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+/* ********************************************************** */
+/* Functions. */
+/* ********************************************************** */
+
+/* Returns the monotonic time in nanoseconds. */
+MAMAENVINLINE uint64_t mmeBench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ull) + (uint64_t)now.tv_nsec;
+}
+
+/* Writes one result line, the same layout is used by every benchmark so that runs can be compared. */
+MAMAENVINLINE void mmeBench_report(const char* benchmark, const char* variant, const char* parameters, uint64_t nanoseconds, uint64_t operations)
+{
+    printf("%-20s %-16s %-24s %12.1f ns/op %14.0f ops/s\n", benchmark, variant, parameters,
+           (operations > 0) ? ((double)nanoseconds / (double)operations) : 0.0,
+           (nanoseconds > 0) ? ((double)operations * 1000000000.0 / (double)nanoseconds) : 0.0);
+}
+
+/* Shuffles an array of pointers with a fixed seed, so that every run uses the same order. */
+MAMAENVINLINE void mmeBench_shuffle(void** items, size_t count)
+{
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (size_t i = count; i > 1; i--) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        size_t j = (size_t)(seed % i);
+        void* swap = items[i - 1];
+        items[i - 1] = items[j];
+        items[j] = swap;
+    }
+}
+
+/* Loads the middleware bridge named by the first argument, or by MME_BENCH_MIDDLEWARE, (qpid when
+ * neither is given), and opens MAMA, for the benchmarks that need a connection.
+ */
+MAMAENVINLINE mama_status mmeBench_openBridge(int argc, char** argv, mamaBridge* bridge)
+{
+    const char* middleware = (argc > 1) ? argv[1] : getenv("MME_BENCH_MIDDLEWARE");
+    if (middleware == NULL) {
+        middleware = "qpid";
+    }
+
+    mama_status status = mama_loadBridge(bridge, middleware);
+    if (status == MAMA_STATUS_OK) {
+        status = mama_open();
+    }
+    if (status != MAMA_STATUS_OK) {
+        fprintf(stderr, "Unable to open the %s bridge, status %d\n", middleware, (int)status);
+    }
+
+    return status;
+}
+
+#endif
@@ -0,0 +1,143 @@
+/* Measures allocating subscription wrappers on application threads and freeing them on another
+ * thread, as happens when subscriptions are destroyed on the session's dispatch thread, for the
+ * pool and for calloc plus the per object lock the wrappers used to create.
+ */
+#include "mmeBench.h"
+#include "mama/mamaEnvPool.h"
+#include "mama/mamaEnvSubscription.h"
+#include <pthread.h>
+#include <wlock.h>
+
+/* The objects each allocating thread hands over, and the size of the ring it hands them over on. */
+#define POOLBENCH_OBJECTS 2000000
+#define POOLBENCH_RING 1024
+
+/* The numbers of allocating and freeing thread pairs measured. */
+static const size_t sg_pairs[] = { 1, 2, 4, 8 };
+
+
+/* One object allocated the old way, with its own lock. */
+typedef struct poolBenchLocked
+{
+    mmeSubscription* m_object;
+    wLock m_lock;
+
+} poolBenchLocked;
+
+
+/* A single producer, single consumer ring between an allocating and a freeing thread. */
+typedef struct poolBenchPair
+{
+    void* m_ring[POOLBENCH_RING];
+    size_t m_head;
+    size_t m_tail;
+    int m_usePool;
+    pthread_barrier_t* m_start;
+
+} poolBenchPair;
+
+
+static void* poolBench_allocator(void* closure)
+{
+    poolBenchPair* pair = (poolBenchPair*)closure;
+    pthread_barrier_wait(pair->m_start);
+
+    for (size_t i = 0; i < POOLBENCH_OBJECTS; i++) {
+        void* object = NULL;
+        if (pair->m_usePool) {
+            object = mamaEnvPool_allocate(mamaEnvSubscriptionObject);
+        }
+        else {
+            poolBenchLocked* locked = (poolBenchLocked*)malloc(sizeof(poolBenchLocked));
+            locked->m_object = (mmeSubscription*)calloc(1, sizeof(mmeSubscription));
+            locked->m_lock = wlock_create();
+            object = locked;
+        }
+
+        size_t head = pair->m_head;
+        while (head - __atomic_load_n(&pair->m_tail, __ATOMIC_ACQUIRE) == POOLBENCH_RING) {
+        }
+        pair->m_ring[head % POOLBENCH_RING] = object;
+        __atomic_store_n(&pair->m_head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+
+static void* poolBench_freer(void* closure)
+{
+    poolBenchPair* pair = (poolBenchPair*)closure;
+    pthread_barrier_wait(pair->m_start);
+
+    for (size_t i = 0; i < POOLBENCH_OBJECTS; i++) {
+        size_t tail = pair->m_tail;
+        while (__atomic_load_n(&pair->m_head, __ATOMIC_ACQUIRE) == tail) {
+        }
+        void* object = pair->m_ring[tail % POOLBENCH_RING];
+        __atomic_store_n(&pair->m_tail, tail + 1, __ATOMIC_RELEASE);
+
+        if (pair->m_usePool) {
+            mamaEnvPool_free(mamaEnvSubscriptionObject, object);
+        }
+        else {
+            poolBenchLocked* locked = (poolBenchLocked*)object;
+            wlock_destroy(locked->m_lock);
+            free(locked->m_object);
+            free(locked);
+        }
+    }
+
+    return NULL;
+}
+
+
+static void poolBench_run(int usePool, size_t numberPairs)
+{
+    poolBenchPair* pairs = (poolBenchPair*)calloc(numberPairs, sizeof(poolBenchPair));
+    pthread_t* threads = (pthread_t*)calloc(numberPairs * 2, sizeof(pthread_t));
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)(numberPairs * 2 + 1));
+
+    for (size_t p = 0; p < numberPairs; p++) {
+        pairs[p].m_usePool = usePool;
+        pairs[p].m_start = &start;
+        pthread_create(&threads[p * 2], NULL, poolBench_allocator, (void*)&pairs[p]);
+        pthread_create(&threads[p * 2 + 1], NULL, poolBench_freer, (void*)&pairs[p]);
+    }
+
+    pthread_barrier_wait(&start);
+    uint64_t begin = mmeBench_now();
+    for (size_t t = 0; t < numberPairs * 2; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    uint64_t elapsed = mmeBench_now() - begin;
+
+    char parameters[32];
+    snprintf(parameters, sizeof(parameters), "pairs=%zu", numberPairs);
+    mmeBench_report("alloc remote free", usePool ? "pool" : "calloc+wlock", parameters, elapsed, (uint64_t)numberPairs * POOLBENCH_OBJECTS);
+
+    pthread_barrier_destroy(&start);
+    free(threads);
+    free(pairs);
+}
+
+
+int main(int argc, char** argv)
+{
+    for (size_t p = 0; p < sizeof(sg_pairs) / sizeof(sg_pairs[0]); p++) {
+        poolBench_run(0, sg_pairs[p]);
+        poolBench_run(1, sg_pairs[p]);
+    }
+
+    /* Show how the pool behaved, (returns count the caches handed back to the shared list). */
+    mamaEnvAllocatorStats stats;
+    if (mamaEnv_getAllocatorStats(mamaEnvSubscriptionObject, &stats) == MAMA_STATUS_OK) {
+        printf("subscription pool slabs=%llu bytes=%llu allocations=%llu frees=%llu refills=%llu returns=%llu\n",
+               (unsigned long long)stats.m_slabs, (unsigned long long)stats.m_bytesReserved,
+               (unsigned long long)stats.m_allocations, (unsigned long long)stats.m_frees,
+               (unsigned long long)stats.m_refills, (unsigned long long)stats.m_returns);
+    }
+
+    return 0;
+}
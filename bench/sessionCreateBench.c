@@ -0,0 +1,74 @@
+/* Measures creating sessions on a new connection one at a time with mamaEnv_createSession, and all
+ * at once with mamaEnv_createSessions, which starts the dispatch threads together.
+ */
+#include "mmeBench.h"
+#include "mama/mamaManagedEnvironment.h"
+
+/* The number of connections created for each measurement. */
+#define SESSIONCREATE_RUNS 20
+
+/* The session counts measured. */
+static const mama_u32_t sg_sessions[] = { 1, 64, 512 };
+
+
+static mama_status sessionCreate_run(mamaBridge bridge, int batched, mama_u32_t numberSessions)
+{
+    mamaEnvSession* sessions = (mamaEnvSession*)calloc(numberSessions, sizeof(mamaEnvSession));
+    if (sessions == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+
+    mama_status status = MAMA_STATUS_OK;
+    uint64_t elapsed = 0;
+    for (int run = 0; (run < SESSIONCREATE_RUNS) && (status == MAMA_STATUS_OK); run++) {
+        mamaEnvConnection connection = NULL;
+        status = mamaEnv_createConnection(bridge, &connection);
+        if (status != MAMA_STATUS_OK) {
+            break;
+        }
+
+        /* Only the session creation is timed, the connection is set up and torn down outside it. */
+        uint64_t begin = mmeBench_now();
+        if (batched) {
+            status = mamaEnv_createSessions(connection, numberSessions, sessions);
+        }
+        else {
+            for (mama_u32_t s = 0; (s < numberSessions) && (status == MAMA_STATUS_OK); s++) {
+                status = mamaEnv_createSession(connection, &sessions[s]);
+            }
+        }
+        elapsed += mmeBench_now() - begin;
+
+        mamaEnv_destroyConnection(connection);
+    }
+
+    if (status == MAMA_STATUS_OK) {
+        char parameters[32];
+        snprintf(parameters, sizeof(parameters), "sessions=%u", numberSessions);
+        mmeBench_report("session create", batched ? "createSessions" : "createSession", parameters, elapsed,
+                        (uint64_t)numberSessions * SESSIONCREATE_RUNS);
+    }
+    else {
+        fprintf(stderr, "Creating %u sessions failed, status %d\n", numberSessions, (int)status);
+    }
+
+    free(sessions);
+    return status;
+}
+
+
+int main(int argc, char** argv)
+{
+    mamaBridge bridge = NULL;
+    if (mmeBench_openBridge(argc, argv, &bridge) != MAMA_STATUS_OK) {
+        return 1;
+    }
+
+    for (size_t s = 0; s < sizeof(sg_sessions) / sizeof(sg_sessions[0]); s++) {
+        sessionCreate_run(bridge, 0, sg_sessions[s]);
+        sessionCreate_run(bridge, 1, sg_sessions[s]);
+    }
+
+    mama_close();
+    return 0;
+}
@@ -0,0 +1,108 @@
+/* Measures subscribing one session to many symbols with mamaEnv_createBasicSubscription in a loop
+ * and with mamaEnv_createBasicSubscriptions. The transport is named by the second argument, or by
+ * MME_BENCH_TRANSPORT, and must be defined in mama.properties for the middleware.
+ */
+#include "mmeBench.h"
+#include "mama/mamaManagedEnvironment.h"
+#include <string.h>
+
+/* The number of symbols subscribed. */
+#define SUBSCRIBE_SYMBOLS 100000
+
+
+static void MAMACALLTYPE subscribeBench_onMsg(mamaSubscription subscription, mamaMsg msg, void* closure, void* itemClosure)
+{
+}
+
+
+static mama_status subscribeBench_run(mamaBridge bridge, const char* transportName, const char** symbols, int batched)
+{
+    mamaEnvConnection connection = NULL;
+    mamaEnvSession session = NULL;
+    mamaTransport transport = NULL;
+    mama_status status = mamaEnv_createConnection(bridge, &connection);
+    if (status == MAMA_STATUS_OK) {
+        status = mamaEnv_createSession(connection, &session);
+    }
+    if (status == MAMA_STATUS_OK) {
+        status = mamaTransport_allocate(&transport);
+    }
+    if (status == MAMA_STATUS_OK) {
+        status = mamaTransport_create(transport, transportName, bridge);
+    }
+
+    mamaMsgCallbacks callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.onMsg = subscribeBench_onMsg;
+
+    mamaSubscription* subscriptions = (mamaSubscription*)calloc(SUBSCRIBE_SYMBOLS, sizeof(mamaSubscription));
+    mama_status* statuses = (mama_status*)calloc(SUBSCRIBE_SYMBOLS, sizeof(mama_status));
+    if ((status == MAMA_STATUS_OK) && ((subscriptions == NULL) || (statuses == NULL))) {
+        status = MAMA_STATUS_NOMEM;
+    }
+
+    if (status == MAMA_STATUS_OK) {
+        uint64_t begin = mmeBench_now();
+        if (batched) {
+            status = mamaEnv_createBasicSubscriptions(&callbacks, NULL, session, symbols, SUBSCRIBE_SYMBOLS, transport,
+                                                      subscriptions, statuses);
+        }
+        else {
+            for (mama_u32_t s = 0; (s < SUBSCRIBE_SYMBOLS) && (status == MAMA_STATUS_OK); s++) {
+                status = mamaEnv_createBasicSubscription(&callbacks, NULL, session, symbols[s], transport, &subscriptions[s]);
+            }
+        }
+        uint64_t elapsed = mmeBench_now() - begin;
+
+        if (status == MAMA_STATUS_OK) {
+            char parameters[32];
+            snprintf(parameters, sizeof(parameters), "symbols=%u", SUBSCRIBE_SYMBOLS);
+            mmeBench_report("subscribe", batched ? "createBasicSubscriptions" : "createBasicSubscription", parameters,
+                            elapsed, SUBSCRIBE_SYMBOLS);
+        }
+    }
+
+    if (status != MAMA_STATUS_OK) {
+        fprintf(stderr, "Subscribing on transport %s failed, status %d\n", transportName, (int)status);
+    }
+
+    /* The subscriptions are left for the connection to destroy, before the transport they use. */
+    if (connection != NULL) {
+        mamaEnv_destroyConnection(connection);
+    }
+    if (transport != NULL) {
+        mamaTransport_destroy(transport);
+    }
+    free(statuses);
+    free(subscriptions);
+    return status;
+}
+
+
+int main(int argc, char** argv)
+{
+    mamaBridge bridge = NULL;
+    if (mmeBench_openBridge(argc, argv, &bridge) != MAMA_STATUS_OK) {
+        return 1;
+    }
+
+    const char* transportName = (argc > 2) ? argv[2] : getenv("MME_BENCH_TRANSPORT");
+    if (transportName == NULL) {
+        transportName = "sub";
+    }
+
+    char* names = (char*)malloc((size_t)SUBSCRIBE_SYMBOLS * 16);
+    const char** symbols = (const char**)malloc(SUBSCRIBE_SYMBOLS * sizeof(const char*));
+    for (size_t s = 0; s < SUBSCRIBE_SYMBOLS; s++) {
+        snprintf(&names[s * 16], 16, "MME.BENCH.%05zu", s);
+        symbols[s] = &names[s * 16];
+    }
+
+    subscribeBench_run(bridge, transportName, symbols, 0);
+    subscribeBench_run(bridge, transportName, symbols, 1);
+
+    free((void*)symbols);
+    free(names);
+    mama_close();
+    return 0;
+}
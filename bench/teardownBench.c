@@ -0,0 +1,80 @@
+/* Measures destroying a connection as the number of sessions and of live objects per session grows,
+ * the objects being long interval timers that never fire during the run.
+ */
+#include "mmeBench.h"
+#include "mama/mamaManagedEnvironment.h"
+
+/* The number of connections destroyed for each measurement, and the interval of the timers. */
+#define TEARDOWN_RUNS 5
+#define TEARDOWN_INTERVAL 60.0
+
+/* The session counts and timers per session measured. */
+static const mama_u32_t sg_sessions[] = { 1, 64, 512 };
+static const mama_u32_t sg_timers[] = { 0, 100, 1000 };
+
+
+static void MAMACALLTYPE teardown_onTimer(mamaTimer timer, void* closure)
+{
+}
+
+
+static mama_status teardown_run(mamaBridge bridge, mama_u32_t numberSessions, mama_u32_t numberTimers)
+{
+    mamaEnvSession* sessions = (mamaEnvSession*)calloc(numberSessions, sizeof(mamaEnvSession));
+    if (sessions == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+
+    mama_status status = MAMA_STATUS_OK;
+    uint64_t elapsed = 0;
+    for (int run = 0; (run < TEARDOWN_RUNS) && (status == MAMA_STATUS_OK); run++) {
+        mamaEnvConnection connection = NULL;
+        status = mamaEnv_createConnection(bridge, &connection);
+        if (status != MAMA_STATUS_OK) {
+            break;
+        }
+
+        status = mamaEnv_createSessions(connection, numberSessions, sessions);
+        for (mama_u32_t s = 0; (s < numberSessions) && (status == MAMA_STATUS_OK); s++) {
+            for (mama_u32_t t = 0; (t < numberTimers) && (status == MAMA_STATUS_OK); t++) {
+                mamaTimer timer = NULL;
+                status = mamaEnv_createTimer(teardown_onTimer, NULL, TEARDOWN_INTERVAL, sessions[s], &timer);
+            }
+        }
+
+        /* The timers are left for the connection to destroy, that being what is measured. */
+        uint64_t begin = mmeBench_now();
+        mamaEnv_destroyConnection(connection);
+        elapsed += mmeBench_now() - begin;
+    }
+
+    if (status == MAMA_STATUS_OK) {
+        char parameters[32];
+        snprintf(parameters, sizeof(parameters), "sessions=%u timers=%u", numberSessions, numberTimers);
+        mmeBench_report("connection destroy", "destroyConnection", parameters, elapsed, TEARDOWN_RUNS);
+    }
+    else {
+        fprintf(stderr, "Setting up %u sessions with %u timers failed, status %d\n", numberSessions, numberTimers, (int)status);
+    }
+
+    free(sessions);
+    return status;
+}
+
+
+int main(int argc, char** argv)
+{
+    mamaBridge bridge = NULL;
+    if (mmeBench_openBridge(argc, argv, &bridge) != MAMA_STATUS_OK) {
+        return 1;
+    }
+
+    for (size_t s = 0; s < sizeof(sg_sessions) / sizeof(sg_sessions[0]); s++) {
+        for (size_t t = 0; t < sizeof(sg_timers) / sizeof(sg_timers[0]); t++) {
+            teardown_run(bridge, sg_sessions[s], sg_timers[t]);
+        }
+    }
+
+    mama_close();
+    return 0;
+}
@@ -4,15 +4,34 @@
 #include <list.h>
 #include "mamaEnvEvent.h"
 #include "mamaEnvSession.h"
-
-/* The interval at which the session timer ticks. */
-#define MEVC_SESSION_TIMER_INTERVAL 1
+#include "mamaEnvWorkerPool.h"
+#include "mamaEnvSharedSubscription.h"
 
 /* The amount of time to wait on all sessions being destroyed before an error is
  * returned is set to 10 seconds.
  */
 #define MEVC_DESTROY_WAIT_TIME 10
 
+/* The first and longest delays in seconds between attempts to reclaim a session while mama
+ * is still closing objects on its queue, the delay doubles with each attempt.
+ */
+#define MEVC_RECLAIM_RETRY_MIN 0.001
+#define MEVC_RECLAIM_RETRY_MAX 0.1
+
+
+/* The sessions that offloaded subscriptions deliver on, published in one go so that the
+ * count always matches the array.
+ */
+typedef struct mmeOffloadLanes
+{
+    /* The number of lanes. */
+    mama_u32_t m_numberLanes;
+
+    /* The lanes. */
+    mmeSession* m_lanes[];
+
+} mmeOffloadLanes;
+
 
 /* This structure holds all the information required for a connection. */
 typedef struct mmeConnection
@@ -23,6 +42,11 @@ typedef struct mmeConnection
     /* Used when destroying the connection. */
     MamaEvent* m_destroySynch;
 
+    /* Set on the object thread once the connection is being destroyed, after which the
+     * last session to be reclaimed sets m_destroySynch.
+     */
+    int m_destroying;
+
     /* The dispatcher used to pump the object queue. */
     mamaDispatcher m_objectDispatcher;
 
@@ -32,11 +56,25 @@ typedef struct mmeConnection
     /* The list of active sessions. */
     wList m_sessions;
 
-    /* The list of destroyed sessions. */
+    /* The list of destroyed sessions, each is reclaimed once its last object has been destroyed. */
     wList m_destroyedSessions;
 
-    /* The session timer is used to destroy sessions. */
-    mamaTimer m_sessionTimer;
+    /* The threads that dispatch worker pool sessions, NULL until mamaEnv_createWorkerPool. */
+    mmeWorkerPool* m_workerPool;
+
+    /* The shared subscriptions, keyed on (transport, source, symbol). */
+    mmeInterestTable m_interests;
+
+    /* The hidden session that dispatches the shared subscriptions, NULL until the first one. */
+    mmeSession* m_sharingSession;
+
+    /* The hidden sessions that offloaded subscriptions deliver on, NULL until
+     * mamaEnv_createOffloadLanes.
+     */
+    struct mmeOffloadLanes* m_offloadLanes;
+
+    /* The lane the next offloaded subscription is pinned to. */
+    mama_u32_t m_nextOffloadLane;
 
 } mmeConnection;
 
@@ -47,15 +85,28 @@ typedef struct CreationUtilityStructure
     /* The bridge needed to create the session queue. */
     mamaBridge m_bridge;
 
-    /* The session itself. */
+    /* The session itself, when only one is being created. */
     mmeSession* m_session;
 
+    /* The sessions to create, all in the same event. */
+    mmeSession** m_sessions;
+
+    /* The number of sessions to create. */
+    mama_u32_t m_numberSessions;
+
     /* The returned status code. */
     mama_status m_status;
 
-    /* Used to synchronize creating the session. */
+    /* Used to synchronize creating the session, this is NULL for an asynchronous create. */
     MamaEvent* m_synch;
 
+    /* The connection, used to add the session to its list for an asynchronous create. */
+    struct mmeConnection* m_connection;
+
+    /* The function invoked once an asynchronous create completes, and its closure. */
+    mamaEnv_onSessionCreateCallback m_callback;
+    void* m_closure;
+
 } CreationUtilityStructure;
 
 
@@ -79,18 +130,22 @@ typedef struct WombatListUtility
 
 
 mama_status mamaEnvConnection_addSessionToList(wList list, mmeSession* session);
+mama_status mamaEnvConnection_checkDestroyComplete(mmeConnection* connection);
+mama_status mamaEnvConnection_createSessions(mmeConnection* connection, mama_u32_t numberSessions, const mamaEnvSessionAttributes* attributes, mmeSession** sessions);
 mama_status mamaEnvConnection_enumerateList(wList list, mamaEnv_listCallback cb, void* closure);
+mama_status mamaEnvConnection_getSharingSession(mmeConnection* connection, mmeSession** session);
+mama_status mamaEnvConnection_getOffloadLane(mmeConnection* connection, mmeSession** lane);
 mama_status mamaEnvConnection_deallocate(mmeConnection* connection);
+mama_status mamaEnvConnection_destroySession(mmeConnection* connection, mmeSession* session);
 mama_status mamaEnvConnection_removeSessionFromList(wList list, mmeSession* session);
 
 void MAMACALLTYPE mamaEnvConnection_onDestroyAllSessions(mamaQueue queue, void* closure);
 void MAMACALLTYPE mamaEnvConnection_onSessionCreate(mamaQueue queue, void* closure);
-mama_status mamaEnvConnection_onSessionDestroyListEnumerate(wList list, void* element, void* closure);
 mama_status mamaEnvConnection_onSessionListEnumerate(wList list, void* element, void* closure);
+void MAMACALLTYPE mamaEnvConnection_onSessionReclaim(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvConnection_onSessionReclaimRetry(mamaTimer timer, void* closure);
 void mamaEnvConnection_onWombatListCallback(wList list, void* element, void* closure);
 
-void MAMACALLTYPE mamaEnvConnection_onSessionTimerTick(mamaTimer timer, void* closure);
-
 
 
 #endif
\ No newline at end of file
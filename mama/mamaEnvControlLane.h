@@ -0,0 +1,62 @@
+#ifndef MAMAENVCONTROLLANE_H
+#define MAMAENVCONTROLLANE_H
+
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mamaEnvGeneral.h"
+#include <pthread.h>
+
+
+/* ********************************************************** */
+/* Structures. */
+/* ********************************************************** */
+
+/* An event waiting on a session's control lane. It is embedded in the object whose destroy
+ * it completes, so putting it on the lane never allocates.
+ */
+typedef struct mmeControlEvent
+{
+    /* The function to run on the dispatch thread, and its closure. */
+    mamaQueueEventCB m_callback;
+    void* m_closure;
+
+    /* The monotonic time in nanoseconds at which the event was put on the lane. */
+    mama_u64_t m_enqueued;
+
+    /* The next event on the lane. */
+    struct mmeControlEvent* m_next;
+
+} mmeControlEvent;
+
+/* A FIFO of control events that the session's dispatch thread runs ahead of the events
+ * waiting on its queue.
+ */
+typedef struct mmeControlLane
+{
+    /* Protects the list. */
+    pthread_mutex_t m_lock;
+
+    /* The waiting events, oldest first. */
+    mmeControlEvent* m_head;
+    mmeControlEvent* m_tail;
+
+    /* The number of waiting events, read without the lock so that the dispatch thread can
+     * check the lane cheaply after every callback.
+     */
+    int m_pending;
+
+    /* Statistics, written only by the dispatch thread and read atomically. */
+    mama_u64_t m_events;
+    mama_u64_t m_totalDelay;
+    mama_u64_t m_maxDelay;
+
+} mmeControlLane;
+
+
+void mamaEnvControlLane_init(mmeControlLane* lane);
+void mamaEnvControlLane_destroy(mmeControlLane* lane);
+int mamaEnvControlLane_drain(mmeControlLane* lane, mamaQueue queue, void* skip);
+int mamaEnvControlLane_push(mmeControlLane* lane, mmeControlEvent* event, mamaQueueEventCB callback, void* closure);
+
+#endif
@@ -48,4 +48,12 @@ mama_status mamaEnv_setEvent(MamaEvent* synchEvent);
 mama_status mamaEnv_timedWaitEvent(long seconds, MamaEvent* synchEvent);
 mama_status mamaEnv_waitEvent(MamaEvent* synchEvent);
 
+/* Returns a monotonic time in nanoseconds, only useful for measuring intervals. */
+mama_u64_t mamaEnv_getMonotonicTime(void);
+
+/* Returns non-zero if an interval in seconds is finite, not negative, and fits in a mama_u64_t
+ * count of nanoseconds, so that it can be converted as intervals are throughout.
+ */
+int mamaEnv_isValidInterval(mama_f64_t seconds);
+
 #endif
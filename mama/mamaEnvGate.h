@@ -0,0 +1,48 @@
+#ifndef MAMAENVGATE_H
+#define MAMAENVGATE_H
+
+#include "mamaEnvGeneral.h"
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* Set once message callbacks may no longer be invoked, (i.e. on shutdown). */
+#define MMEG_CLOSED_MSG 0x40000000
+
+/* Set once no callbacks at all may be invoked, (i.e. on destroy). */
+#define MMEG_CLOSED_ALL 0x20000000
+
+/* The remaining bits count the callbacks currently running inside the gate. */
+#define MMEG_COUNT_MASK 0x1fffffff
+
+
+/* ********************************************************** */
+/* Structures. */
+/* ********************************************************** */
+
+/* A gate guards the callback functions of an event object without a mutex. A callback
+ * enters the gate with a single compare and swap on the state word, which fails once the
+ * gate has been closed. Closing the gate sets a closed bit and then waits for the
+ * callbacks already inside to leave, after which no callback can be running.
+ */
+typedef struct mmeGate
+{
+    /* The closed bits plus the number of callbacks inside the gate. */
+    int m_state;
+
+} mmeGate;
+
+
+/* ********************************************************** */
+/* Functions. */
+/* ********************************************************** */
+
+/* Entering and leaving a gate are inline functions in src/mamaEnvGatePrivate.h, which is not
+ * installed since they use a thread local variable of the library.
+ */
+
+void mamaEnvGate_close(mmeGate* gate, int closedBits);
+void mamaEnvGate_wait(mmeGate* gate);
+
+#endif
@@ -51,4 +51,22 @@
 #endif
 #endif
 
+/* The size of a cache line, event objects are aligned to this so that objects used by
+ * different threads never share a line.
+ */
+#define MAMAENV_CACHE_LINE_SIZE 64
+
+/* Aligns a structure to a cache line, this must be placed between the struct keyword
+ * and the structure name.
+ */
+#ifndef MAMAENVCACHEALIGNED
+
+#ifdef WIN32
+#define MAMAENVCACHEALIGNED __declspec(align(64))
+#else
+#define MAMAENVCACHEALIGNED __attribute__((aligned(MAMAENV_CACHE_LINE_SIZE)))
+#endif
+
+#endif
+
 #endif
@@ -0,0 +1,97 @@
+#ifndef MAMAENVHASHTABLE_H
+#define MAMAENVHASHTABLE_H
+
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mamaEnvGeneral.h"
+#include <stddef.h>
+
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* The FNV-1a parameters, these are fixed so that a string always hashes the same regardless
+ * of platform or run, (a session group relies on this to place each symbol).
+ */
+#define MMEH_FNV_OFFSET_BASIS 2166136261u
+#define MMEH_FNV_PRIME 16777619u
+
+
+/* ********************************************************** */
+/* Structures. */
+/* ********************************************************** */
+
+/* A node of a chained hash table, which must be the first member of the structure it links
+ * so that a node's address is the structure's.
+ */
+typedef struct mmeHashNode
+{
+    /* The hash of the structure's key. */
+    mama_u32_t m_hash;
+
+    /* The next node in the same bucket. */
+    struct mmeHashNode* m_next;
+
+} mmeHashNode;
+
+
+/* A chained hash table, the caller supplies the locking and compares its own keys. */
+typedef struct mmeHashTable
+{
+    /* The buckets, NULL until the first node is added. */
+    mmeHashNode** m_buckets;
+    size_t m_numberBuckets;
+
+    /* The number of nodes in the table. */
+    size_t m_numberNodes;
+
+    /* The number of buckets when the first node is added, the table doubles whenever it
+     * holds more nodes than buckets. This must be a power of two.
+     */
+    size_t m_initialBuckets;
+
+} mmeHashTable;
+
+/* Frees a node left in the table when it is destroyed. */
+typedef void (*mamaEnvHashTable_freeNode)(mmeHashNode* node);
+
+
+void mamaEnvHashTable_init(mmeHashTable* table, size_t initialBuckets);
+void mamaEnvHashTable_destroy(mmeHashTable* table, mamaEnvHashTable_freeNode freeNode);
+mama_status mamaEnvHashTable_add(mmeHashTable* table, mmeHashNode* node);
+void mamaEnvHashTable_remove(mmeHashTable* table, mmeHashNode* node);
+
+/* Returns the first node in the bucket for a hash, or NULL, the caller follows m_next and
+ * compares its own keys for the nodes with the same hash.
+ */
+MAMAENVINLINE mmeHashNode* mamaEnvHashTable_bucket(const mmeHashTable* table, mama_u32_t hash)
+{
+    return (table->m_buckets != NULL) ? table->m_buckets[hash & (table->m_numberBuckets - 1)] : NULL;
+}
+
+/* Continues an FNV-1a hash over the bytes of a string, start with MMEH_FNV_OFFSET_BASIS. */
+MAMAENVINLINE mama_u32_t mamaEnvHash_string(mama_u32_t hash, const char* string)
+{
+    for (const unsigned char* next = (const unsigned char*)string; *next != '\0'; next++) {
+        hash ^= *next;
+        hash *= MMEH_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/* Continues an FNV-1a hash over a number of bytes, start with MMEH_FNV_OFFSET_BASIS. */
+MAMAENVINLINE mama_u32_t mamaEnvHash_bytes(mama_u32_t hash, const void* bytes, size_t length)
+{
+    const unsigned char* next = (const unsigned char*)bytes;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= next[i];
+        hash *= MMEH_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+#endif
@@ -1,34 +1,44 @@
 #ifndef MAMAENVINBOX_H
 #define MAMAENVINBOX_H
 
-#include <wlock.h>
 #include "mamaEnvGeneral.h"
+#include "mamaSynchronizedMap.h"
+#include "mamaEnvGate.h"
+#include "mamaEnvControlLane.h"
 
 /* This structure contains all of the information used to create an inbox, it will be
  * passed as a closure to the object queue.
  */
-typedef struct mmeInbox
+typedef struct MAMAENVCACHEALIGNED mmeInbox
 {
     // The mama inbox, this MUST appear first in the structure, so that mmeInbox and mamaInbox
     // can be used interchangeably.
     // (see 6.7.2.1-13. A pointer to a structure object, suitably converted, points to its initial member)
     mamaInbox m_inbox;
 
+    /* This is used to control access to the callback functions, it is kept in the same
+     * cache line as the fields read on every message.
+     */
+    mmeGate m_gate;
+
     /* The closure data provided to the create function. */
     void* m_closure;
 
+    /* The original message callback function, this will be set to NULL whenever the
+     * inbox destroy is enqueued.
+     */
+    mamaInboxMsgCallback m_msgCallback;
+
     /* The original error callback function, this will be set to NULL whenever the
      * inbox destroy is enqueued.
      */
     mamaInboxErrorCallback m_errorCallback;
 
-    /* This is used to control access to the callback function. */
-    wLock m_lock;
+    /* The session the inbox belongs to, which it holds a reference on until destroyed. */
+    struct mmeSession* m_session;
 
-    /* The original message callback function, this will be set to NULL whenever the
-     * inbox destroy is enqueued.
-     */
-    mamaInboxMsgCallback m_msgCallback;
+    /* Completes the destroy on the session's control lane, ahead of queued messages. */
+    mmeControlEvent m_destroyEvent;
 
 } mmeInbox;
 
@@ -40,6 +50,7 @@ mama_status mamaEnvInbox_shutdown(mmeInbox* inbox);
 
 void MAMACALLTYPE mamaEnvInbox_onErrorCallback(mama_status status, void* closure);
 void MAMACALLTYPE mamaEnvInbox_onInboxDestroy(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvInbox_onInboxFree(mamaQueue queue, void* closure);
 void MAMACALLTYPE mamaEnvInbox_onMessageCallback(mamaMsg msg, void* closure);
 
 #endif
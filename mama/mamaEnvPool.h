@@ -0,0 +1,32 @@
+#ifndef MAMAENVPOOL_H
+#define MAMAENVPOOL_H
+
+#include "mamaManagedEnvironment.h"
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* The number of objects carved out of each slab. */
+#define MMEP_SLAB_OBJECTS 64
+
+/* The number of free objects each thread caches per object type. */
+#define MMEP_MAGAZINE_SIZE 32
+
+/* Objects are aligned and padded to a cache line so that objects used by
+ * different threads never share one.
+ */
+#define MMEP_ALIGNMENT MAMAENV_CACHE_LINE_SIZE
+
+
+/* ********************************************************** */
+/* Functions. */
+/* ********************************************************** */
+
+/* Returns a zeroed object of the given type, or NULL if there is no memory. */
+void* mamaEnvPool_allocate(mamaEnvObjectType type);
+
+/* Returns an object to the pool, this can be called on any thread. */
+void mamaEnvPool_free(mamaEnvObjectType type, void* object);
+
+#endif
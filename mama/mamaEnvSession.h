@@ -9,12 +9,111 @@
 #include "mamaEnvInbox.h"
 #include "mamaEnvTimer.h"
 #include "mamaSynchronizedMap.h"
+#include "mamaEnvControlLane.h"
+#include <pthread.h>
+
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* The number of independently locked shards in a session's subscription map, so
+ * that threads creating and destroying subscriptions concurrently rarely contend.
+ */
+#define MMES_SUBSCRIPTION_SHARDS 16
+
+/* The highest CPU number that can appear in a session's CPU list, plus one. */
+#define MMES_MAX_CPUS 1024
+
+/* The highest NUMA node that a session can prefer, plus one. */
+#define MMES_MAX_NUMA_NODES 1024
+
+/* The longest time in milliseconds an adaptive session blocks before checking whether it
+ * should stop, (stopping also wakes it with an event so this is rarely reached).
+ */
+#define MMES_POLL_BLOCK_TIMEOUT 100
+
+/* The number of wrapper callbacks between samples of the queue depth, getting the event count
+ * takes the queue lock so it is not done for every callback.
+ */
+#define MMES_DEPTH_SAMPLE_INTERVAL 256
+
+/* The states of an application dispatched session. Destroying the session moves it to
+ * MMES_PUMP_CLOSING, and whichever thread sees that last hands the queue to a mama dispatcher
+ * so it can drain, (or drains it itself if the dispatcher can't be created), moving it to
+ * MMES_PUMP_CLOSED.
+ */
+#define MMES_PUMP_IDLE 0
+#define MMES_PUMP_PUMPING 1
+#define MMES_PUMP_CLOSING 2
+#define MMES_PUMP_CLOSED 3
+
+/* The states of a worker pool session. A session with events is on the run queue once,
+ * (SCHEDULED), or being dispatched by one worker, (RUNNING), and an event that arrives
+ * meanwhile moves it to RUNNING_NOTIFIED so that the worker puts it back on the run queue.
+ */
+#define MMES_SCHEDULE_IDLE 0
+#define MMES_SCHEDULE_SCHEDULED 1
+#define MMES_SCHEDULE_RUNNING 2
+#define MMES_SCHEDULE_RUNNING_NOTIFIED 3
+#define MMES_SCHEDULE_CLOSED 4
 
 
 /* ********************************************************** */
 /* Structures. */
 /* ********************************************************** */
 
+/* The placement of a session's dispatcher thread, parsed from mamaEnvSessionAttributes. */
+typedef struct mmeSessionAttributes
+{
+    /* One bit for each CPU the thread may run on. */
+    mama_u64_t m_cpuMask[MMES_MAX_CPUS / 64];
+
+    /* Set if m_cpuMask should be applied. */
+    int m_hasCpus;
+
+    /* The NUMA node preferred for the dispatcher thread's own memory, or -1. */
+    int m_threadNumaNode;
+
+    /* The thread name, empty to leave it alone. */
+    char m_threadName[16];
+
+    /* The SCHED_FIFO priority, or 0. */
+    int m_fifoPriority;
+
+    /* The nice value, only applied if m_setNice is set. */
+    int m_nice;
+    int m_setNice;
+
+    /* How the session thread waits for events. */
+    mamaEnvDispatchMode m_dispatchMode;
+
+    /* For an adaptive session, the time in nanoseconds to spin before blocking. */
+    mama_u64_t m_spinTime;
+
+} mmeSessionAttributes;
+
+
+/* A number of objects of one type destroyed together by mamaEnv_destroySubscriptions and the
+ * like, whose destroys are completed by a single event.
+ */
+typedef struct mmeDestroyBatch
+{
+    /* The event on the session's control lane. */
+    mmeControlEvent m_event;
+
+    /* The type of the objects. */
+    mamaEnvObjectType m_type;
+
+    /* The number of objects. */
+    mama_u32_t m_count;
+
+    /* The wrapper objects, allocated with the batch. */
+    void* m_objects[];
+
+} mmeDestroyBatch;
+
+
 /* This structure defines a session. */
 typedef struct mmeSession
 {
@@ -33,28 +132,148 @@ typedef struct mmeSession
     /* This map contains all timer objects. */
     SynchronizedMap* m_timers;
 
+    /* This map contains the session's subscribers to shared subscriptions. */
+    SynchronizedMap* m_sharedSubscribers;
+
     /* cache the position of this session in whichever session list it exists (active/destroyed) */
     void* m_listEntry;
 
+    /* The connection that created the session. */
+    struct mmeConnection* m_connection;
+
+    /* The group that owns the session and its slot in the group, NULL if it isn't in one. */
+    struct mmeSessionGroup* m_group;
+    mama_u32_t m_groupIndex;
+
+    /* One reference for the session itself plus one for each managed object that has not yet
+     * been destroyed, the session is reclaimed as soon as this reaches zero.
+     */
+    int m_references;
+
+    /* The one shot timer that retries the reclaim while mama is still closing objects on the
+     * session queue, and the delay it was created with, only used on the object thread.
+     */
+    mamaTimer m_reclaimTimer;
+    mama_f64_t m_reclaimDelay;
+
+    /* The thread dispatching the session queue, only valid once m_dispatchThreadKnown is set. */
+    pthread_t m_dispatchThread;
+
+    /* Set by the first event dispatched on the session queue. */
+    int m_dispatchThreadKnown;
+
+    /* How to place the dispatcher thread, NULL to leave it alone. */
+    mmeSessionAttributes* m_attributes;
+
+    /* The thread that polls the queue in place of m_dispatcher for polling and adaptive sessions. */
+    pthread_t m_pollThread;
+
+    /* Set while m_pollThread is running. */
+    int m_pollThreadRunning;
+
+    /* Set to ask m_pollThread to return. */
+    int m_pollStop;
+
+    /* For an application dispatched session, whether it is being dispatched or destroyed. */
+    int m_pumpState;
+
+    /* For a worker pool session, whether it is waiting for or held by a worker. */
+    int m_scheduleState;
+
+    /* The next session on the worker pool's run queue. */
+    struct mmeSession* m_nextScheduled;
+
+    /* Destroy completions, run by the dispatch thread ahead of the events on m_queue. */
+    mmeControlLane m_control;
+
+    /* The application's backpressure callback and its closure, set by
+     * mamaEnv_setSessionBackpressureCallback.
+     */
+    mamaEnv_onSessionBackpressureCallback m_backpressureCallback;
+    void* m_backpressureClosure;
+
+    /* Set from the high watermark until the low watermark, so each crossing is reported once. */
+    int m_backpressured;
+
+    /* The number of times the queue has crossed its high watermark. */
+    mama_u64_t m_highWatermarkCount;
+
+    /* The deepest the queue has been seen. */
+    mama_u64_t m_maxQueueDepth;
+
+    /* Wrapper callbacks since the queue depth was last sampled, only used on the dispatch thread. */
+    mama_u32_t m_callbacksSinceSample;
+
+    /* The number of destroys and shutdowns made on the dispatch thread, which need no locking. */
+    mama_u64_t m_fastPathDestroys;
+
+    /* The number of destroys and shutdowns made on any other thread. */
+    mama_u64_t m_slowPathDestroys;
+
 } mmeSession;
 
 mama_status mamaEnvSession_allocate(mmeSession** session);
 mama_status mamaEnvSession_canDestroy(mmeSession* session);
+mama_status mamaEnvSession_closeSchedule(mmeSession* session);
+mama_status mamaEnvSession_closePump(mmeSession* session);
 mama_status mamaEnvSession_create(mamaBridge bridge, mmeSession* session);
 mama_status mamaEnvSession_deallocate(mmeSession* session);
 mama_status mamaEnvSession_destroy(mmeSession* session);
 mama_status mamaEnvSession_destroyAllEvents(mmeSession* session);
 mama_status mamaEnvSession_deactivate(mmeSession* session);
+int mamaEnvSession_isDispatchThread(mmeSession* session);
+mama_status mamaEnvSession_setAttributes(mmeSession* session, const mamaEnvSessionAttributes* attributes);
+void mamaEnvSession_acquire(mmeSession* session);
+void mamaEnvSession_release(mmeSession* session);
 
+void mamaEnvSession_drainControl(mmeSession* session, void* current);
+void mamaEnvSession_recordDepth(mmeSession* session, size_t depth);
+void mamaEnvSession_sampleDepth(mmeSession* session);
+mama_status mamaEnvSession_enqueueControl(mmeSession* session, mmeControlEvent* event, mamaQueueEventCB callback, void* closure);
 
-mama_status mamaEnvSession_createSubscription(mmeSubscriptionCallback* callback, void* closure, mmeSession* session, const char* source, const char* symbol, mamaTransport transport, mmeSubscriptionType type, mamaSubscription* result);
+void MAMACALLTYPE mamaEnvSession_onControlWake(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSession_onDispatchStart(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSession_onEnqueue(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSession_onPollWake(mamaQueue queue, void* closure);
+void* mamaEnvSession_pollThread(void* closure);
+int mamaEnvSession_runScheduled(mmeSession* session);
+
+
+mama_status mamaEnvSession_createSubscription(mmeSubscriptionCallback* callback, void* closure, mmeSession* session, const char* source, const char* symbol, mamaTransport transport, mmeSubscriptionType type, const mmeSubscriptionOptions* options, mamaSubscription* result);
+mama_status mamaEnvSession_createSubscriptions(mmeSubscriptionCallback* callback, void** closures, mmeSession* session, const char** symbols, mama_u32_t count, mamaTransport transport, mmeSubscriptionType type, mamaSubscription* results, mama_status* statuses);
 mama_status mamaEnvSession_destroySubscription(mmeSession* envSession, mmeSubscription* envSubscription);
 
+mama_status mamaEnvSession_shutdownSubscription(mmeSession* envSession, mmeSubscription* envSubscription);
+
 mama_status mamaEnvSession_destroyInbox(mmeSession* envSession, mmeInbox* envInbox);
+mama_status mamaEnvSession_shutdownInbox(mmeSession* envSession, mmeInbox* envInbox);
+
 mama_status mamaEnvSession_destroyTimer(mmeSession* envSession, mmeTimer* envTimer);
 
+mama_status mamaEnvSession_destroyEvents(mmeSession* envSession, mamaEnvObjectType type, SynchronizedMap* map, void** handles, mama_u32_t count);
+void MAMACALLTYPE mamaEnvSession_onDestroyBatch(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSession_onFreeBatch(mamaQueue queue, void* closure);
+mama_status mamaEnvSession_shutdownTimer(mmeSession* envSession, mmeTimer* envTimer);
+
 mama_status mamaEnvSession_onDestroyAllInboxesCallback(void* data, void* closure);
 mama_status mamaEnvSession_onDestroyAllSubscriptionsCallback(void* data, void* closure);
 mama_status mamaEnvSession_onDestroyAllTimersCallback(void* data, void* closure);
+mama_status mamaEnvSession_onDestroyAllSharedSubscribersCallback(void* data, void* closure);
+
+/* Called by a wrapper after its callback has left the gate, on the dispatch thread. This runs
+ * any destroys waiting on the control lane without waiting for the events ahead of the wake
+ * event, (the current object's own destroy is left for the wake event as its callback is still
+ * running), and now and again samples the queue depth.
+ */
+MAMAENVFORCEINLINE void mamaEnvSession_afterCallback(mmeSession* session, void* current)
+{
+    if (__atomic_load_n(&session->m_control.m_pending, __ATOMIC_ACQUIRE) != 0) {
+        mamaEnvSession_drainControl(session, current);
+    }
+    if (++session->m_callbacksSinceSample >= MMES_DEPTH_SAMPLE_INTERVAL) {
+        session->m_callbacksSinceSample = 0;
+        mamaEnvSession_sampleDepth(session);
+    }
+}
 
 #endif
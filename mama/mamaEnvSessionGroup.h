@@ -0,0 +1,32 @@
+#ifndef MAMAENVSESSIONGROUP_H
+#define MAMAENVSESSIONGROUP_H
+
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mamaEnvConnection.h"
+#include "mamaEnvHashTable.h"
+
+
+/* ********************************************************** */
+/* Structures. */
+/* ********************************************************** */
+
+/* This structure defines a group of sessions on one connection. */
+typedef struct mmeSessionGroup
+{
+    /* The connection the sessions were created on, only used while a session is left. */
+    mmeConnection* m_connection;
+
+    /* The sessions, symbols are placed by hash modulo the number of sessions. A slot is
+     * cleared when its session is destroyed with the connection.
+     */
+    mmeSession** m_sessions;
+
+    /* The number of sessions. */
+    mama_u32_t m_numberSessions;
+
+} mmeSessionGroup;
+
+
+#endif
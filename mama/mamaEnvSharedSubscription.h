@@ -0,0 +1,157 @@
+#ifndef MAMAENVSHAREDSUBSCRIPTION_H
+#define MAMAENVSHAREDSUBSCRIPTION_H
+
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mamaManagedEnvironment.h"
+#include "mamaSynchronizedMap.h"
+#include "mamaEnvGate.h"
+#include "mamaEnvHashTable.h"
+#include <pthread.h>
+
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* The number of buckets in a connection's interest table when the first interest is added,
+ * the table doubles whenever it holds more interests than buckets.
+ */
+#define MMEI_INITIAL_BUCKETS 256
+
+/* The kinds of callback delivered to a shared subscriber. */
+#define MMEI_DELIVER_CREATE 0
+#define MMEI_DELIVER_MSG 1
+#define MMEI_DELIVER_ERROR 2
+
+/* The states of an interest, it is pending while its mama subscription is created outside
+ * the table lock.
+ */
+#define MMEI_PENDING 0
+#define MMEI_READY 1
+#define MMEI_FAILED 2
+
+/* The number of subscribers a fan out copies to the stack, more than this are copied to the heap. */
+#define MMEI_FANOUT_STACK 32
+
+
+/* ********************************************************** */
+/* Structures. */
+/* ********************************************************** */
+
+/* One session's subscription to a shared interest. */
+typedef struct mmeSharedSubscriber
+{
+    /* This is used to control access to the callback functions. */
+    mmeGate m_gate;
+
+    /* The application's callbacks and closure. */
+    wombat_subscriptionCreateCB m_onCreate;
+    wombat_subscriptionErrorCB m_onError;
+    wombat_subscriptionOnMsgCB m_onMsg;
+    void* m_closure;
+
+    /* The session the callbacks are delivered on, which it holds a reference on until destroyed. */
+    struct mmeSession* m_session;
+
+    /* The interest this subscriber shares, only used while the gate is open. */
+    struct mmeInterest* m_interest;
+
+    /* Links the subscribers of the interest, protected by the interest's lock. */
+    struct mmeSharedSubscriber* m_previous;
+    struct mmeSharedSubscriber* m_next;
+
+    /* One for the interest's subscriber list plus one for each fan out still enqueuing to the
+     * subscriber, whoever drops the last frees it on its session queue behind those deliveries.
+     */
+    int m_references;
+
+} mmeSharedSubscriber;
+
+
+/* The single mama subscription shared by every subscriber to a (transport, source, symbol). */
+typedef struct mmeInterest
+{
+    /* Links the interest into the table, which must be the first member. */
+    mmeHashNode m_node;
+
+    /* The key. */
+    mamaTransport m_transport;
+    char* m_source;
+    char* m_symbol;
+
+    /* The mama subscription, created on the connection's sharing session. */
+    mamaSubscription m_subscription;
+
+    /* The sharing session, which the interest holds a reference on until destroyed. */
+    struct mmeSession* m_session;
+
+    /* Protects the subscriber list and m_created, it is never held while enqueuing. */
+    pthread_mutex_t m_lock;
+
+    /* The subscribers and how many there are. */
+    mmeSharedSubscriber* m_subscribers;
+    size_t m_numberSubscribers;
+
+    /* Set once the mama subscription's create callback has been fanned out. */
+    int m_created;
+
+    /* The number of subscribers, protected by the table lock, the mama subscription is
+     * destroyed when this reaches zero.
+     */
+    mama_u32_t m_references;
+
+    /* One of the MMEI states and, once failed, why, protected by the table lock. */
+    int m_state;
+    mama_status m_status;
+
+} mmeInterest;
+
+
+/* A connection's interests, hashed on (transport, source, symbol). */
+typedef struct mmeInterestTable
+{
+    /* Protects the table and each interest's reference count and state. */
+    pthread_mutex_t m_lock;
+
+    /* Signalled when a pending interest becomes ready or fails. */
+    pthread_cond_t m_ready;
+
+    /* The interests. */
+    mmeHashTable m_interests;
+
+} mmeInterestTable;
+
+
+/* One callback waiting on a subscriber's session queue. */
+typedef struct mmeSharedDelivery
+{
+    /* The subscriber, which can't be freed before this is dispatched. */
+    mmeSharedSubscriber* m_subscriber;
+
+    /* One of the MMEI_DELIVER values. */
+    int m_type;
+
+    /* The subscriber's own copy of the message, for MMEI_DELIVER_MSG. */
+    mamaMsg m_message;
+
+    /* The error, for MMEI_DELIVER_ERROR. */
+    mama_status m_status;
+
+} mmeSharedDelivery;
+
+
+void mamaEnvInterestTable_init(mmeInterestTable* table);
+void mamaEnvInterestTable_destroy(mmeInterestTable* table);
+
+mama_status mamaEnvSharedSubscription_create(mmeSharedSubscriber* subscriber, struct mmeSession* session, const char* source, const char* symbol, mamaTransport transport);
+mama_status mamaEnvSharedSubscription_destroy(mmeSharedSubscriber* subscriber);
+
+void MAMACALLTYPE mamaEnvSharedSubscription_onCreate(mamaSubscription subscription, void* closure);
+void MAMACALLTYPE mamaEnvSharedSubscription_onError(mamaSubscription subscription, mama_status status, void* platformError, const char* subject, void* closure);
+void MAMACALLTYPE mamaEnvSharedSubscription_onMsg(mamaSubscription subscription, mamaMsg message, void* closure, void* itemClosure);
+void MAMACALLTYPE mamaEnvSharedSubscription_onDelivery(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSharedSubscription_onSubscriberDestroy(mamaQueue queue, void* closure);
+
+#endif
@@ -1,68 +1,208 @@
 #ifndef MAMAENVSUBSCRIPTION_H
 #define MAMAENVSUBSCRIPTION_H
 
-#include <wlock.h>
-#include "mamaEnvGeneral.h"
+#include "mamaManagedEnvironment.h"
+#include "mamaSynchronizedMap.h"
+#include "mamaEnvGate.h"
+#include "mamaEnvControlLane.h"
 
 /* Indicates the type of subscription. */
 typedef enum mmeSubscriptionType
 {
     Basic = 1,
-    Wildcard = 2
+    Wildcard = 2,
+    Batch = 3,
+    Conflated = 4,
+    Routed = 5,
+    Offloaded = 6
 } mmeSubscriptionType;
 
 
-/* This structure contains the callback function pointers. */
+/* This structure contains the callback function pointers, the message callbacks come first
+ * so that they share the subscription's first cache line.
+ */
 typedef struct mmeSubscriptionCallback
 {
+    /* onMsg for a basic subscription. */
+    wombat_subscriptionOnMsgCB m_onMsgBasic;
+
+    /* onMsg for a wildcard subscription. */
+    wombat_subscriptionWildCardOnMsgCB m_onMsgWildcard;
+
+    /* onBatch for a batch subscription. */
+    mamaEnv_onBatchMsgCallback m_onMsgBatch;
+
     /* onCreate. */
     wombat_subscriptionCreateCB m_onCreate;
 
     /* onError. */
     wombat_subscriptionErrorCB m_onError;
 
-    /* onMsg for a basic subscription. */
-    wombat_subscriptionOnMsgCB m_onMsgBasic;
+} mmeSubscriptionCallback;
 
-    /* onMsg for a wildcard subscription. */
-    wombat_subscriptionWildCardOnMsgCB m_onMsgWildcard;
 
-} mmeSubscriptionCallback;
+/* Options for the less common subscription types. */
+typedef struct mmeSubscriptionOptions
+{
+    /* The largest number of messages delivered in one batch. */
+    mama_u32_t m_maxBatchSize;
+
+    /* The longest time in seconds to hold a message in a batch, 0 for no limit. */
+    mama_f64_t m_maxBatchDelay;
+
+    /* The shortest time in seconds between deliveries of a conflated subscription, 0 to
+     * deliver as soon as the events ahead of the latest message have been dispatched.
+     */
+    mama_f64_t m_conflationInterval;
+
+    /* The lane an offloaded subscription's messages are delivered on. */
+    struct mmeSession* m_lane;
+
+} mmeSubscriptionOptions;
+
+
+/* One message of an offloaded subscription waiting on its lane. */
+typedef struct mmeOffloadDelivery
+{
+    /* The subscription, which can't be freed before this is dispatched. */
+    struct mmeSubscription* m_subscription;
+
+    /* The detached message and its item closure. */
+    mamaMsg m_message;
+    void* m_itemClosure;
+
+} mmeOffloadDelivery;
+
+
+/* The messages held by a batch subscription, this is only ever accessed by the thread
+ * dispatching the session queue.
+ */
+typedef struct mmeSubscriptionBatch
+{
+    /* The session queue, used to enqueue the flush event. */
+    mamaQueue m_queue;
+
+    /* The detached messages waiting to be delivered. */
+    mamaMsg* m_messages;
+
+    /* The number of messages waiting. */
+    mama_u32_t m_count;
+
+    /* The largest number of messages delivered in one batch. */
+    mama_u32_t m_maxSize;
+
+    /* The longest time in nanoseconds to hold a message, 0 for no limit. */
+    mama_u64_t m_maxDelay;
+
+    /* The time the first message in the current batch arrived. */
+    mama_u64_t m_started;
+
+    /* Set while a flush event is on the session queue. */
+    int m_flushPending;
+
+} mmeSubscriptionBatch;
+
+
+/* The latest message of a conflated subscription, this is only ever accessed by the thread
+ * dispatching the session queue, apart from the counters.
+ */
+typedef struct mmeSubscriptionConflation
+{
+    /* The session queue, used to enqueue the flush event. */
+    mamaQueue m_queue;
+
+    /* The detached message waiting to be delivered, or NULL. */
+    mamaMsg m_pending;
+
+    /* The shortest time in nanoseconds between deliveries, 0 to deliver on the flush event. */
+    mama_u64_t m_interval;
+
+    /* The same interval in seconds, used to create the timer. */
+    mama_f64_t m_seconds;
+
+    /* The time of the last delivery. */
+    mama_u64_t m_lastDelivered;
+
+    /* Delivers a message held back by the interval, NULL while nothing is held back. */
+    mamaTimer m_timer;
+
+    /* Set while a flush event is on the session queue. */
+    int m_flushPending;
+
+    /* The messages received, delivered, and replaced by a later message before delivery. */
+    mama_u64_t m_received;
+    mama_u64_t m_delivered;
+    mama_u64_t m_conflated;
+
+} mmeSubscriptionConflation;
 
 
 /* This structure contains all of the information used to create a subscription, it will be
  * passed as a closure to the object queue.
  */
-typedef struct mmeSubscription
+typedef struct MAMAENVCACHEALIGNED mmeSubscription
 {
     // The mama subscription, this MUST appear first in the structure, so that mmeSubscription and mamaSubscription
     // can be used interchangeably.
     // (see 6.7.2.1-13. A pointer to a structure object, suitably converted, points to its initial member)
     mamaSubscription m_subscription;
 
-    /* This union contains the callback function pointers. */
-    mmeSubscriptionCallback m_callback;
+    /* This is used to control access to the callback functions. Together with the session,
+     * the closure and the message callbacks it is in the first cache line, so a basic or
+     * wildcard message touches only that line, (see the asserts in mamaEnvSubscription.c).
+     */
+    mmeGate m_gate;
+
+    /* The session the subscription belongs to, which it holds a reference on until destroyed. */
+    struct mmeSession* m_session;
 
     /* The closure data provided to the create function. */
     void* m_closure;
 
-    /* This is used to control access to the callback function. */
-    wLock m_lock;
+    /* This union contains the callback function pointers. */
+    mmeSubscriptionCallback m_callback;
+
+    /* The messages waiting to be delivered, only set for a batch subscription. */
+    mmeSubscriptionBatch* m_batch;
+
+    /* The latest message waiting to be delivered, only set for a conflated subscription. */
+    mmeSubscriptionConflation* m_conflation;
+
+    /* The routes and interned topics, only set for a routed subscription. */
+    struct mmeTopicRouter* m_router;
+
+    /* The lane the callbacks run on, which it holds a reference on until freed, only set
+     * for an offloaded subscription.
+     */
+    struct mmeSession* m_lane;
+
+    /* Completes the destroy on the session's control lane, ahead of queued messages. */
+    mmeControlEvent m_destroyEvent;
 
 } mmeSubscription;
 
 mama_status mamaEnvSubscription_allocate(mmeSubscriptionCallback* callback, void* closure, mmeSubscription** subscription);
 mama_status mamaEnvSubscription_deallocate(mmeSubscription* subscription);
-mama_status mamaEnvSubscription_create(mamaQueue queue, const char* source, mmeSubscription* subscription, const char* symbol, mamaTransport transport, mmeSubscriptionType type);
+mama_status mamaEnvSubscription_create(mamaQueue queue, const char* source, mmeSubscription* subscription, const char* symbol, mamaTransport transport, mmeSubscriptionType type, const mmeSubscriptionOptions* options);
 mama_status mamaEnvSubscription_destroy(mmeSubscription* subscription);
 mama_status mamaEnvSubscription_shutdown(mmeSubscription* subscription);
 
 void MAMACALLTYPE mamaEnvSubscription_onSubscriptionDestroy(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSubscription_onSubscriptionFree(mamaQueue queue, void* closure);
 
 void MAMACALLTYPE mamaEnvSubscription_onCreateBasic(mamaSubscription subscription, void* closure);
 void MAMACALLTYPE mamaEnvSubscription_onDestroy(mamaSubscription subscription, void* closure);
 void MAMACALLTYPE mamaEnvSubscription_onErrorBasic(mamaSubscription subscription, mama_status status, void* platformError, const char* subject, void* closure);
 void MAMACALLTYPE mamaEnvSubscription_onMsgBasic(mamaSubscription subscription, mamaMsg message, void* closure, void* itemClosure);
+void MAMACALLTYPE mamaEnvSubscription_onMsgBatch(mamaSubscription subscription, mamaMsg message, void* closure, void* itemClosure);
+void MAMACALLTYPE mamaEnvSubscription_onBatchFlush(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSubscription_onMsgConflated(mamaSubscription subscription, mamaMsg message, void* closure, void* itemClosure);
+void MAMACALLTYPE mamaEnvSubscription_onConflationFlush(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSubscription_onConflationTimer(mamaTimer timer, void* closure);
 void MAMACALLTYPE mamaEnvSubscription_onMsgWildcard(mamaSubscription subscription, mamaMsg message, const char* topic, void* closure, void* itemClosure);
+void MAMACALLTYPE mamaEnvSubscription_onMsgOffloaded(mamaSubscription subscription, mamaMsg message, void* closure, void* itemClosure);
+void MAMACALLTYPE mamaEnvSubscription_onOffloadDelivery(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSubscription_onOffloadRetire(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvSubscription_onMsgRouted(mamaSubscription subscription, mamaMsg message, const char* topic, void* closure, void* itemClosure);
 
 #endif
@@ -1,19 +1,26 @@
 #ifndef MAMAENVTIMER_H
 #define MAMAENVTIMER_H
 
-#include <wlock.h>
 #include "mamaEnvGeneral.h"
+#include "mamaSynchronizedMap.h"
+#include "mamaEnvGate.h"
+#include "mamaEnvControlLane.h"
 
 /* This structure contains all of the information used to create a timer, it will be
  * passed as a closure to the object queue.
  */
-typedef struct mmeTimer
+typedef struct MAMAENVCACHEALIGNED mmeTimer
 {
     // The mama timer, this MUST appear first in the structure, so that mmeTimer and mamaTimer
     // can be used interchangeably.
     // (see 6.7.2.1-13. A pointer to a structure object, suitably converted, points to its initial member)
     mamaTimer m_timer;
 
+    /* This is used to control access to the callback function, it is kept in the same
+     * cache line as the fields read on every tick.
+     */
+    mmeGate m_gate;
+
     /* The original callback function, this will be set to NULL whenever the timer
      * destroy is enqueued.
      */
@@ -22,11 +29,11 @@ typedef struct mmeTimer
     /* The closure data provided to the create function. */
     void* m_closure;
 
-    /* This is used to control access to the callback function. */
-    wLock m_lock;
+    /* The session the timer belongs to, which it holds a reference on until destroyed. */
+    struct mmeSession* m_session;
 
-    /* This is used to control scheduling so destroy can grab m_lock. */
-    wLock m_destroyLock;
+    /* Completes the destroy on the session's control lane, ahead of queued messages. */
+    mmeControlEvent m_destroyEvent;
 
 } mmeTimer;
 
@@ -36,6 +43,7 @@ mama_status mamaEnvTimer_destroy(mmeTimer* timer);
 mama_status mamaEnvTimer_shutdown(mmeTimer* timer);
 
 void MAMACALLTYPE mamaEnvTimer_onTimerDestroy(mamaQueue queue, void* closure);
+void MAMACALLTYPE mamaEnvTimer_onTimerFree(mamaQueue queue, void* closure);
 void MAMACALLTYPE mamaEnvTimer_onTimerTick(mamaTimer timer, void* closure);
 
 #endif
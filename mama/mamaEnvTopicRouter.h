@@ -0,0 +1,136 @@
+#ifndef MAMAENVTOPICROUTER_H
+#define MAMAENVTOPICROUTER_H
+
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mamaManagedEnvironment.h"
+#include "mamaEnvHashTable.h"
+#include <pthread.h>
+
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* The number of buckets in a topic table when the first topic is added, the table doubles
+ * whenever it holds more topics than buckets.
+ */
+#define MMER_INITIAL_BUCKETS 64
+
+
+/* ********************************************************** */
+/* Structures. */
+/* ********************************************************** */
+
+/* The key of a node in a topic table, which must be the first member of the node. */
+typedef struct mmeTopicKey
+{
+    /* Links the node into its table, hashed on the topic. */
+    mmeHashNode m_node;
+
+    /* The topic, owned by the node. */
+    char* m_topic;
+
+} mmeTopicKey;
+
+
+/* A handler registered for a topic, or for every topic starting with a prefix. Routes are
+ * never changed once added, and a removed route is kept until the dispatch thread next routes
+ * a message since it may still be calling it.
+ */
+typedef struct mmeTopicRoute
+{
+    /* The topic or prefix. */
+    mmeTopicKey m_key;
+
+    /* The length of the topic or prefix. */
+    size_t m_length;
+
+    /* The handler and its closure. */
+    mamaEnv_onRoutedMsgCallback m_callback;
+    void* m_closure;
+
+    /* The next prefix route, (longest first), or the next retired route. */
+    struct mmeTopicRoute* m_nextRoute;
+
+} mmeTopicRoute;
+
+
+/* A topic seen by the subscription, interned the first time it arrives and handed to mama as
+ * the topic's closure so that later messages find it without hashing the topic.
+ */
+typedef struct mmeTopicEntry
+{
+    /* The topic. */
+    mmeTopicKey m_key;
+
+    /* The route resolved for the topic, or NULL for the subscription's own callback. */
+    mmeTopicRoute* m_route;
+
+    /* The router generation m_route was resolved at. */
+    mama_u32_t m_generation;
+
+} mmeTopicEntry;
+
+
+/* The routes of a routed wildcard subscription. */
+typedef struct mmeTopicRouter
+{
+    /* Protects the routes and the generation. */
+    pthread_mutex_t m_lock;
+
+    /* The topic routes. */
+    mmeHashTable m_routes;
+
+    /* The prefix routes, longest first so the first match is the longest. */
+    mmeTopicRoute* m_prefixes;
+
+    /* Routes that have been removed or replaced, freed by the dispatch thread when no route
+     * callback can be running.
+     */
+    mmeTopicRoute* m_retired;
+
+    /* Changed whenever a route is added or removed so that entries resolve their route again. */
+    mama_u32_t m_generation;
+
+    /* The interned topics, only accessed by the thread dispatching the session queue. */
+    mmeHashTable m_topics;
+
+    /* The number of messages whose topic had to be looked up by name, or re-resolved. */
+    mama_u64_t m_lookups;
+
+} mmeTopicRouter;
+
+
+mama_status mamaEnvTopicRouter_create(mmeTopicRouter** router);
+void mamaEnvTopicRouter_destroy(mmeTopicRouter* router);
+mama_status mamaEnvTopicRouter_addRoute(mmeTopicRouter* router, mamaEnvRouteType type, const char* topic, mamaEnv_onRoutedMsgCallback callback, void* closure);
+mama_status mamaEnvTopicRouter_removeRoute(mmeTopicRouter* router, mamaEnvRouteType type, const char* topic);
+mmeTopicEntry* mamaEnvTopicRouter_intern(mmeTopicRouter* router, const char* topic);
+void mamaEnvTopicRouter_resolve(mmeTopicRouter* router, mmeTopicEntry* entry);
+void mamaEnvTopicRouter_freeRetired(mmeTopicRouter* router);
+
+/* Frees the retired routes, if there are any, on the dispatch thread while no route callback is
+ * running.
+ */
+MAMAENVFORCEINLINE void mamaEnvTopicRouter_reclaim(mmeTopicRouter* router)
+{
+    if (__atomic_load_n(&router->m_retired, __ATOMIC_ACQUIRE) != NULL) {
+        mamaEnvTopicRouter_freeRetired(router);
+    }
+}
+
+/* Returns the route for a topic entry, or NULL, on the dispatch thread. This is a single compare
+ * unless a route has been added or removed since the entry was last resolved.
+ */
+MAMAENVFORCEINLINE mmeTopicRoute* mamaEnvTopicRouter_route(mmeTopicRouter* router, mmeTopicEntry* entry)
+{
+    if (entry->m_generation != __atomic_load_n(&router->m_generation, __ATOMIC_ACQUIRE)) {
+        mamaEnvTopicRouter_resolve(router, entry);
+    }
+
+    return entry->m_route;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef MAMAENVWORKERPOOL_H
+#define MAMAENVWORKERPOOL_H
+
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mamaManagedEnvironment.h"
+#include <pthread.h>
+
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* The most events a worker dispatches from one session before moving it to the back of the
+ * run queue, so that a busy session cannot starve the others.
+ */
+#define MMEW_QUANTUM 64
+
+
+/* ********************************************************** */
+/* Structures. */
+/* ********************************************************** */
+
+/* This structure defines the threads shared by a connection's worker pool sessions. */
+typedef struct mmeWorkerPool
+{
+    /* Protects the run queue and the stop flag. */
+    pthread_mutex_t m_lock;
+
+    /* Signalled when a session is added to the run queue or the pool is stopping. */
+    pthread_cond_t m_ready;
+
+    /* Signalled when a worker lets a session go idle while a thread is waiting to close one. */
+    pthread_cond_t m_released;
+
+    /* The number of threads waiting on m_released. */
+    int m_waiters;
+
+    /* The sessions waiting for a worker, linked through m_nextScheduled. */
+    struct mmeSession* m_head;
+    struct mmeSession* m_tail;
+
+    /* Set to ask the workers to return. */
+    int m_stop;
+
+    /* The worker threads. */
+    pthread_t* m_threads;
+
+    /* The number of worker threads that were started. */
+    mama_u32_t m_numberThreads;
+
+} mmeWorkerPool;
+
+
+mama_status mamaEnvWorkerPool_create(mama_u32_t numberWorkers, mmeWorkerPool** pool);
+mama_status mamaEnvWorkerPool_destroy(mmeWorkerPool* pool);
+void mamaEnvWorkerPool_schedule(mmeWorkerPool* pool, struct mmeSession* session);
+void mamaEnvWorkerPool_waitClosed(mmeWorkerPool* pool, struct mmeSession* session);
+void* mamaEnvWorkerPool_workerThread(void* closure);
+
+#endif
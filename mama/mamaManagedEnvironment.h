@@ -82,6 +82,185 @@ typedef mmeSession* mamaEnvSession;             // opaque pointer to definition
  */
 MAMAENV_API mama_status mamaEnv_createSession(mamaEnvConnection connection, mamaEnvSession* session);
 
+/* How a session's thread waits for events. */
+typedef enum mamaEnvDispatchMode
+{
+    /* A mama dispatcher blocks on the queue, every event pays for a thread wakeup. */
+    mamaEnvDispatchBlocking = 0,
+
+    /* The thread spins on the queue and never blocks, using a whole core. */
+    mamaEnvDispatchPolling = 1,
+
+    /* The thread spins for m_spinTime after each event and then blocks until the next. */
+    mamaEnvDispatchAdaptive = 2,
+
+    /* There is no thread, the application dispatches the session with mamaEnv_dispatchSession. */
+    mamaEnvDispatchApplication = 3,
+
+    /* There is no thread, the connection's worker pool dispatches the session whenever it has
+     * events, see mamaEnv_createWorkerPool.
+     */
+    mamaEnvDispatchWorkerPool = 4
+
+} mamaEnvDispatchMode;
+
+/* Controls where and how a session's dispatcher thread runs. Initialise with
+ * mamaEnv_initSessionAttributes and then set only the fields of interest.
+ */
+typedef struct mamaEnvSessionAttributes
+{
+    /* The CPUs the dispatcher thread may run on, as a list such as "2,4-6", or NULL to leave
+     * the affinity alone.
+     */
+    const char* m_cpuList;
+
+    /* The NUMA node preferred for memory that the dispatcher thread itself allocates or first
+     * touches, or -1 to leave its memory policy alone. Only the dispatcher thread's policy is
+     * set, the session and the objects created on it are allocated by the creating thread.
+     */
+    int m_threadNumaNode;
+
+    /* The name given to the dispatcher thread, (truncated to 15 characters), or NULL to leave
+     * the name alone.
+     */
+    const char* m_threadName;
+
+    /* The SCHED_FIFO priority of the dispatcher thread, or 0 to leave it under the normal scheduler. */
+    int m_fifoPriority;
+
+    /* The nice value of the dispatcher thread, from -20 to 19, only applied if m_setNice is non-zero. */
+    int m_nice;
+    int m_setNice;
+
+    /* How the dispatcher thread waits for events. Application dispatched and worker pool
+     * sessions have no thread of their own to place, so the fields above must be left at
+     * their defaults.
+     */
+    mamaEnvDispatchMode m_dispatchMode;
+
+    /* For mamaEnvDispatchAdaptive, the time in seconds to keep spinning after the last event
+     * before blocking.
+     */
+    mama_f64_t m_spinTime;
+
+} mamaEnvSessionAttributes;
+
+/**
+ * This function will set session attributes to their defaults, which leave the dispatcher
+ * thread exactly as mamaEnv_createSession does.
+ *
+ * @param attributes (out) The attributes to initialise.
+ */
+MAMAENV_API void mamaEnv_initSessionAttributes(mamaEnvSessionAttributes* attributes);
+
+/**
+ * This function will create a session in the same way as mamaEnv_createSession, and then
+ * place its dispatcher thread according to the attributes. The attributes are applied by
+ * the dispatcher thread itself before it dispatches anything else, a failure to apply one,
+ * (e.g. for lack of privilege), is logged and the session carries on without it.
+ * This function can be called by any thread.
+ *
+ * @param connection (in) The connection object.
+ * @param attributes (in) The attributes, these are copied so need not outlive the call.
+ * @param session (out) To return the resulting session.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (e.g. if the CPU list cannot be parsed, the nice value is out of range, or a worker pool session is requested before mamaEnv_createWorkerPool)
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createSessionWithAttributes(mamaEnvConnection connection, const mamaEnvSessionAttributes* attributes, mamaEnvSession* session);
+
+/**
+ * This function will start a pool of worker threads on the connection, which dispatch every
+ * session created with mamaEnvDispatchWorkerPool. A session is dispatched by at most one
+ * worker at a time, so its callbacks are serialized exactly as if it had a thread of its own,
+ * but an idle session costs no thread at all. A worker dispatches at most a few dozen events
+ * from a session before moving on to the next, so a busy session cannot starve the others.
+ * The pool must be created before any worker pool session, and is destroyed along with the
+ * connection.
+ * This function can be called by any thread.
+ *
+ * @param connection (in) The connection object.
+ * @param numberWorkers (in) The number of worker threads.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (if numberWorkers is 0 or the connection already has a pool)
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createWorkerPool(mamaEnvConnection connection, mama_u32_t numberWorkers);
+
+/**
+ * This function will create the lanes that subscriptions created with
+ * mamaEnv_createOffloadedSubscription run their message callbacks on. Each lane is a hidden
+ * session of the connection, dispatched by the worker pool if the connection has one and
+ * otherwise by a thread of its own, so the pool should be created first to share its threads.
+ * Each subscription is pinned to one lane, so its messages are delivered in order, while
+ * subscriptions on different lanes run in parallel. The lanes are destroyed along with the
+ * connection.
+ * This function can be called by any thread.
+ *
+ * @param connection (in) The connection object.
+ * @param numberLanes (in) The number of lanes.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (if numberLanes is 0 or the connection already has lanes)
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createOffloadLanes(mamaEnvConnection connection, mama_u32_t numberLanes);
+
+/**
+ * This function will create a number of sessions at once, in the same way as calling
+ * mamaEnv_createSession for each, but with a single round trip to the connection's
+ * object thread. Either all of the sessions are created or none are.
+ * This function can be called by any thread.
+ * Each resulting session object should be destroyed by calling mamaEnv_destroySession.
+ *
+ * @param connection (in) The connection object.
+ * @param numberSessions (in) The number of sessions to create.
+ * @param sessions (out) An array of numberSessions entries to return the resulting sessions.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createSessions(mamaEnvConnection connection, mama_u32_t numberSessions, mamaEnvSession* sessions);
+
+/* The callback invoked once a session requested with mamaEnv_createSessionAsync has been
+ * created. On failure the session will be NULL and status will give the reason.
+ */
+typedef void (MAMACALLTYPE* mamaEnv_onSessionCreateCallback)(mamaEnvSession session, mama_status status, void* closure);
+
+/**
+ * This function will create a session in the same way as mamaEnv_createSession, but returns
+ * as soon as the request has been queued rather than waiting for the session's queue and
+ * dispatcher to be created. This allows many sessions to be created without a round trip
+ * to the connection's object thread for each one.
+ * This function can be called by any thread.
+ * The callback is invoked on the connection's object thread once the session has been
+ * created, (or has failed to be created), and must not block or call mamaEnv_createSession.
+ * The session is added to the connection before the callback is invoked, so if the
+ * connection is destroyed the session will be destroyed with it.
+ *
+ * @param connection (in) The connection object.
+ * @param callback (in) The function to invoke once the session has been created.
+ * @param closure (in) The closure passed to the callback.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ *  If anything other than MAMA_STATUS_OK is returned the callback will not be invoked.
+ */
+MAMAENV_API mama_status mamaEnv_createSessionAsync(mamaEnvConnection connection, mamaEnv_onSessionCreateCallback callback, void* closure);
+
 
 typedef mama_status(MAMACALLTYPE* mamaEnv_onSessionEventCallback)(mamaEnvSession session, void* closure);
 
@@ -94,6 +273,7 @@ typedef mama_status(MAMACALLTYPE* mamaEnv_onSessionEventCallback)(mamaEnvSession
  * @param connection (in) The connection on which the session was created.
  * @param session (in) The session to destroy.
  * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG if the session belongs to a group
  *      MAMA_STATUS_NULL_ARG
  *      MAMA_STATUS_PLATFORM
  *      MAMA_STATUS_OK
@@ -102,6 +282,228 @@ MAMAENV_API mama_status mamaEnv_destroySession(mamaEnvConnection connection, mam
 
 MAMAENV_API mama_status mamaEnv_shutdownSession(mamaEnvConnection connection, mamaEnvSession session);
 
+/* Statistics gathered for a session. */
+typedef struct mamaEnvSessionStats
+{
+    /* The number of event object destroys and shutdowns called on the session's own
+     * dispatch thread, (e.g. from within a callback), which need no object locking.
+     */
+    mama_u64_t m_fastPathDestroys;
+
+    /* The number of event object destroys and shutdowns called on any other thread. */
+    mama_u64_t m_slowPathDestroys;
+
+    /* The number of destroys completed on the session's control lane. */
+    mama_u64_t m_controlEvents;
+
+    /* The total and longest time in nanoseconds that a destroy waited on the control lane
+     * before being completed.
+     */
+    mama_u64_t m_controlDelayTotal;
+    mama_u64_t m_controlDelayMax;
+
+    /* The deepest the session queue has been seen, sampled as events are dispatched and
+     * whenever the high watermark is crossed.
+     */
+    mama_u64_t m_maxQueueDepth;
+
+    /* The number of times the session queue has crossed its high watermark. */
+    mama_u64_t m_highWatermarkCount;
+
+} mamaEnvSessionStats;
+
+/**
+ * This function will return a snapshot of the statistics gathered for a session.
+ * This function can be called by any thread.
+ *
+ * @param session (in) The session.
+ * @param stats (out) To return the statistics.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_getSessionStats(mamaEnvSession session, mamaEnvSessionStats* stats);
+
+/* Whether a session queue has risen above its high watermark or fallen back to its low one. */
+typedef enum mamaEnvBackpressureState
+{
+    mamaEnvBackpressureHigh = 1,
+    mamaEnvBackpressureLow = 2
+
+} mamaEnvBackpressureState;
+
+/* The callback invoked when a session queue crosses one of its watermarks, depth is the number
+ * of events on the queue at the time.
+ */
+typedef void (MAMACALLTYPE* mamaEnv_onSessionBackpressureCallback)(mamaEnvSession session, mamaEnvBackpressureState state, size_t depth, void* closure);
+
+/**
+ * This function will set watermarks on a session's queue and a callback to be told when the
+ * queue crosses them, so that a slow consumer can be detected and the application can shed
+ * load, shut down subscriptions or raise an alert before a backlog builds up.
+ * The callback is invoked with mamaEnvBackpressureHigh once the queue grows past the high
+ * watermark, and then with mamaEnvBackpressureLow once it has drained back to the low
+ * watermark. The high callback is invoked on whichever thread enqueued the event that crossed
+ * the watermark, (often a transport thread), and the low callback on the dispatch thread, so
+ * both must be quick and must not destroy the session.
+ * This function should be called once, before the session gets busy.
+ *
+ * @param session (in) The session.
+ * @param highWatermark (in) The queue depth above which the session is under backpressure.
+ * @param lowWatermark (in) The queue depth at which the backpressure is over, at least 1 and
+ *      less than highWatermark.
+ * @param callback (in) The function to invoke.
+ * @param closure (in) The closure passed to the callback.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_setSessionBackpressureCallback(mamaEnvSession session, size_t highWatermark, size_t lowWatermark, mamaEnv_onSessionBackpressureCallback callback, void* closure);
+
+/**
+ * This function will dispatch events on a session created with mamaEnvDispatchApplication,
+ * so that the session can be driven from the application's own event loop rather than a
+ * thread of its own. At most the events already on the queue when the call is made are
+ * dispatched, so a busy session cannot keep the caller here indefinitely. If there are no
+ * events the call waits up to timeout milliseconds for one.
+ * This function can be called by any thread, but only one thread may dispatch a session at
+ * a time. While it does so it is the session's dispatch thread, so destroys and shutdowns
+ * made from its callbacks take the fast path.
+ * Once mamaEnv_destroySession has been called the session must not be dispatched again, MME
+ * finishes dispatching its queue on a thread of its own so that it can be reclaimed.
+ *
+ * @param session (in) The session.
+ * @param maxEvents (in) The most events to dispatch, 0 to dispatch all those already queued.
+ * @param timeout (in) The time in milliseconds to wait if there are no events, 0 not to wait.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (if the session was not created with mamaEnvDispatchApplication)
+ *      MAMA_STATUS_INVALID_QUEUE, (if another thread is dispatching the session or it has been destroyed)
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_dispatchSession(mamaEnvSession session, mama_u32_t maxEvents, mama_u64_t timeout);
+
+//////////////////////////////////////////////////////////////////////////////
+// A "session group" spreads subscriptions over a fixed set of sessions by symbol.
+//////////////////////////////////////////////////////////////////////////////
+typedef struct mmeSessionGroup mmeSessionGroup;     // forward-declare actual definition
+typedef mmeSessionGroup* mamaEnvSessionGroup;       // opaque pointer to definition
+
+/**
+ * This function will create a group of sessions on a connection. Subscriptions created
+ * through the group are placed on a session chosen by a stable hash of the symbol, so
+ * every message for a symbol is delivered in order on the same thread while the load is
+ * spread over all of the group's threads.
+ * The group owns its sessions, so mamaEnv_destroySession rejects them. Destroying the
+ * connection destroys them too, after which the group only needs to be destroyed.
+ * This function can be called by any thread.
+ * The resulting group should be destroyed by calling mamaEnv_destroySessionGroup.
+ *
+ * @param connection (in) The connection object.
+ * @param numberSessions (in) The number of sessions, (and hence threads), in the group.
+ * @param group (out) To return the resulting group.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createSessionGroup(mamaEnvConnection connection, mama_u32_t numberSessions, mamaEnvSessionGroup* group);
+
+/**
+ * This function will destroy a group created by mamaEnv_createSessionGroup, destroying
+ * each of its sessions, (and all of their event objects), as mamaEnv_destroySession does.
+ * Sessions already destroyed with the connection are skipped. It must not be called at the
+ * same time as mamaEnv_destroyConnection.
+ * This function can be called by any thread.
+ *
+ * @param group (in) The group to destroy.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_destroySessionGroup(mamaEnvSessionGroup group);
+
+/**
+ * This function will return the session in a group that a symbol is placed on. The same
+ * symbol always maps to the same session for the lifetime of the group. The session can
+ * be used to create any kind of event object, and must be used to destroy subscriptions
+ * created through the group.
+ * This function can be called by any thread.
+ *
+ * @param group (in) The group.
+ * @param symbol (in) The symbol.
+ * @param session (out) To return the session.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NOT_FOUND if the session was destroyed with the connection
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_getGroupSession(mamaEnvSessionGroup group, const char* symbol, mamaEnvSession* session);
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Allocation
+//////////////////////////////////////////////////////////////////////////////
+
+/* The event objects that are allocated from per-type pools. */
+typedef enum mamaEnvObjectType
+{
+    mamaEnvSubscriptionObject = 0,
+    mamaEnvTimerObject = 1,
+    mamaEnvInboxObject = 2,
+    mamaEnvNumberObjectTypes = 3
+} mamaEnvObjectType;
+
+/* Statistics gathered for the pool of one type of event object. Allocations and frees
+ * are counted per thread and added to these totals whenever the thread's cache is
+ * refilled or emptied, so they may lag slightly behind.
+ */
+typedef struct mamaEnvAllocatorStats
+{
+    /* The size of each object in bytes, including padding. */
+    mama_size_t m_objectSize;
+
+    /* The number of slabs allocated, slabs are never returned to the system. */
+    mama_u64_t m_slabs;
+
+    /* The total number of bytes held in slabs. */
+    mama_u64_t m_bytesReserved;
+
+    /* The number of objects allocated. */
+    mama_u64_t m_allocations;
+
+    /* The number of objects freed. */
+    mama_u64_t m_frees;
+
+    /* The number of times a thread's cache was refilled from the shared free list. */
+    mama_u64_t m_refills;
+
+    /* The number of times a thread's cache returned objects to the shared free list,
+     * (e.g. because objects are being freed on a different thread to the one that
+     * allocated them).
+     */
+    mama_u64_t m_returns;
+
+} mamaEnvAllocatorStats;
+
+/**
+ * This function will return a snapshot of the statistics gathered for the pool of
+ * one type of event object. This function can be called by any thread.
+ *
+ * @param type (in) The type of object.
+ * @param stats (out) To return the statistics.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_getAllocatorStats(mamaEnvObjectType type, mamaEnvAllocatorStats* stats);
+
+
 //////////////////////////////////////////////////////////////////////////////
 // Subscriptions
 //////////////////////////////////////////////////////////////////////////////
@@ -132,6 +534,31 @@ MAMAENV_API mama_status mamaEnv_createBasicSubscription(const mamaMsgCallbacks*
     void* closure, mamaEnvSession session, const char* symbol, mamaTransport transport,
     mamaSubscription* subscription);
 
+/**
+ * This function will create a number of basic subscriptions on one session, each one the same
+ * as if it had been created by mamaEnv_createBasicSubscription. Creating them together means
+ * the session's subscription map is locked once, (per shard), rather than once per symbol, and
+ * a single summary is logged, which shortens startup when subscribing to many symbols.
+ * A symbol that fails does not stop the others being created.
+ *
+ * @param callback (in) Subscription callback function pointers, shared by all the subscriptions.
+ * @param closures (in) An array of count closures, one for each symbol, or NULL.
+ * @param session (in) The session for which the subscriptions should be created.
+ * @param symbols (in) An array of count symbols to subscribe to.
+ * @param count (in) The number of symbols.
+ * @param transport (in) The mama transport.
+ * @param subscriptions (out) An array of count entries to return each mamaSubscription, or NULL
+ *                            where that symbol failed.
+ * @param statuses (out) An array of count entries to return the status of each symbol.
+ * @return MAMA_STATUS_OK if every subscription was created, otherwise the first error, which can be
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ */
+MAMAENV_API mama_status mamaEnv_createBasicSubscriptions(const mamaMsgCallbacks* callback,
+    void** closures, mamaEnvSession session, const char** symbols, mama_u32_t count,
+    mamaTransport transport, mamaSubscription* subscriptions, mama_status* statuses);
+
 /**
  * This function will add create a wildcard subscription within the managed environment.
  * This subscription should only be destroyed by calling mamaEnv_destroySubscription,
@@ -161,6 +588,294 @@ MAMAENV_API mama_status mamaEnv_createWildcardSubscription(const mamaWildCardMsg
     mamaTransport transport, mamaSubscription* subscription);
 
 
+/**
+ * This function will create a basic subscription on the session in a group that the symbol
+ * is placed on, (see mamaEnv_getGroupSession). It behaves exactly as mamaEnv_createBasicSubscription
+ * on that session, and the subscription should be destroyed by passing the returned session
+ * to mamaEnv_destroySubscription.
+ *
+ * @param callback (in) Subscription callback function pointers.
+ * @param closure (in) The closure that will be passed back to the callback functions.
+ * @param group (in) The group in which the subscription should be created.
+ * @param symbol (in) The symbol to subscribe to.
+ * @param transport (in) The mama transport.
+ * @param session (out) To return the session the subscription was created on.
+ * @param subscription (out) To return the resulting mamaSubscription.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createGroupBasicSubscription(const mamaMsgCallbacks* callback, void* closure, mamaEnvSessionGroup group,
+    const char* symbol, mamaTransport transport, mamaEnvSession* session, mamaSubscription* subscription);
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Shared subscriptions
+//////////////////////////////////////////////////////////////////////////////
+typedef struct mmeSharedSubscriber mmeSharedSubscriber;         // forward-declare actual definition
+typedef mmeSharedSubscriber* mamaEnvSharedSubscription;         // opaque pointer to definition
+
+/**
+ * This function will subscribe a session to a symbol through a subscription that is shared
+ * by every session on the connection that subscribes to the same (transport, source, symbol).
+ * Only the first subscriber creates a mama subscription, which is dispatched on a hidden
+ * session of the connection, and each message is copied to every subscriber's session where
+ * the callbacks are invoked as for a basic subscription. The mama subscription is destroyed
+ * with its last subscriber.
+ * The subscription argument passed to the callbacks is the shared mama subscription, and the
+ * create callback is delivered to a subscriber that joins after the subscription was created.
+ * The subscriber should only be destroyed by calling mamaEnv_destroySharedSubscription.
+ *
+ * @param callback (in) Subscription callback function pointers, only onCreate, onError and
+ *                      onMsg are used.
+ * @param closure (in) The closure that will be passed back to the callback functions.
+ * @param session (in) The session on which the callbacks are invoked.
+ * @param source (in) The source, or NULL.
+ * @param symbol (in) The symbol to subscribe to.
+ * @param transport (in) The mama transport.
+ * @param subscription (out) To return the subscriber.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createSharedSubscription(const mamaMsgCallbacks* callback, void* closure, mamaEnvSession session,
+    const char* source, const char* symbol, mamaTransport transport, mamaEnvSharedSubscription* subscription);
+
+/**
+ * This function will destroy a subscriber created by mamaEnv_createSharedSubscription, and
+ * the shared mama subscription if it was the last subscriber. It can be called from any thread.
+ *
+ * @param session (in) The session that the subscriber was created on.
+ * @param subscription (in) The subscriber to be destroyed.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_destroySharedSubscription(mamaEnvSession session, mamaEnvSharedSubscription subscription);
+
+
+/* Invoked with a batch of messages for a batch subscription. The messages are only valid
+ * for the duration of the callback.
+ */
+typedef void (MAMACALLTYPE* mamaEnv_onBatchMsgCallback)(mamaSubscription subscription, mamaMsg* messages, mama_size_t count, void* closure);
+
+/* The callback function pointers for a batch subscription. */
+typedef struct mamaEnvBatchMsgCallbacks
+{
+    wombat_subscriptionCreateCB onCreate;
+    wombat_subscriptionErrorCB onError;
+    mamaEnv_onBatchMsgCallback onBatch;
+} mamaEnvBatchMsgCallbacks;
+
+/**
+ * This function will create a basic subscription within the managed environment whose
+ * messages are delivered in batches rather than one at a time.
+ * Messages are held until either maxBatchSize have been received, maxBatchDelay has elapsed
+ * since the first message in the batch, or every event that was already on the session
+ * queue when the batch was started has been dispatched, whichever happens first.
+ * The subscription is otherwise the same as one created by mamaEnv_createBasicSubscription.
+ *
+ * @param callback (in) Subscription callback function pointers.
+ * @param closure (in) The closure that will be passed back to the callback functions.
+ * @param session (in) The session for which the subscription should be created.
+ * @param symbol (in) The symbol to subscribe to.
+ * @param transport (in) The mama transport.
+ * @param maxBatchSize (in) The largest number of messages delivered in one batch.
+ * @param maxBatchDelay (in) The longest time in seconds to hold a message, or 0 for no limit.
+ * @param subscription (out) To return the resulting mamaSubscription.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (if maxBatchSize is 0, or maxBatchDelay is negative, not finite or too large)
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createBatchSubscription(const mamaEnvBatchMsgCallbacks* callback,
+    void* closure, mamaEnvSession session, const char* symbol, mamaTransport transport,
+    mama_u32_t maxBatchSize, mama_f64_t maxBatchDelay, mamaSubscription* subscription);
+
+
+/**
+ * This function will create a basic subscription within the managed environment that delivers
+ * only the latest message, for consumers that need the current state rather than every update.
+ * At most one message is held for the subscription, a newer message replaces it, and it is
+ * delivered either once the events already on the session queue when it arrived have been
+ * dispatched, (interval 0), or no sooner than interval seconds after the previous delivery.
+ * The subscription is otherwise the same as one created by mamaEnv_createBasicSubscription,
+ * except that the item closure passed to onMsg is always NULL.
+ *
+ * @param callback (in) Subscription callback function pointers.
+ * @param closure (in) The closure that will be passed back to the callback functions.
+ * @param session (in) The session for which the subscription should be created.
+ * @param symbol (in) The symbol to subscribe to.
+ * @param transport (in) The mama transport.
+ * @param interval (in) The shortest time in seconds between deliveries, or 0.
+ * @param subscription (out) To return the resulting mamaSubscription.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (if interval is negative, not finite or too large)
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createConflatedSubscription(const mamaMsgCallbacks* callback,
+    void* closure, mamaEnvSession session, const char* symbol, mamaTransport transport,
+    mama_f64_t interval, mamaSubscription* subscription);
+
+/* Counters for a conflated subscription. */
+typedef struct mamaEnvConflationStats
+{
+    /* The number of messages received from mama. */
+    mama_u64_t m_received;
+
+    /* The number of messages delivered to the application. */
+    mama_u64_t m_delivered;
+
+    /* The number of messages replaced by a newer message before they were delivered. */
+    mama_u64_t m_conflated;
+
+} mamaEnvConflationStats;
+
+/**
+ * This function will return the counters of a subscription created by
+ * mamaEnv_createConflatedSubscription, it may be called from any thread.
+ *
+ * @param session (in) The session that the subscription was created on.
+ * @param subscription (in) The conflated subscription.
+ * @param stats (out) To return the counters.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (if the subscription is not conflated)
+ *      MAMA_STATUS_NOT_FOUND, (if the subscription is not on the session)
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_getConflationStats(mamaEnvSession session, mamaSubscription subscription, mamaEnvConflationStats* stats);
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Routed subscriptions
+//////////////////////////////////////////////////////////////////////////////
+
+/* The callback invoked for a message whose topic matches a route. */
+typedef void (MAMACALLTYPE* mamaEnv_onRoutedMsgCallback)(mamaSubscription subscription, mamaMsg message, const char* topic, void* closure);
+
+/* Whether a route matches one topic or every topic starting with a prefix. */
+typedef enum mamaEnvRouteType
+{
+    mamaEnvRouteTopic = 0,
+    mamaEnvRoutePrefix = 1
+
+} mamaEnvRouteType;
+
+/**
+ * This function will create a wildcard subscription whose messages are routed to handlers
+ * registered per topic, or per topic prefix, with mamaEnv_addTopicRoute. Each topic is interned
+ * the first time it arrives and set as mama's closure for the topic, with the route resolved for
+ * it, so a repeated topic is routed through the entry mama passes back rather than by a hash
+ * lookup or a string compare.
+ * A message for a topic with a route is passed to the route's callback, and a topic route is
+ * preferred to a prefix route and a longer prefix to a shorter one. Any other message is passed
+ * to the onMsg callback with a NULL item closure, since MME uses the topic closures of a routed
+ * subscription to hold the interned topics and mamaSubscription_setTopicClosure or
+ * mamaSubscription_setItemClosure must not be called on it. Otherwise it behaves exactly as
+ * mamaEnv_createWildcardSubscription.
+ *
+ * @param callback (in) Subscription callback function pointers.
+ * @param closure (in) The closure that will be passed back to the callback functions.
+ * @param session (in) The session for which the subscription should be created.
+ * @param source (in) The source to subscribe to.
+ * @param symbol (in) The symbol to subscribe to.
+ * @param transport (in) The mama transport.
+ * @param subscription (out) To return the resulting mamaSubscription.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createRoutedSubscription(const mamaWildCardMsgCallbacks* callback,
+    void* closure, mamaEnvSession session,
+    const char* source, const char* symbol,
+    mamaTransport transport, mamaSubscription* subscription);
+
+/**
+ * This function will add a route to a subscription created by mamaEnv_createRoutedSubscription,
+ * replacing any route of the same type for the same topic. It may be called from any thread,
+ * including from within a callback, and applies to the next message dispatched.
+ *
+ * @param session (in) The session that the subscription was created on.
+ * @param subscription (in) The routed subscription.
+ * @param type (in) Whether topic is a whole topic or a prefix.
+ * @param topic (in) The topic or prefix.
+ * @param callback (in) The callback for matching messages.
+ * @param closure (in) The closure that will be passed back to the callback.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (if the subscription is not routed)
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NOT_FOUND, (if the subscription is not on the session)
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_addTopicRoute(mamaEnvSession session, mamaSubscription subscription, mamaEnvRouteType type,
+    const char* topic, mamaEnv_onRoutedMsgCallback callback, void* closure);
+
+/**
+ * This function will remove a route added by mamaEnv_addTopicRoute. The route's callback may
+ * still be running on the dispatch thread when this returns, but won't be invoked again.
+ *
+ * @param session (in) The session that the subscription was created on.
+ * @param subscription (in) The routed subscription.
+ * @param type (in) Whether topic is a whole topic or a prefix.
+ * @param topic (in) The topic or prefix.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (if the subscription is not routed)
+ *      MAMA_STATUS_NOT_FOUND, (if the subscription or the route does not exist)
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_removeTopicRoute(mamaEnvSession session, mamaSubscription subscription, mamaEnvRouteType type, const char* topic);
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Offloaded subscriptions
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * This function will create a basic subscription whose onMsg callback runs on one of the
+ * connection's offload lanes, (see mamaEnv_createOffloadLanes), rather than on the session.
+ * The session's thread only detaches each message and hands it to the lane, so a slow
+ * callback does not hold up the other subscriptions on the session. The messages of one
+ * subscription are always delivered in order, by one lane, and the message passed to the
+ * callback is destroyed once it returns. The create and error callbacks still run on the
+ * session.
+ * Destroying or shutting down the subscription from any thread, including the session's,
+ * waits for a callback running on the lane to return, and no callback starts afterwards.
+ * So an offloaded callback must not wait on the thread that destroys its subscription.
+ *
+ * @param callback (in) Subscription callback function pointers.
+ * @param closure (in) The closure that will be passed back to the callback functions.
+ * @param session (in) The session for which the subscription should be created.
+ * @param symbol (in) The symbol to subscribe to.
+ * @param transport (in) The mama transport.
+ * @param subscription (out) To return the resulting mamaSubscription.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_INVALID_ARG, (if the connection has no offload lanes)
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_createOffloadedSubscription(const mamaMsgCallbacks* callback,
+    void* closure, mamaEnvSession session, const char* symbol, mamaTransport transport,
+    mamaSubscription* subscription);
+
+
 /**
  * This function will destroy a subscription created by one of the mamaEnv_createXXXSubscription
  * functions. Note that this function can be called from any thread.
@@ -178,6 +893,25 @@ MAMAENV_API mama_status mamaEnv_destroySubscription(mamaEnvSession session, mama
 mama_status mamaEnv_shutdownSubscription(mamaEnvSession session, mamaSubscription subscription);
 
 
+/**
+ * These functions destroy, or shut down, a number of subscriptions on one session as if
+ * mamaEnv_destroySubscription or mamaEnv_shutdownSubscription had been called for each one, but the session's
+ * subscription map is locked once rather than once per subscription, and the destroys are completed by a
+ * single event on the session rather than one event each.
+ *
+ * @param session (in) The session that the subscriptions were created on.
+ * @param subscriptions (in) An array of count subscriptions.
+ * @param count (in) The number of subscriptions.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_destroySubscriptions(mamaEnvSession session, mamaSubscription* subscriptions, mama_u32_t count);
+MAMAENV_API mama_status mamaEnv_shutdownSubscriptions(mamaEnvSession session, mamaSubscription* subscriptions, mama_u32_t count);
+
+
 //////////////////////////////////////////////////////////////////////////////
 // Inboxes
 //////////////////////////////////////////////////////////////////////////////
@@ -224,6 +958,25 @@ MAMAENV_API mama_status mamaEnv_destroyInbox(mamaEnvSession session, mamaInbox i
 
 MAMAENV_API mama_status mamaEnv_shutdownInbox(mamaEnvSession session, mamaInbox inbox);
 
+
+/**
+ * These functions destroy, or shut down, a number of inboxes on one session as if
+ * mamaEnv_destroyInbox or mamaEnv_shutdownInbox had been called for each one, but the session's
+ * inbox map is locked once rather than once per inbox, and the destroys are completed by a
+ * single event on the session rather than one event each.
+ *
+ * @param session (in) The session that the inboxes were created on.
+ * @param inboxes (in) An array of count inboxes.
+ * @param count (in) The number of inboxes.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_destroyInboxes(mamaEnvSession session, mamaInbox* inboxes, mama_u32_t count);
+MAMAENV_API mama_status mamaEnv_shutdownInboxes(mamaEnvSession session, mamaInbox* inboxes, mama_u32_t count);
+
 //////////////////////////////////////////////////////////////////////////////
 // Timers
 //////////////////////////////////////////////////////////////////////////////
@@ -269,4 +1022,23 @@ MAMAENV_API mama_status mamaEnv_destroyTimer(mamaEnvSession session, mamaTimer t
 
 MAMAENV_API mama_status mamaEnv_shutdownTimer(mamaEnvSession session, mamaTimer timer);
 
+
+/**
+ * These functions destroy, or shut down, a number of timers on one session as if
+ * mamaEnv_destroyTimer or mamaEnv_shutdownTimer had been called for each one, but the session's
+ * timer map is locked once rather than once per timer, and the destroys are completed by a
+ * single event on the session rather than one event each.
+ *
+ * @param session (in) The session that the timers were created on.
+ * @param timers (in) An array of count timers.
+ * @param count (in) The number of timers.
+ * @return Resulting status of the call which can be
+ *      MAMA_STATUS_NO_MEM
+ *      MAMA_STATUS_NULL_ARG
+ *      MAMA_STATUS_PLATFORM
+ *      MAMA_STATUS_OK
+ */
+MAMAENV_API mama_status mamaEnv_destroyTimers(mamaEnvSession session, mamaTimer* timers, mama_u32_t count);
+MAMAENV_API mama_status mamaEnv_shutdownTimers(mamaEnvSession session, mamaTimer* timers, mama_u32_t count);
+
 #endif
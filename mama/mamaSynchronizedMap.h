@@ -22,20 +22,77 @@ typedef struct RedBlackTreeEntry
 
 } RedBlackTreeEntry;
 
+/* Indicates how the entries in the map are stored. */
+typedef enum SynchronizedMapType
+{
+    /* Each entry is a separately allocated red black tree node. */
+    RedBlackTreeMap = 1,
+
+    /* Entries are stored in flat open-addressing slots keyed by pointer. */
+    HashTableMap = 2
+} SynchronizedMapType;
+
+/* A single slot in the hash table, a NULL key marks an empty slot. */
+typedef struct PointerHashSlot
+{
+    /* The key used to look up the data. */
+    void* m_key;
+
+    /* The data stored against the key. */
+    void* m_data;
+
+} PointerHashSlot;
+
+/* An open-addressing (linear probing) table of pointer keys. */
+typedef struct PointerHashTable
+{
+    /* The slots, the number of slots is always a power of 2. */
+    PointerHashSlot* m_slots;
+
+    /* The number of slots. */
+    size_t m_capacity;
+
+    /* The number of slots holding a live entry. */
+    size_t m_used;
+
+} PointerHashTable;
+
 /* This structure defines the map and basically contains a red black tree
- * and a lock.
+ * or a hash table, and a lock.
  */
 typedef struct SynchronizedMap
 {
     /* The lock to protect the map. */
     wLock m_lock;
 
-    /* The number of entries in the tree. */
+    /* The number of entries in the tree, (always zero for a sharded map). */
     long m_numberEntries;
 
+    /* The storage used by this map. */
+    SynchronizedMapType m_type;
+
     /* Define the structure of the red black tree. */
     RB_HEAD(mamaEnvSynchMap_, RedBlackTreeEntry) m_tree;
 
+    /* The hash table that all new entries are inserted into. */
+    PointerHashTable m_table;
+
+    /* While the table is being grown the previous table is kept here and its
+     * entries are migrated a few at a time on each insert and remove.
+     */
+    PointerHashTable m_oldTable;
+
+    /* The next slot in the old table to be migrated. */
+    size_t m_rehashIndex;
+
+    /* A sharded map holds no entries itself, instead each key is hashed to one
+     * of these independently locked maps.
+     */
+    struct SynchronizedMap** m_shards;
+
+    /* The number of shards, always a power of 2. */
+    size_t m_numberShards;
+
 } SynchronizedMap;
 
 typedef struct mamaEnvSynchMap_ mamaEnvSynchMap;
@@ -43,13 +100,32 @@ typedef struct mamaEnvSynchMap_ mamaEnvSynchMap;
 typedef mama_status (*synchronizedMap_Callback)(void* data, void* closure);
 
 MAMAENV_API SynchronizedMap* synchronizedMap_create(void);
+MAMAENV_API SynchronizedMap* synchronizedMap_createWithType(SynchronizedMapType type);
+MAMAENV_API SynchronizedMap* synchronizedMap_createSharded(SynchronizedMapType type, size_t numberShards);
 MAMAENV_API void synchronizedMap_destroy(SynchronizedMap* map);
 MAMAENV_API mama_status synchronizedMap_foreach(synchronizedMap_Callback callback, void* closure, int ignoreErrors, SynchronizedMap* map);
 MAMAENV_API mama_status synchronizedMap_insert(void* data, void* key, SynchronizedMap* map);
+
+/* Inserts the data of each of a number of keys, taking the lock of the map, (or of each shard),
+ * only once. The status of each insert is written to results and the first error is returned.
+ */
+MAMAENV_API mama_status synchronizedMap_insertEntries(void** keys, void** data, size_t count, SynchronizedMap* map, mama_status* results);
 MAMAENV_API mama_status synchronizedMap_remove(void* key, SynchronizedMap* map, void** data);
+
+/* Removes a number of keys, taking the lock of the map, (or of each shard), only once. The data
+ * of each key, or NULL, is written to data and the status of each remove to results, (which is
+ * MAMA_STATUS_INVALID_ARG for a key that is not in the map). The first error is returned.
+ */
+MAMAENV_API mama_status synchronizedMap_removeEntries(void** keys, size_t count, SynchronizedMap* map, void** data, mama_status* results);
 MAMAENV_API mama_status synchronizedMap_removeAll(synchronizedMap_Callback callback, void* closure, SynchronizedMap* map);
 
 //MAMAENV_API mama_status synchronizedMap_find(void* key, SynchronizedMap* map, void** data);
 MAMAENV_API mama_status synchronizedMap_for(synchronizedMap_Callback callback, void* key, SynchronizedMap* map, void* closure);
 
+/* As synchronizedMap_for for each of a number of keys, taking the lock of the map, (or of each
+ * shard), only once. The result of each callback, or MAMA_STATUS_NOT_FOUND, is written to results
+ * and the first error is returned.
+ */
+MAMAENV_API mama_status synchronizedMap_forEachKey(synchronizedMap_Callback callback, void** keys, size_t count, SynchronizedMap* map, void* closure, mama_status* results);
+
 #endif
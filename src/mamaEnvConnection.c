@@ -1,5 +1,6 @@
 #include "mama/mamaManagedEnvironment.h"
 #include "mama/mamaEnvConnection.h"
+#include "mama/mamaEnvSessionGroup.h"
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -12,6 +13,8 @@ mama_status mamaEnv_createConnection(mamaBridge bridge, mamaEnvConnection* conne
         mmeConnection* localConnection = (mamaEnvConnection)calloc(1, sizeof(mmeConnection));
         ret = MAMA_STATUS_NOMEM;
         if (localConnection != NULL) {
+            mamaEnvInterestTable_init(&localConnection->m_interests);
+
             /* Create the synch object used when shutting down. */
             ret = mamaEnv_createEvent(&localConnection->m_destroySynch);
             if (ret == MAMA_STATUS_OK) {
@@ -31,12 +34,9 @@ mama_status mamaEnv_createConnection(mamaBridge bridge, mamaEnvConnection* conne
                                 /* Create the destroyed sessions array. */
                                 localConnection->m_destroyedSessions = list_create(sizeof(mmeSession*));
                                 if (localConnection->m_destroyedSessions != NULL) {
-                                    /* Create the session timer. */
-                                    ret = mamaTimer_create(&localConnection->m_sessionTimer, localConnection->m_objectQueue, (mamaTimerCb)mamaEnvConnection_onSessionTimerTick, MEVC_SESSION_TIMER_INTERVAL, (void*)localConnection);
-                                    if (ret == MAMA_STATUS_OK) {
-                                        /* Save arguments in the structure. */
-                                        localConnection->m_bridge = bridge;
-                                    }
+                                    /* Save arguments in the structure. */
+                                    localConnection->m_bridge = bridge;
+                                    ret = MAMA_STATUS_OK;
                                 }
                             }
                         }
@@ -63,59 +63,288 @@ mama_status mamaEnv_createConnection(mamaBridge bridge, mamaEnvConnection* conne
 
 
 //////////////////////////////////////////////////////////////////////////////
-mama_status mamaEnv_createSession(mamaEnvConnection connection, mamaEnvSession* session)
+mama_status mamaEnv_createWorkerPool(mamaEnvConnection connection, mama_u32_t numberWorkers)
 {
     /* Returns. */
     mama_status ret = MAMA_STATUS_NULL_ARG;
-    if ((connection != NULL) && (session != NULL)) {
+    if (connection != NULL) {
         /* Cast the connection object. */
         mmeConnection* envConnection = (mmeConnection*)connection;
 
-        /* Allocate a new session object. */
-        mmeSession* localSession = NULL;
-        ret = mamaEnvSession_allocate(&localSession);
-        if (ret == MAMA_STATUS_OK) {
-            /* Use a utility structure to pass the data to the callback. */
-            CreationUtilityStructure utility;
-            memset(&utility, 0, sizeof(utility));
-            utility.m_bridge = envConnection->m_bridge;
-            utility.m_session = localSession;
-            utility.m_status = MAMA_STATUS_OK;
-
-            /* Create a synchronization object. */
-            ret = mamaEnv_createEvent(&utility.m_synch);
+        /* Start the workers. */
+        ret = MAMA_STATUS_INVALID_ARG;
+        mmeWorkerPool* localPool = NULL;
+        if (numberWorkers > 0) {
+            ret = mamaEnvWorkerPool_create(numberWorkers, &localPool);
             if (ret == MAMA_STATUS_OK) {
-                /* Enqueue an event on the object queue to complete creation of the session. */
-                ret = mamaQueue_enqueueEvent(envConnection->m_objectQueue, (mamaQueueEventCB)mamaEnvConnection_onSessionCreate, &utility);
-                if (ret == MAMA_STATUS_OK) {
-                    /* Wait on the session being created. */
-                    ret = mamaEnv_waitEvent(utility.m_synch);
-                    if (ret == MAMA_STATUS_OK) {
-                        /* Extract the status code from the utility structure. */
-                        ret = utility.m_status;
-                        if (ret == MAMA_STATUS_OK) {
-                            /* Add the session to the sessions array. */
-                            ret = mamaEnvConnection_addSessionToList(envConnection->m_sessions, localSession);
+                /* Only the first pool is kept, the connection can't swap pools under its sessions. */
+                mmeWorkerPool* expected = NULL;
+                if (!__atomic_compare_exchange_n(&envConnection->m_workerPool, &expected, localPool, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                    mamaEnvWorkerPool_destroy(localPool);
+                    ret = MAMA_STATUS_INVALID_ARG;
+                }
+            }
+        }
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - createWorkerPool with connection %p and %u workers completed with code %X.", envConnection, numberWorkers, ret);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createOffloadLanes(mamaEnvConnection connection, mama_u32_t numberLanes)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if (connection != NULL) {
+        /* Cast the connection object. */
+        mmeConnection* envConnection = (mmeConnection*)connection;
+
+        ret = MAMA_STATUS_INVALID_ARG;
+        if ((numberLanes > 0) && (__atomic_load_n(&envConnection->m_destroying, __ATOMIC_ACQUIRE) == 0) && (__atomic_load_n(&envConnection->m_offloadLanes, __ATOMIC_ACQUIRE) == NULL)) {
+            ret = MAMA_STATUS_NOMEM;
+            mmeOffloadLanes* lanes = (mmeOffloadLanes*)calloc(1, sizeof(mmeOffloadLanes) + (numberLanes * sizeof(mmeSession*)));
+            if (lanes != NULL) {
+                /* The lanes are dispatched by the worker pool if the connection has one, otherwise
+                 * each has a thread of its own. They are ordinary sessions in the connection's
+                 * list so they are destroyed with the connection.
+                 */
+                mamaEnvSessionAttributes attributes;
+                mamaEnv_initSessionAttributes(&attributes);
+                if (__atomic_load_n(&envConnection->m_workerPool, __ATOMIC_ACQUIRE) != NULL) {
+                    attributes.m_dispatchMode = mamaEnvDispatchWorkerPool;
+                }
+                lanes->m_numberLanes = numberLanes;
+                ret = MAMA_STATUS_OK;
+                for (mama_u32_t i = 0; (i < numberLanes) && (ret == MAMA_STATUS_OK); i++) {
+                    ret = mamaEnv_createSessionWithAttributes(connection, &attributes, &lanes->m_lanes[i]);
+                }
+
+                /* Only the first set of lanes is kept, subscriptions are pinned to them. */
+                mmeOffloadLanes* expected = NULL;
+                if ((ret == MAMA_STATUS_OK) && !__atomic_compare_exchange_n(&envConnection->m_offloadLanes, &expected, lanes, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                    ret = MAMA_STATUS_INVALID_ARG;
+                }
+                if (ret != MAMA_STATUS_OK) {
+                    for (mama_u32_t i = 0; i < numberLanes; i++) {
+                        if (lanes->m_lanes[i] != NULL) {
+                            mamaEnv_destroySession(connection, lanes->m_lanes[i]);
                         }
                     }
+                    free(lanes);
+                }
+            }
+        }
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - createOffloadLanes with connection %p and %u lanes completed with code %X.", envConnection, numberLanes, ret);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvConnection_getOffloadLane(mmeConnection* connection, mmeSession** lane)
+{
+    /* No new offloaded subscription can be made once the sessions are being destroyed. */
+    mmeOffloadLanes* lanes = __atomic_load_n(&connection->m_offloadLanes, __ATOMIC_ACQUIRE);
+    if ((lanes == NULL) || (__atomic_load_n(&connection->m_destroying, __ATOMIC_ACQUIRE) != 0)) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    /* Subscriptions are spread over the lanes in turn. */
+    mama_u32_t next = __atomic_fetch_add(&connection->m_nextOffloadLane, 1, __ATOMIC_RELAXED);
+    *lane = lanes->m_lanes[next % lanes->m_numberLanes];
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvConnection_getSharingSession(mmeConnection* connection, mmeSession** session)
+{
+    /* No new shared subscription can be made once the sessions are being destroyed. */
+    if (__atomic_load_n(&connection->m_destroying, __ATOMIC_ACQUIRE) != 0) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    /* The sharing session is created by the first shared subscription, it is an ordinary
+     * session in the connection's list so it is destroyed with the connection.
+     */
+    mmeSession* localSession = __atomic_load_n(&connection->m_sharingSession, __ATOMIC_ACQUIRE);
+    if (localSession == NULL) {
+        mama_status ret = mamaEnv_createSession(connection, &localSession);
+        if (ret != MAMA_STATUS_OK) {
+            return ret;
+        }
+
+        /* Only the first session is kept. */
+        mmeSession* expected = NULL;
+        if (!__atomic_compare_exchange_n(&connection->m_sharingSession, &expected, localSession, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            mamaEnv_destroySession(connection, localSession);
+            localSession = expected;
+        }
+    }
+
+    *session = localSession;
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createSession(mamaEnvConnection connection, mamaEnvSession* session)
+{
+    /* This is just a batch of one. */
+    return mamaEnv_createSessions(connection, 1, session);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createSessions(mamaEnvConnection connection, mama_u32_t numberSessions, mamaEnvSession* sessions)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((connection != NULL) && (sessions != NULL)) {
+        ret = mamaEnvConnection_createSessions((mmeConnection*)connection, numberSessions, NULL, (mmeSession**)sessions);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createSessionWithAttributes(mamaEnvConnection connection, const mamaEnvSessionAttributes* attributes, mamaEnvSession* session)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((connection != NULL) && (attributes != NULL) && (session != NULL)) {
+        ret = mamaEnvConnection_createSessions((mmeConnection*)connection, 1, attributes, (mmeSession**)session);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvConnection_createSessions(mmeConnection* envConnection, mama_u32_t numberSessions, const mamaEnvSessionAttributes* attributes, mmeSession** localSessions)
+{
+    /* Clear the results so that anything not created is returned as NULL. */
+    memset(localSessions, 0, numberSessions * sizeof(mmeSession*));
+
+    /* Allocate all of the session objects up front. */
+    mama_status ret = (numberSessions > 0) ? MAMA_STATUS_OK : MAMA_STATUS_INVALID_ARG;
+    for (mama_u32_t i = 0; (i < numberSessions) && (ret == MAMA_STATUS_OK); i++) {
+        ret = mamaEnvSession_allocate(&localSessions[i]);
+        if (ret == MAMA_STATUS_OK) {
+            localSessions[i]->m_connection = envConnection;
+
+            /* The attributes are applied later by the dispatcher thread. */
+            if (attributes != NULL) {
+                ret = mamaEnvSession_setAttributes(localSessions[i], attributes);
+            }
+        }
+    }
+    if (ret == MAMA_STATUS_OK) {
+        /* Use a utility structure to pass the data to the callback. */
+        CreationUtilityStructure utility;
+        memset(&utility, 0, sizeof(utility));
+        utility.m_bridge = envConnection->m_bridge;
+        utility.m_sessions = localSessions;
+        utility.m_numberSessions = numberSessions;
+        utility.m_status = MAMA_STATUS_OK;
+
+        /* Create a synchronization object. */
+        ret = mamaEnv_createEvent(&utility.m_synch);
+        if (ret == MAMA_STATUS_OK) {
+            /* Enqueue a single event on the object queue to complete creation of all the sessions. */
+            ret = mamaQueue_enqueueEvent(envConnection->m_objectQueue, (mamaQueueEventCB)mamaEnvConnection_onSessionCreate, &utility);
+            if (ret == MAMA_STATUS_OK) {
+                /* Wait on the sessions being created. */
+                ret = mamaEnv_waitEvent(utility.m_synch);
+                if (ret == MAMA_STATUS_OK) {
+                    /* Extract the status code from the utility structure. */
+                    ret = utility.m_status;
                 }
+            }
 
-                /* Destroy the synchronization object. */
-                mamaEnv_destroyEvent(utility.m_synch);
+            /* Destroy the synchronization object. */
+            mamaEnv_destroyEvent(utility.m_synch);
+        }
+    }
+
+    /* Add the sessions to the sessions array in one pass. */
+    for (mama_u32_t i = 0; (i < numberSessions) && (ret == MAMA_STATUS_OK); i++) {
+        ret = mamaEnvConnection_addSessionToList(envConnection->m_sessions, localSessions[i]);
+    }
+
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - createSessions with connection %p and %u sessions completed with code %X.", envConnection, numberSessions, ret);
+
+    /* If something went wrong then delete all of the sessions, none will have been
+     * left running.
+     */
+    if (ret != MAMA_STATUS_OK) {
+        for (mama_u32_t i = 0; i < numberSessions; i++) {
+            if (localSessions[i] != NULL) {
+                if (localSessions[i]->m_listEntry != NULL) {
+                    mamaEnvConnection_removeSessionFromList(envConnection->m_sessions, localSessions[i]);
+                }
+                mamaEnvSession_destroy(localSessions[i]);
+                mamaEnvSession_deallocate(localSessions[i]);
+                localSessions[i] = NULL;
+            }
+        }
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createSessionAsync(mamaEnvConnection connection, mamaEnv_onSessionCreateCallback callback, void* closure)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((connection != NULL) && (callback != NULL)) {
+        /* Cast the connection object. */
+        mmeConnection* envConnection = (mmeConnection*)connection;
+
+        /* The utility structure outlives this call so is allocated, it is freed by the event. */
+        ret = MAMA_STATUS_NOMEM;
+        CreationUtilityStructure* utility = (CreationUtilityStructure*)calloc(1, sizeof(CreationUtilityStructure));
+        if (utility != NULL) {
+            /* Allocate a new session object. */
+            ret = mamaEnvSession_allocate(&utility->m_session);
+            if (ret == MAMA_STATUS_OK) {
+                utility->m_session->m_connection = envConnection;
+                utility->m_bridge = envConnection->m_bridge;
+                utility->m_sessions = &utility->m_session;
+                utility->m_numberSessions = 1;
+                utility->m_status = MAMA_STATUS_OK;
+                utility->m_connection = envConnection;
+                utility->m_callback = callback;
+                utility->m_closure = closure;
+
+                /* Enqueue an event on the object queue to complete creation of the session. */
+                ret = mamaQueue_enqueueEvent(envConnection->m_objectQueue, (mamaQueueEventCB)mamaEnvConnection_onSessionCreate, utility);
             }
 
             /* Write a mama log. */
-            mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - createSession with connection %p and session %p completed with code %X.", envConnection, localSession, ret);
+            mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - createSessionAsync with connection %p and session %p completed with code %X.", envConnection, utility->m_session, ret);
 
             /* If something went wrong then delete the session. */
             if (ret != MAMA_STATUS_OK) {
-                mamaEnvSession_deallocate(localSession);
-                localSession = NULL;
+                if (utility->m_session != NULL) {
+                    mamaEnvSession_deallocate(utility->m_session);
+                }
+                free(utility);
             }
         }
-
-        /* Write the session object back. */
-        *session = (mamaEnvSession)localSession;
     }
 
     return ret;
@@ -131,27 +360,19 @@ mama_status mamaEnv_destroyConnection(mamaEnvConnection connection)
         /* Cast the connection object. */
         mmeConnection* envConnection = (mmeConnection*)connection;
 
-        /* Destroy the session timer first to prevent it ticking. */
-        ret = mamaTimer_destroy(envConnection->m_sessionTimer);
+        /* Enumerate all the open sessions and destroy each one. */
+        ret = mamaEnvConnection_enumerateList(envConnection->m_sessions, (mamaEnv_listCallback)mamaEnvConnection_onSessionListEnumerate, (void*)envConnection);
         if (ret == MAMA_STATUS_OK) {
-            /* Clear the timer to prevent it being destroyed again. */
-            envConnection->m_sessionTimer = NULL;
-
-            /* Enumerate all the open sessions and destroy each one. */
-            ret = mamaEnvConnection_enumerateList(envConnection->m_sessions, (mamaEnv_listCallback)mamaEnvConnection_onSessionListEnumerate, (void*)envConnection);
+            /* Enqueue an event on the object queue that marks the connection as being
+             * destroyed, once this has run only session reclaims follow it on the queue.
+             */
+            ret = mamaQueue_enqueueEvent(envConnection->m_objectQueue, (mamaQueueEventCB)mamaEnvConnection_onDestroyAllSessions, (void*)envConnection);
             if (ret == MAMA_STATUS_OK) {
-                /* Now the timer has stopped enqueue an event on the object queue that
-                 * actually performs the destruction of the session.
-                 * This will be the last event that goes onto the queue.
-                 */
-                ret = mamaQueue_enqueueEvent(envConnection->m_objectQueue, (mamaQueueEventCB)mamaEnvConnection_onDestroyAllSessions, (void*)envConnection);
+                /* Wait until the last session has been reclaimed. */
+                ret = mamaEnv_waitEvent(envConnection->m_destroySynch);
                 if (ret == MAMA_STATUS_OK) {
-                    /* Wait until the final message has been processed. */
-                    ret = mamaEnv_waitEvent(envConnection->m_destroySynch);
-                    if (ret == MAMA_STATUS_OK) {
-                        /* Free the connection object. */
-                        ret = mamaEnvConnection_deallocate(envConnection);
-                    }
+                    /* Free the connection object. */
+                    ret = mamaEnvConnection_deallocate(envConnection);
                 }
             }
         }
@@ -170,29 +391,61 @@ mama_status mamaEnv_destroySession(mamaEnvConnection connection, mamaEnvSession
     /* Returns. */
     mama_status ret = MAMA_STATUS_NULL_ARG;
     if ((connection != NULL) && (session != NULL)) {
-        /* Cast the pointers. */
-        mmeConnection* envConnection = (mmeConnection*)connection;
-        mmeSession* envSession = (mmeSession*)session;
+        /* A session in a group belongs to the group, and is only destroyed with it. */
+        ret = MAMA_STATUS_INVALID_ARG;
+        if (((mmeSession*)session)->m_group == NULL) {
+            ret = mamaEnvConnection_destroySession((mmeConnection*)connection, (mmeSession*)session);
+        }
+        else {
+            mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnv_destroySession - session %p belongs to group %p and must be destroyed with it.", session, ((mmeSession*)session)->m_group);
+        }
+    }
 
-        /* Remove the session from the session list. */
-        ret = mamaEnvConnection_removeSessionFromList(envConnection->m_sessions, envSession);
-        if (ret == MAMA_STATUS_OK) {
-            // TODO: keep or delete?
-            /* Stop dispatching events */
-            //mamaEnvSession_deactivate(envSession);
+    return ret;
+}
 
-            /* Destroy all of the outstanding events in the session. */
-            ret = mamaEnvSession_destroyAllEvents(envSession);
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvConnection_destroySession(mmeConnection* envConnection, mmeSession* envSession)
+{
+    /* Take the session out of its group, so that destroying the group later doesn't touch it.
+     * If the group has already taken it then the group is destroying it.
+     */
+    if (envSession->m_group != NULL) {
+        mmeSession* member = __atomic_exchange_n(&envSession->m_group->m_sessions[envSession->m_groupIndex], NULL, __ATOMIC_ACQ_REL);
+        if (member == NULL) {
+            return MAMA_STATUS_OK;
+        }
+        envSession->m_group = NULL;
+    }
+
+    /* Remove the session from the session list. */
+    mama_status ret = mamaEnvConnection_removeSessionFromList(envConnection->m_sessions, envSession);
+    if (ret == MAMA_STATUS_OK) {
+        // TODO: keep or delete?
+        /* Stop dispatching events */
+        //mamaEnvSession_deactivate(envSession);
+
+        /* Destroy all of the outstanding events in the session. */
+        ret = mamaEnvSession_destroyAllEvents(envSession);
+        if (ret == MAMA_STATUS_OK) {
+            /* Add the session to the destroy list. */
+            ret = mamaEnvConnection_addSessionToList(envConnection->m_destroyedSessions, envSession);
             if (ret == MAMA_STATUS_OK) {
-                /* Add the session to the destroy list. */
-                ret = mamaEnvConnection_addSessionToList(envConnection->m_destroyedSessions, envSession);
+                /* An application dispatched session gets a dispatcher to drain its queue. */
+                mamaEnvSession_closePump(envSession);
+
+                /* Drop the session's own reference, it will be reclaimed as soon as the
+                 * destroy events for all of its objects have been processed.
+                 */
+                mamaEnvSession_release(envSession);
             }
         }
-
-        /* Write a mama log. */
-        mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - destroySession with connection %p and session %p completed with code %X.", envConnection, envSession, ret);
     }
 
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - destroySession with connection %p and session %p completed with code %X.", envConnection, envSession, ret);
+
     return ret;
 }
 
@@ -225,6 +478,22 @@ mama_status mamaEnvConnection_addSessionToList(wList list, mmeSession* session)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvConnection_checkDestroyComplete(mmeConnection* connection)
+{
+    /* This is only called on the object thread, so no session can be added or reclaimed meanwhile. */
+    if ((connection->m_destroying == 0) || (list_size(connection->m_destroyedSessions) > 0)) {
+        return MAMA_STATUS_OK;
+    }
+
+    /* Only signal once. */
+    connection->m_destroying = 0;
+
+    /* Set the event to release the thread waiting in mamaEnv_destroyConnection. */
+    return mamaEnv_setEvent(connection->m_destroySynch);
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnvConnection_deallocate(mmeConnection* connection)
 {
@@ -234,11 +503,11 @@ mama_status mamaEnvConnection_deallocate(mmeConnection* connection)
      */
     mama_status ret = MAMA_STATUS_OK;
 
-    /* Destroy the session timer. */
-    if (connection->m_sessionTimer != NULL) {
-        mama_status mtd = mamaTimer_destroy(connection->m_sessionTimer);
+    /* Stop the worker threads, every session they dispatched has been reclaimed. */
+    if (connection->m_workerPool != NULL) {
+        mama_status mwd = mamaEnvWorkerPool_destroy(connection->m_workerPool);
         if (ret == MAMA_STATUS_OK) {
-            ret = mtd;
+            ret = mwd;
         }
     }
 
@@ -276,6 +545,12 @@ mama_status mamaEnvConnection_deallocate(mmeConnection* connection)
         }
     }
 
+    /* Every shared subscription has been destroyed along with its sessions. */
+    mamaEnvInterestTable_destroy(&connection->m_interests);
+
+    /* The offload lanes have been reclaimed with the other sessions. */
+    free(connection->m_offloadLanes);
+
     /* Free the connection object. */
     free(connection);
 
@@ -325,26 +600,19 @@ void MAMACALLTYPE mamaEnvConnection_onDestroyAllSessions(mamaQueue queue, void*
     /* Cast the closure to the connection object. */
     mmeConnection* connection = (mmeConnection*)closure;
     if (connection != NULL) {
-        /* Get the number of sessions to be destroyed. */
-        long numberSessions = list_size(connection->m_destroyedSessions);
-        ret = MAMA_STATUS_OK;
-        while ((connection->m_destroyedSessions != NULL) && (ret == MAMA_STATUS_OK) && (numberSessions > 0)) {
-            /* Enumerate all of the sessions in the list and destroy each one in turn. */
-            ret = mamaEnvConnection_enumerateList(connection->m_destroyedSessions, (mamaEnv_listCallback)mamaEnvConnection_onSessionDestroyListEnumerate, NULL);
-            if (ret != MAMA_STATUS_OK) {
-                mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnvConnection_onDestroyAllSessions - mamaEnvConnection_onSessionDestroyListEnumerate failed with code %X.", ret);
-            }
-
-            /* Get the number of sessions remaining in the list. */
-            numberSessions = list_size(connection->m_destroyedSessions);
-            /* If there are still any open sessions then sleep. */
-            if (numberSessions > 0) {
-                ret = mamaQueue_timedDispatch(queue, 10);
-            }
+        /* Sessions created asynchronously may have been added after the session list was
+         * enumerated in mamaEnv_destroyConnection, so destroy any that are left.
+         */
+        ret = mamaEnvConnection_enumerateList(connection->m_sessions, (mamaEnv_listCallback)mamaEnvConnection_onSessionListEnumerate, (void*)connection);
+        if (ret != MAMA_STATUS_OK) {
+            mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnvConnection_onDestroyAllSessions - mamaEnvConnection_onSessionListEnumerate failed with code %X.", ret);
         }
 
-        /* Set the event to release the waiting thread. */
-        ret = mamaEnv_setEvent(connection->m_destroySynch);
+        /* Every session is now draining its own queue in parallel, the waiting thread is
+         * released as soon as the last of them has been reclaimed, (or now if there are none).
+         */
+        connection->m_destroying = 1;
+        ret = mamaEnvConnection_checkDestroyComplete(connection);
     }
 
     /* Write a mama log. */
@@ -361,52 +629,51 @@ void MAMACALLTYPE mamaEnvConnection_onSessionCreate(mamaQueue queue, void* closu
     /* Cast the closure to a utility object. */
     CreationUtilityStructure* utility = (CreationUtilityStructure*)closure;
     if (utility != NULL) {
-        /* Complete creation of the session. */
-        utility->m_status = mamaEnvSession_create(utility->m_bridge, utility->m_session);
-
-        /* Signal the synchronization event. */
-        ret = mamaEnv_setEvent(utility->m_synch);
-    }
-
-    /* Write a mama log. */
-    mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - onSessionCreate completed with code %X.", ret);
-}
+        /* Complete creation of each session, stopping at the first failure. */
+        mama_u32_t created = 0;
+        while ((created < utility->m_numberSessions) && (utility->m_status == MAMA_STATUS_OK)) {
+            utility->m_status = mamaEnvSession_create(utility->m_bridge, utility->m_sessions[created]);
+            if (utility->m_status == MAMA_STATUS_OK) {
+                created++;
+            }
+        }
 
+        /* If any session failed then stop those already created, (the failed one has
+         * already destroyed itself), so that none are left dispatching.
+         */
+        if (utility->m_status != MAMA_STATUS_OK) {
+            for (mama_u32_t i = 0; i < created; i++) {
+                mamaEnvSession_destroy(utility->m_sessions[i]);
+            }
+        }
 
-//////////////////////////////////////////////////////////////////////////////
-mama_status mamaEnvConnection_onSessionDestroyListEnumerate(wList list, void* element, void* closure)
-{
-    /* Errors. */
-    mama_status ret = MAMA_STATUS_NULL_ARG;
+        /* Signal the synchronization event, the waiting thread does the rest. */
+        if (utility->m_synch != NULL) {
+            ret = mamaEnv_setEvent(utility->m_synch);
+        }
 
-    /* Get the session itself. */
-    mmeSession** session = (mmeSession**)element;
-    if (session != NULL) {
-        /* Check to see if the session can be destroyed. */
-        ret = mamaEnvSession_canDestroy(*session);
-        if (ret == MAMA_STATUS_OK) {
-            /* Remove the session from the destroyed list. */
-            ret = mamaEnvConnection_removeSessionFromList(list, *session);
+        /* For an asynchronous create add the session to the connection here, this is done
+         * on the object thread so it is ordered before any later connection destroy.
+         */
+        else {
+            mmeSession* session = utility->m_session;
+            ret = utility->m_status;
             if (ret == MAMA_STATUS_OK) {
-                /* Destroy the session. */
-                ret = mamaEnvSession_destroy(*session);
-                if (ret == MAMA_STATUS_OK) {
-                    /* Deallocate all associated memory. */
-                    ret = mamaEnvSession_deallocate(*session);
-                }
-                else {
-                    mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnvConnection_onSessionDestroyListEnumerate - mamaEnvSession_destroy(%p) failed with code %X.", *session, ret);
-                }
+                ret = mamaEnvConnection_addSessionToList(utility->m_connection->m_sessions, session);
+            }
+            if (ret != MAMA_STATUS_OK) {
+                mamaEnvSession_deallocate(session);
+                session = NULL;
             }
-        }
 
-        /* Return a success code in this case. */
-        else if (ret == MAMA_STATUS_QUEUE_OPEN_OBJECTS) {
-            ret = MAMA_STATUS_OK;
+            /* Tell the caller, then free the utility structure. */
+            (utility->m_callback)((mamaEnvSession)session, ret, utility->m_closure);
+            free(utility);
         }
     }
 
-    return ret;
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - onSessionCreate completed with code %X.", ret);
 }
 
 
@@ -422,8 +689,8 @@ mama_status mamaEnvConnection_onSessionListEnumerate(wList list, void* element,
     /* Get the session itself. */
     mmeSession** session = (mmeSession**)element;
     if (session != NULL) {
-        /* Destroy the session. */
-        ret = mamaEnv_destroySession(connection, *session);
+        /* Destroy the session, (including any in a group, which are detached from it). */
+        ret = mamaEnvConnection_destroySession(connection, *session);
     }
 
     return ret;
@@ -431,23 +698,74 @@ mama_status mamaEnvConnection_onSessionListEnumerate(wList list, void* element,
 
 
 //////////////////////////////////////////////////////////////////////////////
-void MAMACALLTYPE mamaEnvConnection_onSessionTimerTick(mamaTimer timer, void* closure)
+void MAMACALLTYPE mamaEnvConnection_onSessionReclaim(mamaQueue queue, void* closure)
 {
     /* Errors. */
     mama_status ret = MAMA_STATUS_NULL_ARG;
 
-    /* Cast the closure to the connection object. */
-    mmeConnection* connection = (mmeConnection*)closure;
-    if (connection != NULL) {
-        /* Enumerate all of the sessions in the destroy list. */
-        ret = mamaEnvConnection_enumerateList(connection->m_destroyedSessions, (mamaEnv_listCallback)mamaEnvConnection_onSessionDestroyListEnumerate, NULL);
-        if (ret != MAMA_STATUS_OK) {
-            mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnvConnection_onSessionTimerTick - mamaEnvConnection_onSessionDestroyListEnumerate failed with code %X.", ret);
+    /* Cast the closure to the session, every managed object has now been destroyed. */
+    mmeSession* session = (mmeSession*)closure;
+    if (session != NULL) {
+        /* Check that mama has released the queue too. */
+        ret = mamaEnvSession_canDestroy(session);
+        if (ret == MAMA_STATUS_OK) {
+            /* Remove the session from the destroyed list. */
+            mmeConnection* connection = session->m_connection;
+            ret = mamaEnvConnection_removeSessionFromList(connection->m_destroyedSessions, session);
+            if (ret == MAMA_STATUS_OK) {
+                /* Destroy the session. */
+                ret = mamaEnvSession_destroy(session);
+                if (ret == MAMA_STATUS_OK) {
+                    /* Deallocate all associated memory. */
+                    ret = mamaEnvSession_deallocate(session);
+                }
+                else {
+                    mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnvConnection_onSessionReclaim - mamaEnvSession_destroy(%p) failed with code %X.", session, ret);
+                }
+
+                /* If this was the last session of a connection being destroyed then finish. */
+                mama_status mcd = mamaEnvConnection_checkDestroyComplete(connection);
+                if (ret == MAMA_STATUS_OK) {
+                    ret = mcd;
+                }
+            }
+        }
+
+        /* Mama may still be completing destroys on the session queue, so try again after a
+         * delay that doubles each time rather than spinning between the two queues.
+         */
+        else if (ret == MAMA_STATUS_QUEUE_OPEN_OBJECTS) {
+            if (session->m_reclaimDelay < MEVC_RECLAIM_RETRY_MIN) {
+                session->m_reclaimDelay = MEVC_RECLAIM_RETRY_MIN;
+            }
+            else if (session->m_reclaimDelay < MEVC_RECLAIM_RETRY_MAX) {
+                session->m_reclaimDelay *= 2;
+            }
+
+            ret = mamaTimer_create(&session->m_reclaimTimer, session->m_connection->m_objectQueue, (mamaTimerCb)mamaEnvConnection_onSessionReclaimRetry, session->m_reclaimDelay, (void*)session);
+            if (ret == MAMA_STATUS_OK) {
+                mama_log(MAMA_LOG_LEVEL_FINEST, "MamaEnv - onSessionReclaim with session %p will retry in %f seconds.", session, session->m_reclaimDelay);
+                return;
+            }
+            session->m_reclaimTimer = NULL;
         }
     }
 
     /* Write a mama log. */
-    mama_log(MAMA_LOG_LEVEL_FINEST, "MamaEnv - onSessionTimerTick with connection %p completed with code %X.", connection, ret);
+    mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - onSessionReclaim with session %p completed with code %X.", session, ret);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvConnection_onSessionReclaimRetry(mamaTimer timer, void* closure)
+{
+    /* Cast the closure to the session. */
+    mmeSession* session = (mmeSession*)closure;
+
+    /* The timer only fires once, this is on the object thread so the session can be reclaimed here. */
+    mamaTimer_destroy(timer);
+    session->m_reclaimTimer = NULL;
+    mamaEnvConnection_onSessionReclaim(session->m_connection->m_objectQueue, closure);
 }
 
 
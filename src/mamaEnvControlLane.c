@@ -0,0 +1,103 @@
+#include "mama/mamaEnvControlLane.h"
+#include "mama/mamaEnvEvent.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvControlLane_init(mmeControlLane* lane)
+{
+    pthread_mutex_init(&lane->m_lock, NULL);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvControlLane_destroy(mmeControlLane* lane)
+{
+    pthread_mutex_destroy(&lane->m_lock);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+int mamaEnvControlLane_push(mmeControlLane* lane, mmeControlEvent* event, mamaQueueEventCB callback, void* closure)
+{
+    event->m_callback = callback;
+    event->m_closure = closure;
+    event->m_enqueued = mamaEnv_getMonotonicTime();
+    event->m_next = NULL;
+
+    /* Append the event, the caller must wake the dispatch thread if the lane was empty. */
+    pthread_mutex_lock(&lane->m_lock);
+    int wasEmpty = (lane->m_head == NULL) ? 1 : 0;
+    if (lane->m_tail != NULL) {
+        lane->m_tail->m_next = event;
+    }
+    else {
+        lane->m_head = event;
+    }
+    lane->m_tail = event;
+    __atomic_store_n(&lane->m_pending, lane->m_pending + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lane->m_lock);
+
+    return wasEmpty;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+int mamaEnvControlLane_drain(mmeControlLane* lane, mamaQueue queue, void* skip)
+{
+    /* Take every waiting event so that they run without the lock held. */
+    pthread_mutex_lock(&lane->m_lock);
+    mmeControlEvent* event = lane->m_head;
+    lane->m_head = NULL;
+    lane->m_tail = NULL;
+    __atomic_store_n(&lane->m_pending, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lane->m_lock);
+
+    /* Run the events in order, keeping any whose closure is skip. */
+    mmeControlEvent* keptHead = NULL;
+    mmeControlEvent* keptTail = NULL;
+    int kept = 0;
+    while (event != NULL) {
+        /* The event lives in the object it destroys, so read the link first. */
+        mmeControlEvent* next = event->m_next;
+        if ((skip != NULL) && (event->m_closure == skip)) {
+            event->m_next = NULL;
+            if (keptTail != NULL) {
+                keptTail->m_next = event;
+            }
+            else {
+                keptHead = event;
+            }
+            keptTail = event;
+            kept++;
+        }
+        else {
+            mama_u64_t delay = mamaEnv_getMonotonicTime() - event->m_enqueued;
+            __atomic_store_n(&lane->m_events, lane->m_events + 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&lane->m_totalDelay, lane->m_totalDelay + delay, __ATOMIC_RELAXED);
+            if (delay > lane->m_maxDelay) {
+                __atomic_store_n(&lane->m_maxDelay, delay, __ATOMIC_RELAXED);
+            }
+
+            (event->m_callback)(queue, event->m_closure);
+        }
+        event = next;
+    }
+
+    /* Put the kept events back ahead of anything added meanwhile, the caller must wake the
+     * dispatch thread if the lane was empty.
+     */
+    int wasEmpty = 0;
+    if (keptHead != NULL) {
+        pthread_mutex_lock(&lane->m_lock);
+        wasEmpty = (lane->m_head == NULL) ? 1 : 0;
+        keptTail->m_next = lane->m_head;
+        lane->m_head = keptHead;
+        if (lane->m_tail == NULL) {
+            lane->m_tail = keptTail;
+        }
+        __atomic_store_n(&lane->m_pending, lane->m_pending + kept, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&lane->m_lock);
+    }
+
+    return wasEmpty;
+}
@@ -2,6 +2,7 @@
 /* Includes. */
 /* ********************************************************** */
 #include "mama/mamaEnvEvent.h"
+#include <math.h>
 #include <pthread.h>
 
 /* ********************************************************** */
@@ -126,6 +127,17 @@ mama_status mamaEnv_waitEvent(MamaEvent* synchEvent)
     return ret;
 }
 
+mama_u64_t mamaEnv_getMonotonicTime(void)
+{
+    /* Convert the performance counter ticks to nanoseconds. */
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (mama_u64_t)((counter.QuadPart / frequency.QuadPart) * 1000000000ULL + ((counter.QuadPart % frequency.QuadPart) * 1000000000ULL) / frequency.QuadPart);
+}
+
 /* ********************************************************** */
 /* GCC Implementation. */
 /* ********************************************************** */
@@ -346,4 +358,22 @@ mama_status mamaEnv_waitEvent(MamaEvent* synchEvent)
     return ret;
 }
 
+mama_u64_t mamaEnv_getMonotonicTime(void)
+{
+    struct timespec timeSpec;
+    clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+
+    return ((mama_u64_t)timeSpec.tv_sec * 1000000000ULL) + (mama_u64_t)timeSpec.tv_nsec;
+}
+
 #endif
+
+/* ********************************************************** */
+/* Common Implementation. */
+/* ********************************************************** */
+
+int mamaEnv_isValidInterval(mama_f64_t seconds)
+{
+    /* Intervals are held in nanoseconds, so the number of seconds must be one that fits. */
+    return isfinite(seconds) && (seconds >= 0) && ((seconds * 1000000000.0) < 18446744073709551616.0);
+}
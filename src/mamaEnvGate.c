@@ -0,0 +1,58 @@
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mamaEnvGatePrivate.h"
+#include <sched.h>
+#include <time.h>
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* The number of times the state is polled before yielding the processor. */
+#define MMEG_SPIN_COUNT 100
+
+/* The number of times the processor is yielded before sleeping between polls. */
+#define MMEG_YIELD_COUNT 1000
+
+/* The time slept between polls once a callback has been running for a while. */
+#define MMEG_SLEEP_NANOSECONDS 100000
+
+/* ********************************************************** */
+/* Globals. */
+/* ********************************************************** */
+
+__thread mmeGate* g_mamaEnvCurrentGate = NULL;
+
+/* ********************************************************** */
+/* Public Functions. */
+/* ********************************************************** */
+
+void mamaEnvGate_close(mmeGate* gate, int closedBits)
+{
+    /* Any callback entering after this will see the bits and back out. */
+    __atomic_fetch_or(&gate->m_state, closedBits, __ATOMIC_SEQ_CST);
+}
+
+void mamaEnvGate_wait(mmeGate* gate)
+{
+    /* Don't wait on a callback running on this thread, it is our caller. */
+    int self = (g_mamaEnvCurrentGate == gate) ? 1 : 0;
+
+    /* Callbacks are normally short, so spin briefly before backing off. */
+    long polls = 0;
+    while ((__atomic_load_n(&gate->m_state, __ATOMIC_ACQUIRE) & MMEG_COUNT_MASK) > self) {
+        polls++;
+        if (polls < MMEG_SPIN_COUNT) {
+            continue;
+        }
+
+        if (polls < MMEG_SPIN_COUNT + MMEG_YIELD_COUNT) {
+            sched_yield();
+        }
+        else {
+            struct timespec pause = { 0, MMEG_SLEEP_NANOSECONDS };
+            nanosleep(&pause, NULL);
+        }
+    }
+}
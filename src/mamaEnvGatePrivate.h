@@ -0,0 +1,48 @@
+#ifndef MAMAENVGATEPRIVATE_H
+#define MAMAENVGATEPRIVATE_H
+
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mama/mamaEnvGate.h"
+
+
+/* ********************************************************** */
+/* Globals. */
+/* ********************************************************** */
+
+/* The gate, if any, whose callback is running on the current thread. This lets a
+ * callback shut down or destroy its own object without waiting on itself.
+ */
+extern __thread mmeGate* g_mamaEnvCurrentGate;
+
+
+/* ********************************************************** */
+/* Functions. */
+/* ********************************************************** */
+
+/* Returns non-zero if the callback may be invoked, in which case mamaEnvGate_exit must
+ * be called once it returns. The closedMask gives the closed bits that stop this callback.
+ */
+MAMAENVFORCEINLINE int mamaEnvGate_enter(mmeGate* gate, int closedMask, mmeGate** previous)
+{
+    int state = __atomic_load_n(&gate->m_state, __ATOMIC_RELAXED);
+    do {
+        if ((state & closedMask) != 0) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&gate->m_state, &state, state + 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    *previous = g_mamaEnvCurrentGate;
+    g_mamaEnvCurrentGate = gate;
+
+    return 1;
+}
+
+MAMAENVFORCEINLINE void mamaEnvGate_exit(mmeGate* gate, mmeGate* previous)
+{
+    g_mamaEnvCurrentGate = previous;
+    __atomic_fetch_sub(&gate->m_state, 1, __ATOMIC_RELEASE);
+}
+
+#endif
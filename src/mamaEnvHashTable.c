@@ -0,0 +1,86 @@
+#include "mama/mamaEnvHashTable.h"
+#include <stdlib.h>
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvHashTable_init(mmeHashTable* table, size_t initialBuckets)
+{
+    table->m_buckets = NULL;
+    table->m_numberBuckets = 0;
+    table->m_numberNodes = 0;
+    table->m_initialBuckets = initialBuckets;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvHashTable_destroy(mmeHashTable* table, mamaEnvHashTable_freeNode freeNode)
+{
+    /* Free whatever is left in the table, if the owner has anything to free. */
+    if (freeNode != NULL) {
+        for (size_t i = 0; i < table->m_numberBuckets; i++) {
+            mmeHashNode* next = table->m_buckets[i];
+            while (next != NULL) {
+                mmeHashNode* node = next;
+                next = next->m_next;
+                freeNode(node);
+            }
+        }
+    }
+
+    free(table->m_buckets);
+    table->m_buckets = NULL;
+    table->m_numberBuckets = 0;
+    table->m_numberNodes = 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvHashTable_add(mmeHashTable* table, mmeHashNode* node)
+{
+    /* Grow the table, (rehashing everything), once it holds more nodes than buckets. */
+    if ((table->m_buckets == NULL) || (table->m_numberNodes >= table->m_numberBuckets)) {
+        size_t numberBuckets = (table->m_buckets == NULL) ? table->m_initialBuckets : (table->m_numberBuckets * 2);
+        mmeHashNode** buckets = (mmeHashNode**)calloc(numberBuckets, sizeof(mmeHashNode*));
+        if (buckets == NULL) {
+            return MAMA_STATUS_NOMEM;
+        }
+        for (size_t i = 0; i < table->m_numberBuckets; i++) {
+            mmeHashNode* next = table->m_buckets[i];
+            while (next != NULL) {
+                mmeHashNode* moved = next;
+                next = next->m_next;
+                moved->m_next = buckets[moved->m_hash & (numberBuckets - 1)];
+                buckets[moved->m_hash & (numberBuckets - 1)] = moved;
+            }
+        }
+        free(table->m_buckets);
+        table->m_buckets = buckets;
+        table->m_numberBuckets = numberBuckets;
+    }
+
+    size_t bucket = node->m_hash & (table->m_numberBuckets - 1);
+    node->m_next = table->m_buckets[bucket];
+    table->m_buckets[bucket] = node;
+    table->m_numberNodes++;
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvHashTable_remove(mmeHashTable* table, mmeHashNode* node)
+{
+    if (table->m_buckets == NULL) {
+        return;
+    }
+
+    mmeHashNode** link = &table->m_buckets[node->m_hash & (table->m_numberBuckets - 1)];
+    while (*link != NULL) {
+        if (*link == node) {
+            *link = node->m_next;
+            table->m_numberNodes--;
+            break;
+        }
+        link = &(*link)->m_next;
+    }
+}
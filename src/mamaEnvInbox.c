@@ -1,4 +1,11 @@
 #include "mama/mamaEnvInbox.h"
+#include "mama/mamaEnvSession.h"
+#include "mama/mamaEnvPool.h"
+#include "mamaEnvGatePrivate.h"
+#include <stddef.h>
+
+/* Everything a message reads must stay in the first cache line. */
+_Static_assert(offsetof(mmeInbox, m_session) + sizeof(struct mmeSession*) <= MAMAENV_CACHE_LINE_SIZE, "the fields read on every message must be in the first cache line");
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -7,27 +14,16 @@ mama_status mamaEnvInbox_allocate(void* closure, mamaInboxErrorCallback errorCal
     /* Returns. */
     mama_status ret = MAMA_STATUS_NOMEM;
 
-    /* Allocate a new inbox object. */
-    mmeInbox* envInbox = (mmeInbox*)calloc(1, sizeof(mmeInbox));
+    /* Allocate a new inbox object, note that the gate starts open. */
+    mmeInbox* envInbox = (mmeInbox*)mamaEnvPool_allocate(mamaEnvInboxObject);
     if (envInbox != NULL) {
-        /* Create the lock object. */
-        ret = MAMA_STATUS_PLATFORM;
-        envInbox->m_lock = wlock_create();
-        if (envInbox->m_lock != NULL) {
-            /* Save arguments in member variables. */
-            envInbox->m_closure = closure;
-            envInbox->m_errorCallback = errorCallback;
-            envInbox->m_msgCallback = msgCallback;
-
-            /* Success. */
-            ret = MAMA_STATUS_OK;
-        }
+        /* Save arguments in member variables. */
+        envInbox->m_closure = closure;
+        envInbox->m_errorCallback = errorCallback;
+        envInbox->m_msgCallback = msgCallback;
 
-        /* If something went wrong then destroy the timer. */
-        if (ret != MAMA_STATUS_OK) {
-            mamaEnvInbox_destroy(envInbox);
-            envInbox = NULL;
-        }
+        /* Success. */
+        ret = MAMA_STATUS_OK;
     }
 
     /* Write back data. */
@@ -49,18 +45,8 @@ mama_status mamaEnvInbox_destroy(mmeInbox* inbox)
             inbox->m_inbox = NULL;
         }
 
-        /* Destroy the lock. */
-        if (inbox->m_lock != NULL) {
-            wlock_unlock(inbox->m_lock);
-            int rc = wlock_destroy(inbox->m_lock);
-            if (rc != 0) {
-                mama_log(MAMA_LOG_LEVEL_SEVERE, "mamaEnvInbox_destroy -- got non-zero rc=%d destoying m_lock", rc);
-            }
-            inbox->m_lock = NULL;
-        }
-
-        /* Free the inbox object. */
-        free(inbox);
+        /* Return the inbox object to the pool. */
+        mamaEnvPool_free(mamaEnvInboxObject, inbox);
     }
 
     return ret;
@@ -73,16 +59,17 @@ void MAMACALLTYPE mamaEnvInbox_onErrorCallback(mama_status status, void* closure
     /* Cast the closure to the inbox object. */
     mmeInbox* envInbox = (mmeInbox*)closure;
     if (envInbox != NULL) {
-        /* Lock the inbox. */
-        wlock_lock(envInbox->m_lock);
+        /* Enter the gate, this fails once the inbox has been destroyed. */
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envInbox->m_gate, MMEG_CLOSED_ALL, &previous)) {
+            /* Invoke the original callback function. */
+            if (envInbox->m_errorCallback != NULL) {
+                (envInbox->m_errorCallback)(status, envInbox->m_closure);
+            }
 
-        /* Invoke the original callback function. */
-        if (envInbox->m_errorCallback != NULL) {
-            (envInbox->m_errorCallback)(status, envInbox->m_closure);
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envInbox->m_gate, previous);
         }
-
-        /* Unlock the inbox. */
-        wlock_unlock(envInbox->m_lock);
     }
 }
 
@@ -93,16 +80,26 @@ void MAMACALLTYPE mamaEnvInbox_onInboxDestroy(mamaQueue queue, void* closure)
     /* Returns. */
     mama_status ret = MAMA_STATUS_NULL_ARG;
 
-    /* Cast the closure to an inbox object. */
+    /* Cast the closure to a inbox object. */
     mmeInbox* inbox = (mmeInbox*)closure;
     if (inbox != NULL) {
-        /* Acquire the lock in case anything else is using the timer at the moment. */
-        wlock_lock(inbox->m_lock);
-
-        /* Destroy it. */
-        ret = mamaEnvInbox_destroy(inbox);
+        /* Destroy the mama inbox, the gate was closed before this event was enqueued so no
+         * callback can be running.
+         */
+        ret = MAMA_STATUS_OK;
+        if (inbox->m_inbox != NULL) {
+            ret = mamaInbox_destroy(inbox->m_inbox);
+            inbox->m_inbox = NULL;
+        }
 
-        /* Note that we do not release the lock as it has now been destroyed. */
+        /* This may have run on the control lane ahead of events already on the session queue,
+         * which still refer to the object, so it is freed by an event behind them.
+         */
+        mama_status eret = mamaQueue_enqueueEvent(queue, (mamaQueueEventCB)mamaEnvInbox_onInboxFree, (void*)inbox);
+        if (eret != MAMA_STATUS_OK) {
+            mama_log(MAMA_LOG_LEVEL_ERROR, "MamaEnv - onInboxDestroy with inbox %p failed to enqueue free with code %X.", inbox, eret);   // NOLINT
+            mamaEnvInbox_onInboxFree(queue, (void*)inbox);
+        }
     }
 
     /* Write a mama log. */
@@ -110,22 +107,43 @@ void MAMACALLTYPE mamaEnvInbox_onInboxDestroy(mamaQueue queue, void* closure)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvInbox_onInboxFree(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to a inbox object, the mama inbox has already been destroyed. */
+    mmeInbox* inbox = (mmeInbox*)closure;
+    struct mmeSession* session = inbox->m_session;
+    mamaEnvInbox_destroy(inbox);
+
+    /* Drop the reference this object held on its session. */
+    if (session != NULL) {
+        mamaEnvSession_release(session);
+    }
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 void MAMACALLTYPE mamaEnvInbox_onMessageCallback(mamaMsg msg, void* closure)
 {
     /* Cast the closure to the inbox object. */
     mmeInbox* envInbox = (mmeInbox*)closure;
     if (envInbox != NULL) {
-        /* Lock the inbox. */
-        wlock_lock(envInbox->m_lock);
+        /* Enter the gate, this fails once the inbox has been shut down or destroyed. */
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envInbox->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            /* Invoke the original callback function. */
+            if (envInbox->m_msgCallback != NULL) {
+                (envInbox->m_msgCallback)(msg, envInbox->m_closure);
+            }
 
-        /* Invoke the original callback function. */
-        if (envInbox->m_msgCallback != NULL) {
-            (envInbox->m_msgCallback)(msg, envInbox->m_closure);
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envInbox->m_gate, previous);
         }
 
-        /* Unlock the inbox. */
-        wlock_unlock(envInbox->m_lock);
+        /* Complete any waiting destroys and keep the queue depth gauge up to date. */
+        if (envInbox->m_session != NULL) {
+            mamaEnvSession_afterCallback(envInbox->m_session, envInbox);
+        }
     }
 }
 
@@ -133,10 +151,9 @@ void MAMACALLTYPE mamaEnvInbox_onMessageCallback(mamaMsg msg, void* closure)
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnvInbox_shutdown(mmeInbox* inbox)
 {
-    wlock_lock(inbox->m_lock);
-    inbox->m_msgCallback = NULL;
-    wlock_unlock(inbox->m_lock);
+    /* Stop further messages and wait for any running callback to return. */
+    mamaEnvGate_close(&inbox->m_gate, MMEG_CLOSED_MSG);
+    mamaEnvGate_wait(&inbox->m_gate);
 
     return MAMA_STATUS_OK;
 }
-
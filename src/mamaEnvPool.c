@@ -0,0 +1,277 @@
+/* ********************************************************** */
+/* Includes. */
+/* ********************************************************** */
+#include "mama/mamaEnvPool.h"
+#include "mama/mamaEnvInbox.h"
+#include "mama/mamaEnvSubscription.h"
+#include "mama/mamaEnvTimer.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* Rounds an object size up to a whole number of cache lines. */
+#define MMEP_STRIDE(size) ((((size) + MMEP_ALIGNMENT - 1) / MMEP_ALIGNMENT) * MMEP_ALIGNMENT)
+
+/* The number of objects moved between a thread's cache and the shared free list in one go,
+ * this leaves the cache half full so that alternating allocates and frees don't thrash.
+ */
+#define MMEP_TRANSFER_SIZE (MMEP_MAGAZINE_SIZE / 2)
+
+/* ********************************************************** */
+/* Types. */
+/* ********************************************************** */
+
+/* The shared part of a pool, only touched when a thread's cache is empty or full. */
+typedef struct mmePool
+{
+    /* Protects the free list and the slab list. */
+    pthread_mutex_t m_lock;
+
+    /* Free objects linked through their first word. */
+    void* m_free;
+
+    /* Slabs linked through their first word, objects start one cache line in. */
+    void* m_slabs;
+
+    /* The size of each object including padding. */
+    size_t m_stride;
+
+    /* Statistics, written under the lock and read atomically. */
+    mama_u64_t m_numberSlabs;
+    mama_u64_t m_allocations;
+    mama_u64_t m_frees;
+    mama_u64_t m_refills;
+    mama_u64_t m_returns;
+
+} mmePool;
+
+/* The per-thread cache of free objects for one pool. */
+typedef struct mmeMagazine
+{
+    /* The cached objects. */
+    void* m_objects[MMEP_MAGAZINE_SIZE];
+
+    /* The number of cached objects. */
+    int m_count;
+
+    /* Allocations and frees made on this thread that haven't been added to the pool totals. */
+    mama_u64_t m_allocations;
+    mama_u64_t m_frees;
+
+} mmeMagazine;
+
+/* ********************************************************** */
+/* Globals. */
+/* ********************************************************** */
+
+static mmePool sg_pools[mamaEnvNumberObjectTypes] =
+{
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, MMEP_STRIDE(sizeof(mmeSubscription)), 0, 0, 0, 0, 0 },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, MMEP_STRIDE(sizeof(mmeTimer)), 0, 0, 0, 0, 0 },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, MMEP_STRIDE(sizeof(mmeInbox)), 0, 0, 0, 0, 0 }
+};
+
+#ifndef MAMAENV_NO_POOL
+/* This thread's caches, one for each pool. */
+static __thread mmeMagazine sg_magazines[mamaEnvNumberObjectTypes];
+
+/* Set once this thread has registered to have its caches emptied when it exits. */
+static __thread int sg_registered = 0;
+
+/* The key used to empty a thread's caches when it exits. */
+static pthread_key_t sg_threadKey;
+static pthread_once_t sg_threadKeyOnce = PTHREAD_ONCE_INIT;
+
+/* ********************************************************** */
+/* Private Functions. */
+/* ********************************************************** */
+
+/* Moves objects from the magazine to the free list and adds the thread's counts to the totals, the
+ * pool lock must be held.
+ */
+static void mamaEnvPool_returnObjects(mmePool* pool, mmeMagazine* magazine, int number)
+{
+    for (int i = 0; i < number; i++) {
+        void* object = magazine->m_objects[--magazine->m_count];
+        *(void**)object = pool->m_free;
+        pool->m_free = object;
+    }
+
+    __atomic_store_n(&pool->m_allocations, pool->m_allocations + magazine->m_allocations, __ATOMIC_RELAXED);
+    __atomic_store_n(&pool->m_frees, pool->m_frees + magazine->m_frees, __ATOMIC_RELAXED);
+    magazine->m_allocations = 0;
+    magazine->m_frees = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvPool_onThreadExit(void* closure)
+{
+    /* Give this thread's cached objects back so other threads can use them. */
+    mmeMagazine* magazines = (mmeMagazine*)closure;
+    for (int type = 0; type < mamaEnvNumberObjectTypes; type++) {
+        mmePool* pool = &sg_pools[type];
+        pthread_mutex_lock(&pool->m_lock);
+        mamaEnvPool_returnObjects(pool, &magazines[type], magazines[type].m_count);
+        pthread_mutex_unlock(&pool->m_lock);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvPool_createThreadKey(void)
+{
+    pthread_key_create(&sg_threadKey, mamaEnvPool_onThreadExit);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvPool_registerThread(void)
+{
+    pthread_once(&sg_threadKeyOnce, mamaEnvPool_createThreadKey);
+    pthread_setspecific(sg_threadKey, sg_magazines);
+    sg_registered = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static int mamaEnvPool_refill(mmePool* pool, mmeMagazine* magazine)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&pool->m_lock);
+
+    /* Carve a new slab if there are no free objects, the first cache line holds the slab link. */
+    if (pool->m_free == NULL) {
+        void* slab = NULL;
+        if (posix_memalign(&slab, MMEP_ALIGNMENT, MMEP_ALIGNMENT + (pool->m_stride * MMEP_SLAB_OBJECTS)) == 0) {
+            *(void**)slab = pool->m_slabs;
+            pool->m_slabs = slab;
+            __atomic_store_n(&pool->m_numberSlabs, pool->m_numberSlabs + 1, __ATOMIC_RELAXED);
+
+            /* Link in reverse so that objects are handed out in address order. */
+            char* objects = (char*)slab + MMEP_ALIGNMENT;
+            for (int i = MMEP_SLAB_OBJECTS - 1; i >= 0; i--) {
+                void* object = objects + (pool->m_stride * i);
+                *(void**)object = pool->m_free;
+                pool->m_free = object;
+            }
+        }
+    }
+
+    /* Move a batch of objects into the magazine. */
+    while ((pool->m_free != NULL) && (ret < MMEP_TRANSFER_SIZE)) {
+        void* object = pool->m_free;
+        pool->m_free = *(void**)object;
+        magazine->m_objects[magazine->m_count++] = object;
+        ret++;
+    }
+
+    if (ret > 0) {
+        __atomic_store_n(&pool->m_refills, pool->m_refills + 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&pool->m_lock);
+
+    return ret;
+}
+#endif
+
+/* ********************************************************** */
+/* Public Functions. */
+/* ********************************************************** */
+
+void* mamaEnvPool_allocate(mamaEnvObjectType type)
+{
+#ifdef MAMAENV_NO_POOL
+    /* The objects are declared cache line aligned, which calloc does not guarantee. */
+    void* ret = NULL;
+    if (posix_memalign(&ret, MMEP_ALIGNMENT, sg_pools[type].m_stride) != 0) {
+        return NULL;
+    }
+    memset(ret, 0, sg_pools[type].m_stride);
+    return ret;
+#else
+    mmePool* pool = &sg_pools[type];
+    mmeMagazine* magazine = &sg_magazines[type];
+
+    if (sg_registered == 0) {
+        mamaEnvPool_registerThread();
+    }
+
+    /* Only go to the shared free list when this thread has nothing cached. */
+    if ((magazine->m_count == 0) && (mamaEnvPool_refill(pool, magazine) == 0)) {
+        return NULL;
+    }
+
+    void* ret = magazine->m_objects[--magazine->m_count];
+    magazine->m_allocations++;
+
+    /* Callers expect the same zeroed memory calloc would give them. */
+    memset(ret, 0, pool->m_stride);
+
+    return ret;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvPool_free(mamaEnvObjectType type, void* object)
+{
+#ifdef MAMAENV_NO_POOL
+    free(object);
+#else
+    if (object == NULL) {
+        return;
+    }
+
+    mmeMagazine* magazine = &sg_magazines[type];
+
+    if (sg_registered == 0) {
+        mamaEnvPool_registerThread();
+    }
+
+    /* Objects are usually freed on the dispatch thread rather than the thread that allocated them,
+     * so a full magazine hands half its objects back to the shared free list for other threads.
+     */
+    if (magazine->m_count == MMEP_MAGAZINE_SIZE) {
+        mmePool* pool = &sg_pools[type];
+        pthread_mutex_lock(&pool->m_lock);
+        mamaEnvPool_returnObjects(pool, magazine, MMEP_TRANSFER_SIZE);
+        __atomic_store_n(&pool->m_returns, pool->m_returns + 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&pool->m_lock);
+    }
+
+    magazine->m_objects[magazine->m_count++] = object;
+    magazine->m_frees++;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_getAllocatorStats(mamaEnvObjectType type, mamaEnvAllocatorStats* stats)
+{
+    if (stats == NULL) {
+        return MAMA_STATUS_NULL_ARG;
+    }
+    if ((type < 0) || (type >= mamaEnvNumberObjectTypes)) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    mmePool* pool = &sg_pools[type];
+
+    stats->m_objectSize = pool->m_stride;
+    stats->m_slabs = __atomic_load_n(&pool->m_numberSlabs, __ATOMIC_RELAXED);
+    stats->m_bytesReserved = stats->m_slabs * (MMEP_ALIGNMENT + (pool->m_stride * MMEP_SLAB_OBJECTS));
+    stats->m_refills = __atomic_load_n(&pool->m_refills, __ATOMIC_RELAXED);
+    stats->m_returns = __atomic_load_n(&pool->m_returns, __ATOMIC_RELAXED);
+
+    stats->m_allocations = __atomic_load_n(&pool->m_allocations, __ATOMIC_RELAXED);
+    stats->m_frees = __atomic_load_n(&pool->m_frees, __ATOMIC_RELAXED);
+
+#ifndef MAMAENV_NO_POOL
+    /* Include the calling thread's own counts, other threads' are added as their caches turn over. */
+    stats->m_allocations += sg_magazines[type].m_allocations;
+    stats->m_frees += sg_magazines[type].m_frees;
+#endif
+
+    return MAMA_STATUS_OK;
+}
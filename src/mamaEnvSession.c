@@ -1,4 +1,22 @@
+/* Needed for the Linux thread placement functions. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "mama/mamaEnvSession.h"
+#include "mama/mamaEnvConnection.h"
+#include "mama/mamaEnvEvent.h"
+#include <ctype.h>
+#include <errno.h>
+#include <sched.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* The MPOL_PREFERRED memory policy, defined here to avoid depending on the numa headers. */
+#define MMES_MPOL_PREFERRED 1
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -18,7 +36,136 @@ mama_status mamaEnv_createBasicSubscription(const mamaMsgCallbacks* callback, vo
         localCallback.m_onMsgBasic = callback->onMsg;
 
         /* Create the subscription. */
-        ret = mamaEnvSession_createSubscription(&localCallback, closure, envSession, NULL, symbol, transport, Basic, subscription);
+        ret = mamaEnvSession_createSubscription(&localCallback, closure, envSession, NULL, symbol, transport, Basic, NULL, subscription);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createBasicSubscriptions(const mamaMsgCallbacks* callback, void** closures, mamaEnvSession session, const char** symbols, mama_u32_t count, mamaTransport transport, mamaSubscription* subscriptions, mama_status* statuses)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((callback != NULL) && (session != NULL) && (symbols != NULL) && (transport != NULL) && (subscriptions != NULL) && (statuses != NULL)) {
+        /* Cast the session. */
+        mmeSession* envSession = (mmeSession*)session;
+
+        /* Format a callback structure to hold all the function pointers. */
+        mmeSubscriptionCallback localCallback;
+        memset(&localCallback, 0, sizeof(mmeSubscriptionCallback));
+        localCallback.m_onCreate = callback->onCreate;
+        localCallback.m_onError = callback->onError;
+        localCallback.m_onMsgBasic = callback->onMsg;
+
+        /* Create the subscriptions. */
+        ret = mamaEnvSession_createSubscriptions(&localCallback, closures, envSession, symbols, count, transport, Basic, subscriptions, statuses);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createBatchSubscription(const mamaEnvBatchMsgCallbacks* callback, void* closure, mamaEnvSession session, const char* symbol, mamaTransport transport, mama_u32_t maxBatchSize, mama_f64_t maxBatchDelay, mamaSubscription* subscription)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((callback != NULL) && (session != NULL) && (symbol != NULL) && (transport != NULL) && (subscription != NULL)) {
+        /* A batch must be able to hold at least one message, and the delay is held in nanoseconds. */
+        ret = MAMA_STATUS_INVALID_ARG;
+        if ((maxBatchSize > 0) && mamaEnv_isValidInterval(maxBatchDelay)) {
+            /* Cast the session. */
+            mmeSession* envSession = (mmeSession*)session;
+
+            /* Format a callback structure to hold all the function pointers. */
+            mmeSubscriptionCallback localCallback;
+            memset(&localCallback, 0, sizeof(mmeSubscriptionCallback));
+            localCallback.m_onCreate = callback->onCreate;
+            localCallback.m_onError = callback->onError;
+            localCallback.m_onMsgBatch = callback->onBatch;
+
+            /* Save the batch limits. */
+            mmeSubscriptionOptions options;
+            memset(&options, 0, sizeof(mmeSubscriptionOptions));
+            options.m_maxBatchSize = maxBatchSize;
+            options.m_maxBatchDelay = maxBatchDelay;
+
+            /* Create the subscription. */
+            ret = mamaEnvSession_createSubscription(&localCallback, closure, envSession, NULL, symbol, transport, Batch, &options, subscription);
+        }
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createConflatedSubscription(const mamaMsgCallbacks* callback, void* closure, mamaEnvSession session, const char* symbol, mamaTransport transport, mama_f64_t interval, mamaSubscription* subscription)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((callback != NULL) && (session != NULL) && (symbol != NULL) && (transport != NULL) && (subscription != NULL)) {
+        /* The interval is held in nanoseconds, and also used as the conflation timer's interval. */
+        ret = MAMA_STATUS_INVALID_ARG;
+        if (mamaEnv_isValidInterval(interval)) {
+            /* Cast the session. */
+            mmeSession* envSession = (mmeSession*)session;
+
+            /* Format a callback structure to hold all the function pointers. */
+            mmeSubscriptionCallback localCallback;
+            memset(&localCallback, 0, sizeof(mmeSubscriptionCallback));
+            localCallback.m_onCreate = callback->onCreate;
+            localCallback.m_onError = callback->onError;
+            localCallback.m_onMsgBasic = callback->onMsg;
+
+            /* Save the conflation interval. */
+            mmeSubscriptionOptions options;
+            memset(&options, 0, sizeof(mmeSubscriptionOptions));
+            options.m_conflationInterval = interval;
+
+            /* Create the subscription. */
+            ret = mamaEnvSession_createSubscription(&localCallback, closure, envSession, NULL, symbol, transport, Conflated, &options, subscription);
+        }
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mama_status mamaEnv_getConflationStatsCallback(void* data, void* closure)
+{
+    mmeSubscription* envSubscription = (mmeSubscription*)data;
+    mamaEnvConflationStats* stats = (mamaEnvConflationStats*)closure;
+    mmeSubscriptionConflation* conflation = envSubscription->m_conflation;
+    if (conflation == NULL) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    /* The counters are only written by the dispatch thread. */
+    stats->m_received = __atomic_load_n(&conflation->m_received, __ATOMIC_RELAXED);
+    stats->m_delivered = __atomic_load_n(&conflation->m_delivered, __ATOMIC_RELAXED);
+    stats->m_conflated = __atomic_load_n(&conflation->m_conflated, __ATOMIC_RELAXED);
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_getConflationStats(mamaEnvSession session, mamaSubscription subscription, mamaEnvConflationStats* stats)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (subscription != NULL) && (stats != NULL)) {
+        /* Cast the session. */
+        mmeSession* envSession = (mmeSession*)session;
+
+        /* Read the counters under the map's lock, so that the subscription can't be destroyed
+         * while they are read.
+         */
+        ret = synchronizedMap_for(mamaEnv_getConflationStatsCallback, (void*)subscription, envSession->m_subscriptions, (void*)stats);
     }
 
     return ret;
@@ -52,12 +199,21 @@ mama_status mamaEnv_createInbox(void* closure, mamaInboxErrorCallback errorCallb
                 (mamaInboxErrorCallback)mamaEnvInbox_onErrorCallback,
                 (void*)inbox);
             if (ret == MAMA_STATUS_OK) {
+                /* The inbox holds a reference on the session until it is destroyed, this must
+                 * be taken before it is added to the map where another thread could destroy it.
+                 */
+                inbox->m_session = envSession;
+                mamaEnvSession_acquire(envSession);
+
                 /* Add the inbox to the map. */
                 ret = synchronizedMap_insert((void*)inbox, (void*)inbox->m_inbox, envSession->m_inboxes);
                 if (ret == MAMA_STATUS_OK) {
                     /* Extract the mama inbox from the inbox object. */
                     localMamaInbox = inbox->m_inbox;
                 }
+                else {
+                    mamaEnvSession_release(envSession);
+                }
             }
 
             /* Write a mama log. */
@@ -96,12 +252,19 @@ mama_status mamaEnv_createTimer(mamaTimerCb callback, void* closure, mama_f64_t
             /* Create the mama timer. */
             ret = mamaTimer_create(&timer->m_timer, envSession->m_queue, (mamaTimerCb)mamaEnvTimer_onTimerTick, interval, (void*)timer);
             if (ret == MAMA_STATUS_OK) {
+                /* The timer holds a reference on the session until it is destroyed. */
+                timer->m_session = envSession;
+                mamaEnvSession_acquire(envSession);
+
                 /* Add the timer to the map. */
                 ret = synchronizedMap_insert((void*)timer, (void*)timer->m_timer, envSession->m_timers);
                 if (ret == MAMA_STATUS_OK) {
                     /* Extract the mama timer from the session timer object. */
                     localMamaTimer = timer->m_timer;
                 }
+                else {
+                    mamaEnvSession_release(envSession);
+                }
             }
 
             /* Write a mama log. */
@@ -138,7 +301,63 @@ mama_status mamaEnv_createWildcardSubscription(const mamaWildCardMsgCallbacks* c
         localCallback.m_onMsgWildcard = callback->onMsg;
 
         /* Create the subscription. */
-        ret = mamaEnvSession_createSubscription(&localCallback, closure, envSession, source, symbol, transport, Wildcard, subscription);
+        ret = mamaEnvSession_createSubscription(&localCallback, closure, envSession, source, symbol, transport, Wildcard, NULL, subscription);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createRoutedSubscription(const mamaWildCardMsgCallbacks* callback, void* closure, mamaEnvSession session, const char* source, const char* symbol, mamaTransport transport, mamaSubscription* subscription)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((callback != NULL) && (session != NULL) && (symbol != NULL) && (transport != NULL) && (subscription != NULL)) {
+        /* Cast the session. */
+        mmeSession* envSession = (mmeSession*)session;
+
+        /* Format a callback structure to hold all the function pointers, onMsg receives the
+         * messages without a route.
+         */
+        mmeSubscriptionCallback localCallback;
+        memset(&localCallback, 0, sizeof(mmeSubscriptionCallback));
+        localCallback.m_onCreate = callback->onCreate;
+        localCallback.m_onError = callback->onError;
+        localCallback.m_onMsgWildcard = callback->onMsg;
+
+        /* Create the subscription. */
+        ret = mamaEnvSession_createSubscription(&localCallback, closure, envSession, source, symbol, transport, Routed, NULL, subscription);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createOffloadedSubscription(const mamaMsgCallbacks* callback, void* closure, mamaEnvSession session, const char* symbol, mamaTransport transport, mamaSubscription* subscription)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((callback != NULL) && (session != NULL) && (symbol != NULL) && (transport != NULL) && (subscription != NULL)) {
+        /* Cast the session. */
+        mmeSession* envSession = (mmeSession*)session;
+
+        /* Pin the subscription to one of the connection's lanes. */
+        mmeSubscriptionOptions options;
+        memset(&options, 0, sizeof(mmeSubscriptionOptions));
+        ret = mamaEnvConnection_getOffloadLane(envSession->m_connection, &options.m_lane);
+        if (ret == MAMA_STATUS_OK) {
+            /* Format a callback structure to hold all the function pointers. */
+            mmeSubscriptionCallback localCallback;
+            memset(&localCallback, 0, sizeof(mmeSubscriptionCallback));
+            localCallback.m_onCreate = callback->onCreate;
+            localCallback.m_onError = callback->onError;
+            localCallback.m_onMsgBasic = callback->onMsg;
+
+            /* Create the subscription. */
+            ret = mamaEnvSession_createSubscription(&localCallback, closure, envSession, NULL, symbol, transport, Offloaded, &options, subscription);
+        }
     }
 
     return ret;
@@ -244,6 +463,54 @@ mama_status mamaEnv_destroyTimer(mamaEnvSession session, mamaTimer timer)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_destroyInboxes(mamaEnvSession session, mamaInbox* inboxes, mama_u32_t count)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (inboxes != NULL)) {
+        ret = mamaEnvSession_destroyEvents(session, mamaEnvInboxObject, session->m_inboxes, (void**)inboxes, count);
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - destroyInboxes with session %p and %u inboxes completed with code %X.", session, count, ret);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_destroySubscriptions(mamaEnvSession session, mamaSubscription* subscriptions, mama_u32_t count)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (subscriptions != NULL)) {
+        ret = mamaEnvSession_destroyEvents(session, mamaEnvSubscriptionObject, session->m_subscriptions, (void**)subscriptions, count);
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - destroySubscriptions with session %p and %u subscriptions completed with code %X.", session, count, ret);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_destroyTimers(mamaEnvSession session, mamaTimer* timers, mama_u32_t count)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (timers != NULL)) {
+        ret = mamaEnvSession_destroyEvents(session, mamaEnvTimerObject, session->m_timers, (void**)timers, count);
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - destroyTimers with session %p and %u timers completed with code %X.", session, count, ret);
+    }
+
+    return ret;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnvSession_allocate(mmeSession** session)
 {
@@ -253,17 +520,25 @@ mama_status mamaEnvSession_allocate(mmeSession** session)
     /* Allocate the session structure. */
     mmeSession* localSession = (mmeSession*)calloc(1, sizeof(mmeSession));
     if (localSession != NULL) {
+        /* The session's own reference, released by mamaEnv_destroySession. */
+        localSession->m_references = 1;
+        mamaEnvControlLane_init(&localSession->m_control);
+
         /* Create the inbox map. */
-        localSession->m_inboxes = synchronizedMap_create();
+        localSession->m_inboxes = synchronizedMap_createWithType(HashTableMap);
         if (localSession->m_inboxes != NULL) {
             /* Create the timer map. */
-            localSession->m_timers = synchronizedMap_create();
+            localSession->m_timers = synchronizedMap_createWithType(HashTableMap);
             if (localSession->m_timers != NULL) {
                 /* Create the subscriptions map. */
-                localSession->m_subscriptions = synchronizedMap_create();
+                localSession->m_subscriptions = synchronizedMap_createSharded(HashTableMap, MMES_SUBSCRIPTION_SHARDS);
                 if (localSession->m_subscriptions != NULL) {
-                    /* Function success. */
-                    ret = MAMA_STATUS_OK;
+                    /* Create the shared subscribers map. */
+                    localSession->m_sharedSubscribers = synchronizedMap_createWithType(HashTableMap);
+                    if (localSession->m_sharedSubscribers != NULL) {
+                        /* Function success. */
+                        ret = MAMA_STATUS_OK;
+                    }
                 }
             }
         }
@@ -277,147 +552,497 @@ mama_status mamaEnvSession_allocate(mmeSession** session)
 
 
 //////////////////////////////////////////////////////////////////////////////
-mama_status mamaEnvSession_canDestroy(mmeSession* session)
+void mamaEnvSession_acquire(mmeSession* session)
 {
-    /* The session can be destroyed if there are no open objects on the queue. */
-    return mamaQueue_canDestroy(session->m_queue);
+    __atomic_fetch_add(&session->m_references, 1, __ATOMIC_RELAXED);
 }
 
 
 //////////////////////////////////////////////////////////////////////////////
-mama_status mamaEnvSession_create(mamaBridge bridge, mmeSession* session)
+void mamaEnvSession_release(mmeSession* session)
 {
-    /* Returns. */
-    mama_status ret = MAMA_STATUS_OK;
-
-    /* Create the queue. */
-    ret = mamaQueue_create(&session->m_queue, bridge);
-    if (ret == MAMA_STATUS_OK) {
-        /* Format the queue name using the session pointer. */
-        char queueName[64] = "";
-        sprintf(queueName, "MME Session queue %p", (void*)session);
-
-        /* Set the name of the queue. */
-        ret = mamaQueue_setQueueName(session->m_queue, queueName);
-        if (ret == MAMA_STATUS_OK) {
-            /* Create the dispatcher and start dispatching messages. */
-            ret = mamaDispatcher_create(&session->m_dispatcher, session->m_queue);
+    /* The last reference is dropped either by mamaEnv_destroySession or by the destroy event
+     * of the last object, in either case nothing else can touch the session so it can be
+     * reclaimed on the object queue.
+     */
+    if (__atomic_sub_fetch(&session->m_references, 1, __ATOMIC_ACQ_REL) == 0) {
+        mama_status ret = mamaQueue_enqueueEvent(session->m_connection->m_objectQueue, (mamaQueueEventCB)mamaEnvConnection_onSessionReclaim, (void*)session);
+        if (ret != MAMA_STATUS_OK) {
+            mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnvSession_release - enqueue reclaim for session %p failed with code %X.", session, ret);
         }
     }
+}
 
-    /* If something went wrong destroy the session. */
+
+//////////////////////////////////////////////////////////////////////////////
+static int mamaEnvSession_isApplicationDispatched(mmeSession* session)
+{
+    return (session->m_attributes != NULL) && (session->m_attributes->m_dispatchMode == mamaEnvDispatchApplication);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static int mamaEnvSession_isWorkerPool(mmeSession* session)
+{
+    return (session->m_attributes != NULL) && (session->m_attributes->m_dispatchMode == mamaEnvDispatchWorkerPool);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvSession_startDrain(mmeSession* session)
+{
+    /* Nothing will dispatch the queue now the application has let go of it, so give it a
+     * dispatcher to process the destroy events and let the session be reclaimed.
+     */
+    mama_status ret = mamaDispatcher_create(&session->m_dispatcher, session->m_queue);
     if (ret != MAMA_STATUS_OK) {
-        mamaEnvSession_destroy(session);
+        mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSession_startDrain - mamaDispatcher_create for session %p failed with code %X, draining on this thread.", session, ret);
+
+        /* Without a dispatcher this thread drains the queue itself, until every object has been
+         * destroyed and nothing is left on the queue, (the wake events hold session references).
+         */
+        session->m_dispatchThread = pthread_self();
+        __atomic_store_n(&session->m_dispatchThreadKnown, 1, __ATOMIC_RELEASE);
+        size_t count = 0;
+        while ((mamaQueue_canDestroy(session->m_queue) != MAMA_STATUS_OK) ||
+               ((mamaQueue_getEventCount(session->m_queue, &count) == MAMA_STATUS_OK) && (count > 0))) {
+            mamaQueue_timedDispatch(session->m_queue, MMES_POLL_BLOCK_TIMEOUT);
+        }
+        __atomic_store_n(&session->m_dispatchThreadKnown, 0, __ATOMIC_RELEASE);
     }
 
-    return ret;
+    __atomic_store_n(&session->m_pumpState, MMES_PUMP_CLOSED, __ATOMIC_RELEASE);
 }
 
 
 //////////////////////////////////////////////////////////////////////////////
-mama_status mamaEnvSession_deallocate(mmeSession* session)
+static mama_status mamaEnvSession_wakeControl(mmeSession* session)
 {
-    /* Delete the inbox map. */
-    if (session->m_inboxes != NULL) {
-        synchronizedMap_destroy(session->m_inboxes);
-        session->m_inboxes = NULL;
+    /* The wake event holds a reference so the session can't be reclaimed before it runs. */
+    mamaEnvSession_acquire(session);
+    mama_status ret = mamaQueue_enqueueEvent(session->m_queue, (mamaQueueEventCB)mamaEnvSession_onControlWake, (void*)session);
+    if (ret != MAMA_STATUS_OK) {
+        mamaEnvSession_release(session);
     }
 
-    /* Delete the subscriptions map. */
-    if (session->m_subscriptions != NULL) {
-        synchronizedMap_destroy(session->m_subscriptions);
-        session->m_subscriptions = NULL;
-    }
+    return ret;
+}
 
-    /* Delete the timer map. */
-    if (session->m_timers != NULL) {
-        synchronizedMap_destroy(session->m_timers);
-        session->m_timers = NULL;
-    }
 
-    /* Free the session structure. */
-    free(session);
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_enqueueControl(mmeSession* session, mmeControlEvent* event, mamaQueueEventCB callback, void* closure)
+{
+    /* The dispatch thread runs the lane after each callback, the wake event makes sure it is
+     * run even if nothing else is dispatched.
+     */
+    if (mamaEnvControlLane_push(&session->m_control, event, callback, closure)) {
+        return mamaEnvSession_wakeControl(session);
+    }
 
     return MAMA_STATUS_OK;
 }
 
 
-
 //////////////////////////////////////////////////////////////////////////////
-mama_status mamaEnvSession_destroy(mmeSession* session)
+void mamaEnvSession_drainControl(mmeSession* session, void* current)
 {
-    /* Returns. */
-    mama_status ret = MAMA_STATUS_OK;
-
-    /* Destroy the dispatcher which will stop all events. */
-    if (session->m_dispatcher != NULL) {
-        mama_status mdd = mamaDispatcher_destroy(session->m_dispatcher);
-        session->m_dispatcher = NULL;
-        if (ret == MAMA_STATUS_OK) {
-            ret = mdd;
-        }
-    }
-
-    /* Destroy the queue. */
-    if (session->m_queue != NULL) {
-        mama_status mqd = mamaQueue_destroy(session->m_queue);
-        session->m_queue = NULL;
-        if (ret == MAMA_STATUS_OK) {
-            ret = mqd;
+    if (mamaEnvControlLane_drain(&session->m_control, session->m_queue, current)) {
+        mama_status ret = mamaEnvSession_wakeControl(session);
+        if (ret != MAMA_STATUS_OK) {
+            mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnvSession_drainControl - enqueue wake for session %p failed with code %X.", session, ret);
         }
     }
-
-    return ret;
 }
 
 
 //////////////////////////////////////////////////////////////////////////////
-mama_status mamaEnvSession_destroyAllEvents(mmeSession* session)
+void MAMACALLTYPE mamaEnvSession_onControlWake(mamaQueue queue, void* closure)
 {
-    /* Returns. */
-    mama_status ret = MAMA_STATUS_OK;
+    /* Cast the closure to the session. */
+    mmeSession* session = (mmeSession*)closure;
 
-    /* Destroy all the inboxes, note that the return code will be preserved. */
-    mama_status ra = synchronizedMap_removeAll((synchronizedMap_Callback)mamaEnvSession_onDestroyAllInboxesCallback, (void*)session, session->m_inboxes);
-    if (MAMA_STATUS_OK == ret) {
-        ret = ra;
-    }
+    /* No wrapper callback is running so nothing is skipped, then drop the wake's reference
+     * which may be the session's last.
+     */
+    mamaEnvSession_drainControl(session, NULL);
+    mamaEnvSession_release(session);
+}
 
-    /* Destroy all the subscriptions. */
-    ra = synchronizedMap_removeAll((synchronizedMap_Callback)mamaEnvSession_onDestroyAllSubscriptionsCallback, (void*)session, session->m_subscriptions);
-    if (MAMA_STATUS_OK == ret) {
-        ret = ra;
-    }
 
-    /* Destroy all the timers. */
-    ra = synchronizedMap_removeAll((synchronizedMap_Callback)mamaEnvSession_onDestroyAllTimersCallback, (void*)session, session->m_timers);
-    if (MAMA_STATUS_OK == ret) {
-        ret = ra;
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_closeSchedule(mmeSession* session)
+{
+    /* Close the session if no worker holds it, the enqueue callback must already be removed
+     * so that nothing schedules it again.
+     */
+    int expected = MMES_SCHEDULE_IDLE;
+    if (__atomic_compare_exchange_n(&session->m_scheduleState, &expected, MMES_SCHEDULE_CLOSED, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) || (expected == MMES_SCHEDULE_CLOSED)) {
+        return MAMA_STATUS_OK;
     }
 
-    return ret;
+    return MAMA_STATUS_QUEUE_OPEN_OBJECTS;
 }
 
 
 //////////////////////////////////////////////////////////////////////////////
-mama_status mamaEnvSession_createSubscription(mmeSubscriptionCallback* callback, void* closure, mmeSession* session, const char* source, const char* symbol, mamaTransport transport, mmeSubscriptionType type, mamaSubscription* result)
+mama_status mamaEnvSession_canDestroy(mmeSession* session)
 {
-    /* The mama subscription will be returned. */
-    mamaSubscription localMamaSubscription = NULL;
+    /* An application dispatched session may still be inside mamaEnv_dispatchSession. */
+    if (mamaEnvSession_isApplicationDispatched(session) && (__atomic_load_n(&session->m_pumpState, __ATOMIC_ACQUIRE) != MMES_PUMP_CLOSED)) {
+        return MAMA_STATUS_QUEUE_OPEN_OBJECTS;
+    }
 
-    /* Allocate a new subscription object. */
+    /* A worker pool session may still be held by a worker, which may be behind other sessions
+     * on the run queue, so rather than wait the reclaim is retried later.
+     */
+    if (mamaEnvSession_isWorkerPool(session)) {
+        mamaQueue_removeEnqueueCallback(session->m_queue);
+        if (mamaEnvSession_closeSchedule(session) != MAMA_STATUS_OK) {
+            return MAMA_STATUS_QUEUE_OPEN_OBJECTS;
+        }
+    }
+
+    /* The session can be destroyed if there are no open objects on the queue. */
+    return mamaQueue_canDestroy(session->m_queue);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_closePump(mmeSession* session)
+{
+    if (mamaEnvSession_isApplicationDispatched(session)) {
+        /* Stop the application dispatching the session, if a thread is dispatching it now then
+         * that thread starts the drain as it leaves mamaEnv_dispatchSession.
+         */
+        if (__atomic_exchange_n(&session->m_pumpState, MMES_PUMP_CLOSING, __ATOMIC_ACQ_REL) == MMES_PUMP_IDLE) {
+            mamaEnvSession_startDrain(session);
+        }
+    }
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void* mamaEnvSession_pollThread(void* closure)
+{
+    mmeSession* session = (mmeSession*)closure;
+    int adaptive = (session->m_attributes->m_dispatchMode == mamaEnvDispatchAdaptive) ? 1 : 0;
+    mama_u64_t spinTime = session->m_attributes->m_spinTime;
+
+    /* The time the queue was last found busy. */
+    mama_u64_t lastEvent = mamaEnv_getMonotonicTime();
+
+    while (__atomic_load_n(&session->m_pollStop, __ATOMIC_ACQUIRE) == 0) {
+        /* Checking the count is cheap and never blocks, so only dispatch when there is something there. */
+        size_t count = 0;
+        mamaQueue_getEventCount(session->m_queue, &count);
+        if (count > 0) {
+            mamaEnvSession_recordDepth(session, count);
+            mamaQueue_dispatchEvent(session->m_queue);
+            if (adaptive) {
+                lastEvent = mamaEnv_getMonotonicTime();
+            }
+            continue;
+        }
+
+        /* An adaptive session blocks once it has been idle for the spin time, and then spins
+         * again after whatever woke it.
+         */
+        if (adaptive && ((mamaEnv_getMonotonicTime() - lastEvent) >= spinTime)) {
+            mamaQueue_timedDispatch(session->m_queue, MMES_POLL_BLOCK_TIMEOUT);
+            lastEvent = mamaEnv_getMonotonicTime();
+        }
+    }
+
+    return NULL;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSession_onEnqueue(mamaQueue queue, void* closure)
+{
+    mmeSession* session = (mmeSession*)closure;
+
+    /* Put an idle session on the run queue, or tell the worker running it to look again. */
+    int state = __atomic_load_n(&session->m_scheduleState, __ATOMIC_ACQUIRE);
+    for (;;) {
+        if (state == MMES_SCHEDULE_IDLE) {
+            if (__atomic_compare_exchange_n(&session->m_scheduleState, &state, MMES_SCHEDULE_SCHEDULED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                mamaEnvWorkerPool_schedule(session->m_connection->m_workerPool, session);
+                return;
+            }
+        }
+        else if (state == MMES_SCHEDULE_RUNNING) {
+            if (__atomic_compare_exchange_n(&session->m_scheduleState, &state, MMES_SCHEDULE_RUNNING_NOTIFIED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+        }
+        else {
+            /* Already scheduled or notified, or closed. */
+            return;
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+int mamaEnvSession_runScheduled(mmeSession* session)
+{
+    /* Only this worker holds the session now. */
+    __atomic_store_n(&session->m_scheduleState, MMES_SCHEDULE_RUNNING, __ATOMIC_RELEASE);
+    session->m_dispatchThread = pthread_self();
+    __atomic_store_n(&session->m_dispatchThreadKnown, 1, __ATOMIC_RELEASE);
+
+    /* Dispatch a bounded number of events. */
+    size_t count = 0;
+    mamaQueue_getEventCount(session->m_queue, &count);
+    mamaEnvSession_recordDepth(session, count);
+    if (count > MMEW_QUANTUM) {
+        count = MMEW_QUANTUM;
+    }
+    for (size_t i = 0; i < count; i++) {
+        mamaQueue_dispatchEvent(session->m_queue);
+    }
+
+    __atomic_store_n(&session->m_dispatchThreadKnown, 0, __ATOMIC_RELEASE);
+
+    /* Go to the back of the run queue if there is more to do. */
+    size_t remaining = 0;
+    mamaQueue_getEventCount(session->m_queue, &remaining);
+    if (remaining > 0) {
+        __atomic_store_n(&session->m_scheduleState, MMES_SCHEDULE_SCHEDULED, __ATOMIC_RELEASE);
+        return 1;
+    }
+
+    /* Otherwise go idle, unless an event arrived after the count was taken. Once the session is
+     * idle it must not be touched, it may be destroyed at once.
+     */
+    int expected = MMES_SCHEDULE_RUNNING;
+    if (__atomic_compare_exchange_n(&session->m_scheduleState, &expected, MMES_SCHEDULE_IDLE, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    __atomic_store_n(&session->m_scheduleState, MMES_SCHEDULE_SCHEDULED, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSession_onPollWake(mamaQueue queue, void* closure)
+{
+    /* Nothing to do, this only wakes a blocked poll thread so it sees m_pollStop. */
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_create(mamaBridge bridge, mmeSession* session)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_OK;
+
+    /* Create the queue. */
+    ret = mamaQueue_create(&session->m_queue, bridge);
+    if (ret == MAMA_STATUS_OK) {
+        /* Format the queue name using the session pointer. */
+        char queueName[64] = "";
+        sprintf(queueName, "MME Session queue %p", (void*)session);
+
+        /* Set the name of the queue. */
+        ret = mamaQueue_setQueueName(session->m_queue, queueName);
+        if (ret == MAMA_STATUS_OK) {
+            /* The first event on the queue records which thread is dispatching it. */
+            ret = mamaQueue_enqueueEvent(session->m_queue, (mamaQueueEventCB)mamaEnvSession_onDispatchStart, (void*)session);
+            if (ret == MAMA_STATUS_OK) {
+                if (mamaEnvSession_isApplicationDispatched(session)) {
+                    /* Nothing to start, the application dispatches the queue until the session is destroyed. */
+                }
+
+                /* A worker pool session is scheduled by every enqueue, the dispatch start event
+                 * is already on the queue so schedule it for that too.
+                 */
+                else if (mamaEnvSession_isWorkerPool(session)) {
+                    ret = mamaQueue_setEnqueueCallback(session->m_queue, (mamaQueueEnqueueCB)mamaEnvSession_onEnqueue, (void*)session);
+                    if (ret == MAMA_STATUS_OK) {
+                        mamaEnvSession_onEnqueue(session->m_queue, (void*)session);
+                    }
+                }
+
+                /* Polling sessions run their own thread in place of a mama dispatcher. */
+                else if ((session->m_attributes != NULL) && (session->m_attributes->m_dispatchMode != mamaEnvDispatchBlocking)) {
+                    ret = MAMA_STATUS_PLATFORM;
+                    if (pthread_create(&session->m_pollThread, NULL, mamaEnvSession_pollThread, (void*)session) == 0) {
+                        session->m_pollThreadRunning = 1;
+                        ret = MAMA_STATUS_OK;
+                    }
+                }
+
+                /* Otherwise create the dispatcher and start dispatching messages. */
+                else {
+                    ret = mamaDispatcher_create(&session->m_dispatcher, session->m_queue);
+                }
+            }
+        }
+    }
+
+    /* If something went wrong destroy the session. */
+    if (ret != MAMA_STATUS_OK) {
+        mamaEnvSession_destroy(session);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_deallocate(mmeSession* session)
+{
+    /* Delete the inbox map. */
+    if (session->m_inboxes != NULL) {
+        synchronizedMap_destroy(session->m_inboxes);
+        session->m_inboxes = NULL;
+    }
+
+    /* Delete the subscriptions map. */
+    if (session->m_subscriptions != NULL) {
+        synchronizedMap_destroy(session->m_subscriptions);
+        session->m_subscriptions = NULL;
+    }
+
+    /* Delete the timer map. */
+    if (session->m_timers != NULL) {
+        synchronizedMap_destroy(session->m_timers);
+        session->m_timers = NULL;
+    }
+
+    /* Delete the shared subscribers map. */
+    if (session->m_sharedSubscribers != NULL) {
+        synchronizedMap_destroy(session->m_sharedSubscribers);
+        session->m_sharedSubscribers = NULL;
+    }
+
+    /* Free the attributes. */
+    free(session->m_attributes);
+    session->m_attributes = NULL;
+
+    mamaEnvControlLane_destroy(&session->m_control);
+
+    /* Free the session structure. */
+    free(session);
+
+    return MAMA_STATUS_OK;
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_destroy(mmeSession* session)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_OK;
+
+    /* Stop the poll thread, the event wakes it if it is blocked on the queue. */
+    if (session->m_pollThreadRunning != 0) {
+        __atomic_store_n(&session->m_pollStop, 1, __ATOMIC_RELEASE);
+        mamaQueue_enqueueEvent(session->m_queue, (mamaQueueEventCB)mamaEnvSession_onPollWake, (void*)session);
+        pthread_join(session->m_pollThread, NULL);
+        session->m_pollThreadRunning = 0;
+    }
+
+    /* Take a worker pool session off the pool. A reclaimed session was already closed by
+     * mamaEnvSession_canDestroy, only one that failed during creation can still be held by a
+     * worker, and then this waits for the worker to let it go.
+     */
+    if ((session->m_queue != NULL) && mamaEnvSession_isWorkerPool(session)) {
+        mamaQueue_removeEnqueueCallback(session->m_queue);
+        if (mamaEnvSession_closeSchedule(session) != MAMA_STATUS_OK) {
+            mamaEnvWorkerPool_waitClosed(session->m_connection->m_workerPool, session);
+        }
+    }
+
+    /* Destroy the dispatcher which will stop all events. */
+    if (session->m_dispatcher != NULL) {
+        mama_status mdd = mamaDispatcher_destroy(session->m_dispatcher);
+        session->m_dispatcher = NULL;
+        if (ret == MAMA_STATUS_OK) {
+            ret = mdd;
+        }
+    }
+
+    /* Destroy the queue. */
+    if (session->m_queue != NULL) {
+        mama_status mqd = mamaQueue_destroy(session->m_queue);
+        session->m_queue = NULL;
+        if (ret == MAMA_STATUS_OK) {
+            ret = mqd;
+        }
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_destroyAllEvents(mmeSession* session)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_OK;
+
+    /* Destroy all the inboxes, note that the return code will be preserved. */
+    mama_status ra = synchronizedMap_removeAll((synchronizedMap_Callback)mamaEnvSession_onDestroyAllInboxesCallback, (void*)session, session->m_inboxes);
+    if (MAMA_STATUS_OK == ret) {
+        ret = ra;
+    }
+
+    /* Destroy all the subscriptions. */
+    ra = synchronizedMap_removeAll((synchronizedMap_Callback)mamaEnvSession_onDestroyAllSubscriptionsCallback, (void*)session, session->m_subscriptions);
+    if (MAMA_STATUS_OK == ret) {
+        ret = ra;
+    }
+
+    /* Destroy all the timers. */
+    ra = synchronizedMap_removeAll((synchronizedMap_Callback)mamaEnvSession_onDestroyAllTimersCallback, (void*)session, session->m_timers);
+    if (MAMA_STATUS_OK == ret) {
+        ret = ra;
+    }
+
+    /* Leave all the shared subscriptions. */
+    ra = synchronizedMap_removeAll((synchronizedMap_Callback)mamaEnvSession_onDestroyAllSharedSubscribersCallback, (void*)session, session->m_sharedSubscribers);
+    if (MAMA_STATUS_OK == ret) {
+        ret = ra;
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_createSubscription(mmeSubscriptionCallback* callback, void* closure, mmeSession* session, const char* source, const char* symbol, mamaTransport transport, mmeSubscriptionType type, const mmeSubscriptionOptions* options, mamaSubscription* result)
+{
+    /* The mama subscription will be returned. */
+    mamaSubscription localMamaSubscription = NULL;
+
+    /* Allocate a new subscription object. */
     mmeSubscription* subscription = NULL;
     mama_status ret = mamaEnvSubscription_allocate(callback, closure, &subscription);
     if (ret == MAMA_STATUS_OK) {
         /* Create a subscription of the appropriate type. */
-        ret = mamaEnvSubscription_create(session->m_queue, source, subscription, symbol, transport, type);
+        ret = mamaEnvSubscription_create(session->m_queue, source, subscription, symbol, transport, type, options);
         if (MAMA_STATUS_OK == ret) {
+            /* The subscription holds a reference on the session until it is destroyed. */
+            subscription->m_session = session;
+            mamaEnvSession_acquire(session);
+
             /* Add the subscription to the map. */
             ret = synchronizedMap_insert((void*)subscription, (void*)subscription->m_subscription, session->m_subscriptions);
             if (MAMA_STATUS_OK == ret) {
                 /* Extract the mama subscrtiption from the object. */
                 localMamaSubscription = subscription->m_subscription;
             }
+            else {
+                mamaEnvSession_release(session);
+                subscription->m_session = NULL;
+            }
         }
 
         /* Write a mama log. */
@@ -436,62 +1061,806 @@ mama_status mamaEnvSession_createSubscription(mmeSubscriptionCallback* callback,
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_createSubscriptions(mmeSubscriptionCallback* callback, void** closures, mmeSession* session, const char** symbols, mama_u32_t count, mamaTransport transport, mmeSubscriptionType type, mamaSubscription* results, mama_status* statuses)
+{
+    /* Returns the first error. */
+    mama_status ret = MAMA_STATUS_OK;
+
+    /* The subscriptions are created one at a time but added to the map together, so the map
+     * is locked once rather than once per symbol. As for a single subscription, each is only
+     * added to the map once it has been created, so nothing else can find a wrapper that might
+     * still fail.
+     */
+    mmeSubscription** created = (mmeSubscription**)calloc(count + 1, sizeof(mmeSubscription*));
+    void** keys = (void**)calloc(count + 1, sizeof(void*));
+    mama_status* inserted = (mama_status*)calloc(count + 1, sizeof(mama_status));
+    if ((created == NULL) || (keys == NULL) || (inserted == NULL)) {
+        free(created);
+        free(keys);
+        free(inserted);
+        for (mama_u32_t i = 0; i < count; i++) {
+            results[i] = NULL;
+            statuses[i] = MAMA_STATUS_NOMEM;
+        }
+        return MAMA_STATUS_NOMEM;
+    }
+
+    mama_u32_t numberCreated = 0;
+    for (mama_u32_t i = 0; i < count; i++) {
+        results[i] = NULL;
+        statuses[i] = MAMA_STATUS_NULL_ARG;
+        if (symbols[i] == NULL) {
+            continue;
+        }
+
+        mmeSubscription* subscription = NULL;
+        statuses[i] = mamaEnvSubscription_allocate(callback, (closures != NULL) ? closures[i] : NULL, &subscription);
+        if (statuses[i] == MAMA_STATUS_OK) {
+            /* The subscription holds a reference on the session until it is destroyed, and the
+             * callbacks find the session through it, so both are in place before it is created.
+             */
+            subscription->m_session = session;
+            mamaEnvSession_acquire(session);
+
+            statuses[i] = mamaEnvSubscription_create(session->m_queue, NULL, subscription, symbols[i], transport, type, NULL);
+            if (statuses[i] == MAMA_STATUS_OK) {
+                created[numberCreated] = subscription;
+                keys[numberCreated] = (void*)subscription->m_subscription;
+                numberCreated++;
+            }
+            else {
+                mamaEnvSession_release(session);
+                subscription->m_session = NULL;
+                mamaEnvSubscription_destroy(subscription);
+            }
+        }
+    }
+
+    /* Add the created subscriptions to the map. */
+    if (numberCreated > 0) {
+        synchronizedMap_insertEntries(keys, (void**)created, numberCreated, session->m_subscriptions, inserted);
+    }
+
+    /* Return the results in the order of the symbols. */
+    mama_u32_t next = 0;
+    mama_u32_t numberAdded = 0;
+    for (mama_u32_t i = 0; i < count; i++) {
+        if (statuses[i] == MAMA_STATUS_OK) {
+            mmeSubscription* subscription = created[next];
+            statuses[i] = inserted[next];
+            next++;
+
+            if (statuses[i] == MAMA_STATUS_OK) {
+                results[i] = subscription->m_subscription;
+                numberAdded++;
+            }
+            else {
+                mamaEnvSession_release(session);
+                subscription->m_session = NULL;
+                mamaEnvSubscription_destroy(subscription);
+            }
+        }
+
+        if ((statuses[i] != MAMA_STATUS_OK) && (ret == MAMA_STATUS_OK)) {
+            ret = statuses[i];
+        }
+    }
+
+    free(created);
+    free(keys);
+    free(inserted);
+
+    /* Write one mama log for the whole call. */
+    mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - createSubscriptions with session %p created %u of %u subscriptions, first error %X.", session, numberAdded, count, ret);
+
+    return ret;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnvSession_destroyInbox(mmeSession* envSession, mmeInbox* envInbox)
 {
-    /* Lock the inbox. */
-    wlock_lock(envInbox->m_lock);
+    /* Close the gate and wait for any running callback to return, this must be done
+     * before the event is enqueued. On the dispatch thread no callback can be running
+     * concurrently so there is nothing to wait for.
+     */
+    mamaEnvGate_close(&envInbox->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL);
+    if (mamaEnvSession_isDispatchThread(envSession)) {
+        __atomic_fetch_add(&envSession->m_fastPathDestroys, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_fetch_add(&envSession->m_slowPathDestroys, 1, __ATOMIC_RELAXED);
+        mamaEnvGate_wait(&envInbox->m_gate);
+    }
 
-    /* Clear the callback functions to prevent them being fired. */
+    /* Clear the callback functions, (no callback can now be running). */
     envInbox->m_closure = NULL;
     envInbox->m_errorCallback = NULL;
     envInbox->m_msgCallback = NULL;
 
-    /* Unlock the inbox, this must be done before the event in enqueued. */
-    wlock_unlock(envInbox->m_lock);
-
     mama_log(MAMA_LOG_LEVEL_FINER, "mamaEnvSession_destroyInbox: inbox=%p", envInbox->m_inbox);
 
-    /* Enqueue an event to destroy the inbox on the connection's object queue. */
-    return mamaQueue_enqueueEvent(envSession->m_queue, (mamaQueueEventCB)mamaEnvInbox_onInboxDestroy, (void*)envInbox);
+    /* Complete the destroy on the session's control lane. */
+    return mamaEnvSession_enqueueControl(envSession, &envInbox->m_destroyEvent, (mamaQueueEventCB)mamaEnvInbox_onInboxDestroy, (void*)envInbox);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static int mamaEnvSession_isCallbackThread(mmeSession* envSession, mmeSubscription* envSubscription)
+{
+    /* An offloaded subscription's message callbacks run on its lane rather than the session. */
+    return (envSubscription->m_lane == NULL) && mamaEnvSession_isDispatchThread(envSession);
 }
 
 
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnvSession_destroySubscription(mmeSession* envSession, mmeSubscription* envSubscription)
 {
-    /* Lock the subscription. */
-    wlock_lock(envSubscription->m_lock);
+    /* Close the gate and wait for any running callback to return, this must be done
+     * before the event is enqueued. On the dispatch thread no callback can be running
+     * concurrently so there is nothing to wait for.
+     */
+    mamaEnvGate_close(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL);
+    if (mamaEnvSession_isCallbackThread(envSession, envSubscription)) {
+        __atomic_fetch_add(&envSession->m_fastPathDestroys, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_fetch_add(&envSession->m_slowPathDestroys, 1, __ATOMIC_RELAXED);
+        mamaEnvGate_wait(&envSubscription->m_gate);
+    }
 
-    /* Clear the callback functions to prevent it being fired. */
+    /* Clear the callback functions, (no callback can now be running). */
     memset(&envSubscription->m_callback, 0, sizeof(mmeSubscriptionCallback));
     envSubscription->m_closure = NULL;
 
-    /* Unlock the subscription, this must be done before the event in enqueued. */
-    wlock_unlock(envSubscription->m_lock);
+    /* A batch or conflated subscription may have a flush event on the queue, which must run
+     * before the subscription is destroyed, so its destroy stays behind it on the queue.
+     */
+    if ((envSubscription->m_batch != NULL) || (envSubscription->m_conflation != NULL)) {
+        return mamaQueue_enqueueEvent(envSession->m_queue, (mamaQueueEventCB)mamaEnvSubscription_onSubscriptionDestroy, (void*)envSubscription);
+    }
 
-    /* Enqueue an event to destroy the subscription on the connection's object queue. */
-    return mamaQueue_enqueueEvent(envSession->m_queue, (mamaQueueEventCB)mamaEnvSubscription_onSubscriptionDestroy, (void*)envSubscription);
+    /* Complete the destroy on the session's control lane. */
+    return mamaEnvSession_enqueueControl(envSession, &envSubscription->m_destroyEvent, (mamaQueueEventCB)mamaEnvSubscription_onSubscriptionDestroy, (void*)envSubscription);
 }
 
 
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnvSession_destroyTimer(mmeSession* envSession, mmeTimer* envTimer)
 {
-    /* Lock the timer. */
-    wlock_lock(envTimer->m_destroyLock);
-    wlock_lock(envTimer->m_lock);
+    /* Close the gate and wait for any running callback to return, this must be done
+     * before the event is enqueued. On the dispatch thread no callback can be running
+     * concurrently so there is nothing to wait for.
+     */
+    mamaEnvGate_close(&envTimer->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL);
+    if (mamaEnvSession_isDispatchThread(envSession)) {
+        __atomic_fetch_add(&envSession->m_fastPathDestroys, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_fetch_add(&envSession->m_slowPathDestroys, 1, __ATOMIC_RELAXED);
+        mamaEnvGate_wait(&envTimer->m_gate);
+    }
 
-    /* Clear the callback function to prevent it being fired. */
+    /* Clear the callback function, (no callback can now be running). */
     envTimer->m_callback = NULL;
     envTimer->m_closure = NULL;
 
-    /* Unlock the timer, this must be done before the event is enqueued. */
-    wlock_unlock(envTimer->m_lock);
-    wlock_unlock(envTimer->m_destroyLock);
+    /* Complete the destroy on the session's control lane. */
+    return mamaEnvSession_enqueueControl(envSession, &envTimer->m_destroyEvent, (mamaQueueEventCB)mamaEnvTimer_onTimerDestroy, (void*)envTimer);
+}
+
 
-    /* Enqueue an event to destroy the timer on the session queue. */
-    return mamaQueue_enqueueEvent(envSession->m_queue, (mamaQueueEventCB)mamaEnvTimer_onTimerDestroy, (void*)envTimer);
+//////////////////////////////////////////////////////////////////////////////
+static mmeGate* mamaEnvSession_batchGate(mamaEnvObjectType type, void* object)
+{
+    switch (type) {
+    case mamaEnvSubscriptionObject:
+        return &((mmeSubscription*)object)->m_gate;
+    case mamaEnvTimerObject:
+        return &((mmeTimer*)object)->m_gate;
+    default:
+        return &((mmeInbox*)object)->m_gate;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_destroyEvents(mmeSession* envSession, mamaEnvObjectType type, SynchronizedMap* map, void** handles, mama_u32_t count)
+{
+    if (count == 0) {
+        return MAMA_STATUS_OK;
+    }
+
+    mmeDestroyBatch* batch = (mmeDestroyBatch*)calloc(1, sizeof(mmeDestroyBatch) + (count * sizeof(void*)));
+    mama_status* statuses = (mama_status*)calloc(count, sizeof(mama_status));
+    if ((batch == NULL) || (statuses == NULL)) {
+        free(batch);
+        free(statuses);
+        return MAMA_STATUS_NOMEM;
+    }
+    batch->m_type = type;
+
+    /* Remove all the objects from the map at once, any that weren't in the map have already
+     * been removed so are skipped.
+     */
+    mama_status ret = synchronizedMap_removeEntries(handles, count, map, batch->m_objects, statuses);
+    if (ret == MAMA_STATUS_NOMEM) {
+        free(batch);
+        free(statuses);
+        return ret;
+    }
+    for (mama_u32_t i = 0; i < count; i++) {
+        if ((statuses[i] == MAMA_STATUS_OK) && (batch->m_objects[i] != NULL)) {
+            batch->m_objects[batch->m_count++] = batch->m_objects[i];
+        }
+    }
+    free(statuses);
+
+    /* Close all the gates before waiting on any of them, so that callbacks running in other
+     * threads drain together. On the dispatch thread there is nothing to wait for.
+     */
+    for (mama_u32_t i = 0; i < batch->m_count; i++) {
+        mamaEnvGate_close(mamaEnvSession_batchGate(type, batch->m_objects[i]), MMEG_CLOSED_MSG | MMEG_CLOSED_ALL);
+    }
+    int dispatchThread = mamaEnvSession_isDispatchThread(envSession);
+    if (dispatchThread) {
+        __atomic_fetch_add(&envSession->m_fastPathDestroys, batch->m_count, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_fetch_add(&envSession->m_slowPathDestroys, batch->m_count, __ATOMIC_RELAXED);
+        for (mama_u32_t i = 0; i < batch->m_count; i++) {
+            mamaEnvGate_wait(mamaEnvSession_batchGate(type, batch->m_objects[i]));
+        }
+    }
+
+    /* An offloaded subscription's callbacks run on its lane, so even the dispatch thread waits for them. */
+    if (dispatchThread && (type == mamaEnvSubscriptionObject)) {
+        for (mama_u32_t i = 0; i < batch->m_count; i++) {
+            if (((mmeSubscription*)batch->m_objects[i])->m_lane != NULL) {
+                mamaEnvGate_wait(mamaEnvSession_batchGate(type, batch->m_objects[i]));
+            }
+        }
+    }
+
+    /* Clear the callback functions, (no callback can now be running). */
+    ret = MAMA_STATUS_OK;
+    mama_u32_t kept = 0;
+    for (mama_u32_t i = 0; i < batch->m_count; i++) {
+        if (type == mamaEnvSubscriptionObject) {
+            mmeSubscription* envSubscription = (mmeSubscription*)batch->m_objects[i];
+            memset(&envSubscription->m_callback, 0, sizeof(mmeSubscriptionCallback));
+            envSubscription->m_closure = NULL;
+
+            /* A batch or conflated subscription's destroy stays behind any flush on the queue. */
+            if ((envSubscription->m_batch != NULL) || (envSubscription->m_conflation != NULL)) {
+                mama_status eret = mamaQueue_enqueueEvent(envSession->m_queue, (mamaQueueEventCB)mamaEnvSubscription_onSubscriptionDestroy, (void*)envSubscription);
+                if ((eret != MAMA_STATUS_OK) && (ret == MAMA_STATUS_OK)) {
+                    ret = eret;
+                }
+                continue;
+            }
+        }
+        else if (type == mamaEnvTimerObject) {
+            mmeTimer* envTimer = (mmeTimer*)batch->m_objects[i];
+            envTimer->m_callback = NULL;
+            envTimer->m_closure = NULL;
+        }
+        else {
+            mmeInbox* envInbox = (mmeInbox*)batch->m_objects[i];
+            envInbox->m_closure = NULL;
+            envInbox->m_errorCallback = NULL;
+            envInbox->m_msgCallback = NULL;
+        }
+        batch->m_objects[kept++] = batch->m_objects[i];
+    }
+    batch->m_count = kept;
+
+    if (batch->m_count == 0) {
+        free(batch);
+        return ret;
+    }
+
+    /* Complete all the destroys with one event. The control lane skips only the destroy of the
+     * object whose callback is running, which it can't find inside a batch, so on the dispatch
+     * thread the batch goes on the session queue to run after the current callback instead.
+     */
+    mama_status eret = dispatchThread ? mamaQueue_enqueueEvent(envSession->m_queue, (mamaQueueEventCB)mamaEnvSession_onDestroyBatch, (void*)batch)
+                                      : mamaEnvSession_enqueueControl(envSession, &batch->m_event, (mamaQueueEventCB)mamaEnvSession_onDestroyBatch, (void*)batch);
+    if (eret != MAMA_STATUS_OK) {
+        free(batch);
+        if (ret == MAMA_STATUS_OK) {
+            ret = eret;
+        }
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSession_onDestroyBatch(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to the batch. */
+    mmeDestroyBatch* batch = (mmeDestroyBatch*)closure;
+
+    /* Destroy each mama object, the gates were closed before this event was enqueued so no
+     * callback can be running. A subscription is freed after mama calls its destroy callback.
+     */
+    mama_u32_t failed = 0;
+    for (mama_u32_t i = 0; i < batch->m_count; i++) {
+        mama_status ret = MAMA_STATUS_OK;
+        if (batch->m_type == mamaEnvSubscriptionObject) {
+            ret = mamaEnvSubscription_destroy((mmeSubscription*)batch->m_objects[i]);
+        }
+        else if (batch->m_type == mamaEnvTimerObject) {
+            mmeTimer* timer = (mmeTimer*)batch->m_objects[i];
+            if (timer->m_timer != NULL) {
+                ret = mamaTimer_destroy(timer->m_timer);
+                timer->m_timer = NULL;
+            }
+        }
+        else {
+            mmeInbox* inbox = (mmeInbox*)batch->m_objects[i];
+            if (inbox->m_inbox != NULL) {
+                ret = mamaInbox_destroy(inbox->m_inbox);
+                inbox->m_inbox = NULL;
+            }
+        }
+        if (ret != MAMA_STATUS_OK) {
+            failed++;
+        }
+    }
+
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - onDestroyBatch with %u objects of type %d completed with %u failures.", batch->m_count, (int)batch->m_type, failed);
+
+    /* This may have run on the control lane ahead of events already on the session queue, which
+     * still refer to the timers and inboxes, so they are freed by the same batch behind them.
+     */
+    if (batch->m_type != mamaEnvSubscriptionObject) {
+        mama_status eret = mamaQueue_enqueueEvent(queue, (mamaQueueEventCB)mamaEnvSession_onFreeBatch, (void*)batch);
+        if (eret == MAMA_STATUS_OK) {
+            return;
+        }
+        mama_log(MAMA_LOG_LEVEL_ERROR, "MamaEnv - onDestroyBatch failed to enqueue free with code %X.", eret);
+        mamaEnvSession_onFreeBatch(queue, (void*)batch);
+        return;
+    }
+
+    free(batch);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSession_onFreeBatch(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to the batch, whose mama timers or inboxes have already been destroyed. */
+    mmeDestroyBatch* batch = (mmeDestroyBatch*)closure;
+    for (mama_u32_t i = 0; i < batch->m_count; i++) {
+        if (batch->m_type == mamaEnvTimerObject) {
+            mamaEnvTimer_onTimerFree(queue, batch->m_objects[i]);
+        }
+        else {
+            mamaEnvInbox_onInboxFree(queue, batch->m_objects[i]);
+        }
+    }
+
+    free(batch);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_shutdownInbox(mmeSession* envSession, mmeInbox* envInbox)
+{
+    /* On the dispatch thread no inbox callback can be running concurrently. */
+    if (mamaEnvSession_isDispatchThread(envSession)) {
+        __atomic_fetch_add(&envSession->m_fastPathDestroys, 1, __ATOMIC_RELAXED);
+        mamaEnvGate_close(&envInbox->m_gate, MMEG_CLOSED_MSG);
+        return MAMA_STATUS_OK;
+    }
+
+    __atomic_fetch_add(&envSession->m_slowPathDestroys, 1, __ATOMIC_RELAXED);
+    return mamaEnvInbox_shutdown(envInbox);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_shutdownSubscription(mmeSession* envSession, mmeSubscription* envSubscription)
+{
+    /* On the dispatch thread no subscription callback can be running concurrently, unless it
+     * is offloaded.
+     */
+    if (mamaEnvSession_isCallbackThread(envSession, envSubscription)) {
+        __atomic_fetch_add(&envSession->m_fastPathDestroys, 1, __ATOMIC_RELAXED);
+        mamaEnvGate_close(&envSubscription->m_gate, MMEG_CLOSED_MSG);
+        return MAMA_STATUS_OK;
+    }
+
+    __atomic_fetch_add(&envSession->m_slowPathDestroys, 1, __ATOMIC_RELAXED);
+    return mamaEnvSubscription_shutdown(envSubscription);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_shutdownTimer(mmeSession* envSession, mmeTimer* envTimer)
+{
+    /* On the dispatch thread no timer callback can be running concurrently. */
+    if (mamaEnvSession_isDispatchThread(envSession)) {
+        __atomic_fetch_add(&envSession->m_fastPathDestroys, 1, __ATOMIC_RELAXED);
+        mamaEnvGate_close(&envTimer->m_gate, MMEG_CLOSED_MSG);
+        return MAMA_STATUS_OK;
+    }
+
+    __atomic_fetch_add(&envSession->m_slowPathDestroys, 1, __ATOMIC_RELAXED);
+    return mamaEnvTimer_shutdown(envTimer);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnv_initSessionAttributes(mamaEnvSessionAttributes* attributes)
+{
+    if (attributes != NULL) {
+        memset(attributes, 0, sizeof(mamaEnvSessionAttributes));
+        attributes->m_threadNumaNode = -1;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mama_status mamaEnvSession_parseCpuList(const char* cpuList, mmeSessionAttributes* attributes)
+{
+    /* The list is a comma separated set of CPU numbers and ranges, e.g. "2,4-6". */
+    const char* next = cpuList;
+    while (*next != '\0') {
+        /* Read the first CPU of the range. */
+        if (!isdigit((unsigned char)*next)) {
+            return MAMA_STATUS_INVALID_ARG;
+        }
+        unsigned long first = strtoul(next, (char**)&next, 10);
+        unsigned long last = first;
+
+        /* Read the last CPU of the range, if there is one. */
+        if (*next == '-') {
+            next++;
+            if (!isdigit((unsigned char)*next)) {
+                return MAMA_STATUS_INVALID_ARG;
+            }
+            last = strtoul(next, (char**)&next, 10);
+        }
+        if ((first > last) || (last >= MMES_MAX_CPUS)) {
+            return MAMA_STATUS_INVALID_ARG;
+        }
+
+        /* Set the bits. */
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            attributes->m_cpuMask[cpu / 64] |= ((mama_u64_t)1 << (cpu % 64));
+        }
+        attributes->m_hasCpus = 1;
+
+        /* Move past the separator. */
+        if (*next == ',') {
+            next++;
+        }
+        else if (*next != '\0') {
+            return MAMA_STATUS_INVALID_ARG;
+        }
+    }
+
+    /* An empty list would leave the thread nowhere to run. */
+    return (attributes->m_hasCpus != 0) ? MAMA_STATUS_OK : MAMA_STATUS_INVALID_ARG;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_setAttributes(mmeSession* session, const mamaEnvSessionAttributes* attributes)
+{
+    /* Validate what can be validated now, so that the caller sees the error. */
+    if ((attributes->m_threadNumaNode < -1) || (attributes->m_threadNumaNode >= MMES_MAX_NUMA_NODES) || (attributes->m_fifoPriority < 0)) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+    if ((attributes->m_setNice != 0) && ((attributes->m_nice < -20) || (attributes->m_nice > 19))) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+    if ((attributes->m_dispatchMode < mamaEnvDispatchBlocking) || (attributes->m_dispatchMode > mamaEnvDispatchWorkerPool)) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    /* The spin time is held in nanoseconds, so it must be a number that fits. */
+    if (!mamaEnv_isValidInterval(attributes->m_spinTime)) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+    if ((attributes->m_dispatchMode == mamaEnvDispatchWorkerPool) && (__atomic_load_n(&session->m_connection->m_workerPool, __ATOMIC_ACQUIRE) == NULL)) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    /* Application dispatched and worker pool sessions have no thread of their own to place. */
+    if (((attributes->m_dispatchMode == mamaEnvDispatchApplication) || (attributes->m_dispatchMode == mamaEnvDispatchWorkerPool)) &&
+        ((attributes->m_cpuList != NULL) || (attributes->m_threadNumaNode != -1) || (attributes->m_threadName != NULL) || (attributes->m_fifoPriority != 0) || (attributes->m_setNice != 0))) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    mmeSessionAttributes* localAttributes = (mmeSessionAttributes*)calloc(1, sizeof(mmeSessionAttributes));
+    if (localAttributes == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+
+    /* Copy the attributes, the strings belong to the caller. */
+    mama_status ret = MAMA_STATUS_OK;
+    if (attributes->m_cpuList != NULL) {
+        ret = mamaEnvSession_parseCpuList(attributes->m_cpuList, localAttributes);
+    }
+    if (attributes->m_threadName != NULL) {
+        strncpy(localAttributes->m_threadName, attributes->m_threadName, sizeof(localAttributes->m_threadName) - 1);
+    }
+    localAttributes->m_threadNumaNode = attributes->m_threadNumaNode;
+    localAttributes->m_fifoPriority = attributes->m_fifoPriority;
+    localAttributes->m_nice = attributes->m_nice;
+    localAttributes->m_setNice = attributes->m_setNice;
+    localAttributes->m_dispatchMode = attributes->m_dispatchMode;
+    localAttributes->m_spinTime = (mama_u64_t)(attributes->m_spinTime * 1000000000.0);
+
+    if (ret != MAMA_STATUS_OK) {
+        free(localAttributes);
+        return ret;
+    }
+
+    session->m_attributes = localAttributes;
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvSession_applyAttributes(mmeSession* session)
+{
+    mmeSessionAttributes* attributes = session->m_attributes;
+
+#ifdef __linux__
+    /* Name the thread first so it can be found even if the rest fails. */
+    if (attributes->m_threadName[0] != '\0') {
+        int rc = pthread_setname_np(pthread_self(), attributes->m_threadName);
+        if (rc != 0) {
+            mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSession_applyAttributes - session %p could not set thread name, error %d.", session, rc);
+        }
+    }
+
+    /* Pin the thread. */
+    if (attributes->m_hasCpus != 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; (cpu < MMES_MAX_CPUS) && (cpu < CPU_SETSIZE); cpu++) {
+            if ((attributes->m_cpuMask[cpu / 64] & ((mama_u64_t)1 << (cpu % 64))) != 0) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (rc != 0) {
+            mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSession_applyAttributes - session %p could not set CPU affinity, error %d.", session, rc);
+        }
+    }
+
+    /* Prefer the NUMA node for memory this thread allocates or first touches, (not for the
+     * wrappers, which other threads allocate), this uses the system call directly so there is
+     * no dependency on libnuma.
+     */
+    if (attributes->m_threadNumaNode >= 0) {
+        unsigned long nodes[MMES_MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+        memset(nodes, 0, sizeof(nodes));
+        nodes[attributes->m_threadNumaNode / (8 * sizeof(unsigned long))] |= 1UL << (attributes->m_threadNumaNode % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_set_mempolicy, MMES_MPOL_PREFERRED, nodes, (unsigned long)MMES_MAX_NUMA_NODES) != 0) {
+            mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSession_applyAttributes - session %p could not prefer NUMA node %d, error %d.", session, attributes->m_threadNumaNode, errno);
+        }
+    }
+
+    /* Set the nice value, which on Linux applies to just this thread. */
+    if (attributes->m_setNice != 0) {
+        if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), attributes->m_nice) != 0) {
+            mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSession_applyAttributes - session %p could not set nice %d, error %d.", session, attributes->m_nice, errno);
+        }
+    }
+
+    /* Move to the real time scheduler last, once everything else is in place. */
+    if (attributes->m_fifoPriority > 0) {
+        struct sched_param parameters;
+        memset(&parameters, 0, sizeof(parameters));
+        parameters.sched_priority = attributes->m_fifoPriority;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+        if (rc != 0) {
+            mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSession_applyAttributes - session %p could not set SCHED_FIFO priority %d, error %d.", session, attributes->m_fifoPriority, rc);
+        }
+    }
+#else
+    mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSession_applyAttributes - session %p attributes are only supported on Linux.", session);
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+int mamaEnvSession_isDispatchThread(mmeSession* session)
+{
+    /* The thread is only known once the first event has been dispatched, or for application
+     * dispatched and worker pool sessions while a thread is dispatching the queue.
+     */
+    return __atomic_load_n(&session->m_dispatchThreadKnown, __ATOMIC_ACQUIRE) && pthread_equal(session->m_dispatchThread, pthread_self());
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSession_onDispatchStart(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to the session. */
+    mmeSession* session = (mmeSession*)closure;
+    if ((session != NULL) && !mamaEnvSession_isApplicationDispatched(session) && !mamaEnvSession_isWorkerPool(session)) {
+        /* Publish the dispatch thread. */
+        session->m_dispatchThread = pthread_self();
+        __atomic_store_n(&session->m_dispatchThreadKnown, 1, __ATOMIC_RELEASE);
+
+        /* Place the thread before it dispatches anything else. */
+        if (session->m_attributes != NULL) {
+            mamaEnvSession_applyAttributes(session);
+        }
+    }
+
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - onDispatchStart with session %p.", session);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_getSessionStats(mamaEnvSession session, mamaEnvSessionStats* stats)
+{
+    if ((session == NULL) || (stats == NULL)) {
+        return MAMA_STATUS_NULL_ARG;
+    }
+
+    memset(stats, 0, sizeof(mamaEnvSessionStats));
+    stats->m_fastPathDestroys = __atomic_load_n(&session->m_fastPathDestroys, __ATOMIC_RELAXED);
+    stats->m_slowPathDestroys = __atomic_load_n(&session->m_slowPathDestroys, __ATOMIC_RELAXED);
+    stats->m_controlEvents = __atomic_load_n(&session->m_control.m_events, __ATOMIC_RELAXED);
+    stats->m_controlDelayTotal = __atomic_load_n(&session->m_control.m_totalDelay, __ATOMIC_RELAXED);
+    stats->m_controlDelayMax = __atomic_load_n(&session->m_control.m_maxDelay, __ATOMIC_RELAXED);
+    stats->m_maxQueueDepth = __atomic_load_n(&session->m_maxQueueDepth, __ATOMIC_RELAXED);
+    stats->m_highWatermarkCount = __atomic_load_n(&session->m_highWatermarkCount, __ATOMIC_RELAXED);
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvSession_recordDepth(mmeSession* session, size_t depth)
+{
+    /* This can race with the high watermark callback on another thread. */
+    mama_u64_t current = __atomic_load_n(&session->m_maxQueueDepth, __ATOMIC_RELAXED);
+    while ((depth > current) && !__atomic_compare_exchange_n(&session->m_maxQueueDepth, &current, (mama_u64_t)depth, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvSession_sampleDepth(mmeSession* session)
+{
+    size_t depth = 0;
+    if (mamaQueue_getEventCount(session->m_queue, &depth) == MAMA_STATUS_OK) {
+        mamaEnvSession_recordDepth(session, depth);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void MAMACALLTYPE mamaEnvSession_onHighWatermark(mamaQueue queue, size_t size, void* closure)
+{
+    mmeSession* session = (mmeSession*)closure;
+    mamaEnvSession_recordDepth(session, size);
+
+    /* Report the crossing once, however many enqueues the bridge reports above the mark. */
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&session->m_backpressured, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&session->m_highWatermarkCount, 1, __ATOMIC_RELAXED);
+        (session->m_backpressureCallback)((mamaEnvSession)session, mamaEnvBackpressureHigh, size, session->m_backpressureClosure);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void MAMACALLTYPE mamaEnvSession_onLowWatermark(mamaQueue queue, size_t size, void* closure)
+{
+    mmeSession* session = (mmeSession*)closure;
+
+    int expected = 1;
+    if (__atomic_compare_exchange_n(&session->m_backpressured, &expected, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        (session->m_backpressureCallback)((mamaEnvSession)session, mamaEnvBackpressureLow, size, session->m_backpressureClosure);
+    }
+}
+
+
+/* The monitor callbacks set on a session queue, the closure is the session. */
+static mamaQueueMonitorCallbacks sg_monitorCallbacks =
+{
+    mamaEnvSession_onHighWatermark,
+    mamaEnvSession_onLowWatermark
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_setSessionBackpressureCallback(mamaEnvSession session, size_t highWatermark, size_t lowWatermark, mamaEnv_onSessionBackpressureCallback callback, void* closure)
+{
+    if ((session == NULL) || (callback == NULL)) {
+        return MAMA_STATUS_NULL_ARG;
+    }
+    if ((lowWatermark < 1) || (lowWatermark >= highWatermark)) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    /* Cast the session. */
+    mmeSession* envSession = (mmeSession*)session;
+
+    /* Save the callback before mama can invoke it. */
+    envSession->m_backpressureCallback = callback;
+    envSession->m_backpressureClosure = closure;
+
+    mama_status ret = mamaQueue_setQueueMonitorCallbacks(envSession->m_queue, &sg_monitorCallbacks, (void*)envSession);
+    if (ret == MAMA_STATUS_OK) {
+        ret = mamaQueue_setLowWatermark(envSession->m_queue, lowWatermark);
+        if (ret == MAMA_STATUS_OK) {
+            ret = mamaQueue_setHighWatermark(envSession->m_queue, highWatermark);
+        }
+    }
+
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - setSessionBackpressureCallback with session %p, high %lu and low %lu completed with code %X.", envSession, (unsigned long)highWatermark, (unsigned long)lowWatermark, ret);
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_dispatchSession(mamaEnvSession session, mama_u32_t maxEvents, mama_u64_t timeout)
+{
+    if (session == NULL) {
+        return MAMA_STATUS_NULL_ARG;
+    }
+    if (!mamaEnvSession_isApplicationDispatched(session)) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    /* Only one thread may dispatch the session, and not once it has been destroyed. */
+    int expected = MMES_PUMP_IDLE;
+    if (!__atomic_compare_exchange_n(&session->m_pumpState, &expected, MMES_PUMP_PUMPING, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return MAMA_STATUS_INVALID_QUEUE;
+    }
+
+    /* This thread is the dispatch thread until it returns. */
+    session->m_dispatchThread = pthread_self();
+    __atomic_store_n(&session->m_dispatchThreadKnown, 1, __ATOMIC_RELEASE);
+
+    /* Only dispatch what is there now, so events arriving as fast as they are dispatched
+     * cannot keep the caller from the rest of its loop.
+     */
+    size_t count = 0;
+    mamaQueue_getEventCount(session->m_queue, &count);
+    mamaEnvSession_recordDepth(session, count);
+    if ((maxEvents > 0) && (count > maxEvents)) {
+        count = maxEvents;
+    }
+    for (size_t i = 0; i < count; i++) {
+        mamaQueue_dispatchEvent(session->m_queue);
+    }
+
+    /* Wait for an event if there was nothing to do. */
+    if ((count == 0) && (timeout > 0)) {
+        mamaQueue_timedDispatch(session->m_queue, timeout);
+    }
+
+    __atomic_store_n(&session->m_dispatchThreadKnown, 0, __ATOMIC_RELEASE);
+
+    /* If the session was destroyed meanwhile then this thread starts the drain. */
+    expected = MMES_PUMP_PUMPING;
+    if (!__atomic_compare_exchange_n(&session->m_pumpState, &expected, MMES_PUMP_IDLE, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        mamaEnvSession_startDrain(session);
+    }
+
+    return MAMA_STATUS_OK;
 }
 
 
@@ -579,3 +1948,26 @@ mama_status mamaEnvSession_onDestroyAllTimersCallback(void* data, void* closure)
 
     return ret;
 }
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSession_onDestroyAllSharedSubscribersCallback(void* data, void* closure)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+
+    /* Cast the closure to the session. */
+    mmeSession* session = (mmeSession*)closure;
+
+    /* Cast the data to a subscriber. */
+    mmeSharedSubscriber* subscriber = (mmeSharedSubscriber*)data;
+    if ((session != NULL) && (subscriber != NULL)) {
+        /* The subscriber has already been removed from the map. */
+        ret = mamaEnvSharedSubscription_destroy(subscriber);
+    }
+
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - onDestroyAllSharedSubscribersCallback with session %p and subscriber %p completed with code %X.", session, subscriber, ret);
+
+    return ret;
+}
@@ -0,0 +1,124 @@
+#include "mama/mamaEnvSessionGroup.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createSessionGroup(mamaEnvConnection connection, mama_u32_t numberSessions, mamaEnvSessionGroup* group)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((connection != NULL) && (group != NULL)) {
+        /* Allocate the group and its session array. */
+        ret = MAMA_STATUS_INVALID_ARG;
+        mmeSessionGroup* localGroup = NULL;
+        if (numberSessions > 0) {
+            ret = MAMA_STATUS_NOMEM;
+            localGroup = (mmeSessionGroup*)calloc(1, sizeof(mmeSessionGroup));
+            if (localGroup != NULL) {
+                localGroup->m_sessions = (mmeSession**)calloc(numberSessions, sizeof(mmeSession*));
+                if (localGroup->m_sessions != NULL) {
+                    /* Create all of the sessions in one go. */
+                    ret = mamaEnv_createSessions(connection, numberSessions, (mamaEnvSession*)localGroup->m_sessions);
+                    if (ret == MAMA_STATUS_OK) {
+                        /* Save arguments in the structure. */
+                        localGroup->m_connection = (mmeConnection*)connection;
+                        localGroup->m_numberSessions = numberSessions;
+
+                        /* The group owns its sessions, they can't be destroyed individually. */
+                        for (mama_u32_t i = 0; i < numberSessions; i++) {
+                            localGroup->m_sessions[i]->m_groupIndex = i;
+                            localGroup->m_sessions[i]->m_group = localGroup;
+                        }
+                    }
+                }
+
+                /* If something went wrong then free the group, no sessions will have been left. */
+                if (ret != MAMA_STATUS_OK) {
+                    free(localGroup->m_sessions);
+                    free(localGroup);
+                    localGroup = NULL;
+                }
+            }
+        }
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - createSessionGroup with connection %p and group %p completed with code %X.", connection, localGroup, ret);
+
+        /* Write the group back. */
+        *group = (mamaEnvSessionGroup)localGroup;
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_destroySessionGroup(mamaEnvSessionGroup group)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if (group != NULL) {
+        /* Cast the group. */
+        mmeSessionGroup* envGroup = (mmeSessionGroup*)group;
+
+        /* Destroy every session still in the group, preserving the first error. A session
+         * destroyed with its connection has already been taken out of the group.
+         */
+        ret = MAMA_STATUS_OK;
+        for (mama_u32_t i = 0; i < envGroup->m_numberSessions; i++) {
+            mmeSession* session = __atomic_exchange_n(&envGroup->m_sessions[i], NULL, __ATOMIC_ACQ_REL);
+            if (session != NULL) {
+                session->m_group = NULL;
+                mama_status mds = mamaEnvConnection_destroySession(envGroup->m_connection, session);
+                if (ret == MAMA_STATUS_OK) {
+                    ret = mds;
+                }
+            }
+        }
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINE, "MamaEnv - destroySessionGroup with group %p completed with code %X.", envGroup, ret);
+
+        /* Free the group, the sessions themselves are reclaimed by the connection. */
+        free(envGroup->m_sessions);
+        free(envGroup);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_getGroupSession(mamaEnvSessionGroup group, const char* symbol, mamaEnvSession* session)
+{
+    if ((group == NULL) || (symbol == NULL) || (session == NULL)) {
+        return MAMA_STATUS_NULL_ARG;
+    }
+
+    /* Place the symbol by its hash, the session is gone if the connection has been destroyed. */
+    mmeSessionGroup* envGroup = (mmeSessionGroup*)group;
+    *session = (mamaEnvSession)__atomic_load_n(&envGroup->m_sessions[mamaEnvHash_string(MMEH_FNV_OFFSET_BASIS, symbol) % envGroup->m_numberSessions], __ATOMIC_ACQUIRE);
+
+    return (*session != NULL) ? MAMA_STATUS_OK : MAMA_STATUS_NOT_FOUND;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createGroupBasicSubscription(const mamaMsgCallbacks* callback, void* closure, mamaEnvSessionGroup group, const char* symbol, mamaTransport transport, mamaEnvSession* session, mamaSubscription* subscription)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if (session != NULL) {
+        /* Find the session the symbol is placed on. */
+        mamaEnvSession localSession = NULL;
+        ret = mamaEnv_getGroupSession(group, symbol, &localSession);
+        if (ret == MAMA_STATUS_OK) {
+            /* Create the subscription on it. */
+            ret = mamaEnv_createBasicSubscription(callback, closure, localSession, symbol, transport, subscription);
+        }
+
+        /* Return the session so the subscription can be destroyed. */
+        *session = (ret == MAMA_STATUS_OK) ? localSession : NULL;
+    }
+
+    return ret;
+}
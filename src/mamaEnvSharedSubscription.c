@@ -0,0 +1,546 @@
+#include "mama/mamaEnvSharedSubscription.h"
+#include "mama/mamaEnvConnection.h"
+#include "mama/mamaEnvSession.h"
+#include "mamaEnvGatePrivate.h"
+#include <stdint.h>
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_createSharedSubscription(const mamaMsgCallbacks* callback, void* closure, mamaEnvSession session, const char* source, const char* symbol, mamaTransport transport, mamaEnvSharedSubscription* subscription)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((callback != NULL) && (session != NULL) && (symbol != NULL) && (transport != NULL) && (subscription != NULL)) {
+        /* Cast the session. */
+        mmeSession* envSession = (mmeSession*)session;
+
+        /* Allocate the subscriber, note that the gate starts open. */
+        ret = MAMA_STATUS_NOMEM;
+        mmeSharedSubscriber* subscriber = (mmeSharedSubscriber*)calloc(1, sizeof(mmeSharedSubscriber));
+        if (subscriber != NULL) {
+            subscriber->m_onCreate = callback->onCreate;
+            subscriber->m_onError = callback->onError;
+            subscriber->m_onMsg = callback->onMsg;
+            subscriber->m_closure = closure;
+
+            /* The subscriber holds a reference on the session until it is destroyed. */
+            subscriber->m_session = envSession;
+            mamaEnvSession_acquire(envSession);
+
+            /* Join, or create, the interest. */
+            ret = mamaEnvSharedSubscription_create(subscriber, envSession, source, symbol, transport);
+            if (ret == MAMA_STATUS_OK) {
+                /* Add the subscriber to the session so that it is destroyed with the session. */
+                ret = synchronizedMap_insert((void*)subscriber, (void*)subscriber, envSession->m_sharedSubscribers);
+                if (ret != MAMA_STATUS_OK) {
+                    mamaEnvSharedSubscription_destroy(subscriber);
+                    subscriber = NULL;
+                }
+            }
+            else {
+                mamaEnvSession_release(envSession);
+                free(subscriber);
+                subscriber = NULL;
+            }
+        }
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - createSharedSubscription with session %p and subscriber %p completed with code %X.", envSession, subscriber, ret);
+
+        /* Return the subscriber. */
+        *subscription = subscriber;
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_destroySharedSubscription(mamaEnvSession session, mamaEnvSharedSubscription subscription)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (subscription != NULL)) {
+        /* Cast the session. */
+        mmeSession* envSession = (mmeSession*)session;
+
+        /* Remove the subscriber from the session's map. */
+        mmeSharedSubscriber* subscriber = NULL;
+        ret = synchronizedMap_remove((void*)subscription, envSession->m_sharedSubscribers, (void**)&subscriber);
+
+        /* If the subscriber wasn't in the map then it has already been removed, still return OK. */
+        if (ret == MAMA_STATUS_INVALID_ARG) {
+            ret = MAMA_STATUS_OK;
+        }
+        else if ((ret == MAMA_STATUS_OK) && (subscriber != NULL)) {
+            ret = mamaEnvSharedSubscription_destroy(subscriber);
+        }
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - destroySharedSubscription with session %p and subscriber %p completed with code %X.", envSession, subscription, ret);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvInterestTable_init(mmeInterestTable* table)
+{
+    pthread_mutex_init(&table->m_lock, NULL);
+    pthread_cond_init(&table->m_ready, NULL);
+    mamaEnvHashTable_init(&table->m_interests, MMEI_INITIAL_BUCKETS);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvInterestTable_destroy(mmeInterestTable* table)
+{
+    /* Every interest has gone with its last subscriber by the time the connection is freed. */
+    mamaEnvHashTable_destroy(&table->m_interests, NULL);
+    pthread_cond_destroy(&table->m_ready);
+    pthread_mutex_destroy(&table->m_lock);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mama_u32_t mamaEnvInterestTable_hash(mamaTransport transport, const char* source, const char* symbol)
+{
+    /* FNV-1a over the source, a separator, the symbol and then the transport address. */
+    mama_u32_t hash = MMEH_FNV_OFFSET_BASIS;
+    if (source != NULL) {
+        hash = mamaEnvHash_string(hash, source);
+    }
+    hash = mamaEnvHash_string(hash, "/");
+    hash = mamaEnvHash_string(hash, symbol);
+    uintptr_t address = (uintptr_t)transport;
+
+    return mamaEnvHash_bytes(hash, &address, sizeof(address));
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mmeInterest* mamaEnvInterestTable_find(mmeInterestTable* table, mama_u32_t hash, mamaTransport transport, const char* source, const char* symbol)
+{
+    /* The table lock must be held. The hash node is the first member of the interest. */
+    for (mmeHashNode* node = mamaEnvHashTable_bucket(&table->m_interests, hash); node != NULL; node = node->m_next) {
+        mmeInterest* interest = (mmeInterest*)node;
+        if ((node->m_hash == hash) && (interest->m_transport == transport) && (strcmp(interest->m_symbol, symbol) == 0) &&
+            (((interest->m_source == NULL) && (source == NULL)) || ((interest->m_source != NULL) && (source != NULL) && (strcmp(interest->m_source, source) == 0)))) {
+            return interest;
+        }
+    }
+
+    return NULL;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvSharedSubscription_freeInterest(mmeInterest* interest)
+{
+    pthread_mutex_destroy(&interest->m_lock);
+    free(interest->m_source);
+    free(interest->m_symbol);
+    free(interest);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mama_status mamaEnvSharedSubscription_allocateInterest(mama_u32_t hash, const char* source, const char* symbol, mamaTransport transport, mmeInterest** result)
+{
+    /* The interest starts pending with the creator's reference. */
+    mmeInterest* interest = (mmeInterest*)calloc(1, sizeof(mmeInterest));
+    if (interest == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+    pthread_mutex_init(&interest->m_lock, NULL);
+    interest->m_transport = transport;
+    interest->m_node.m_hash = hash;
+    interest->m_symbol = strdup(symbol);
+    interest->m_source = (source != NULL) ? strdup(source) : NULL;
+    if ((interest->m_symbol == NULL) || ((source != NULL) && (interest->m_source == NULL))) {
+        mamaEnvSharedSubscription_freeInterest(interest);
+        return MAMA_STATUS_NOMEM;
+    }
+    interest->m_state = MMEI_PENDING;
+    interest->m_references = 1;
+
+    *result = interest;
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mama_status mamaEnvSharedSubscription_subscribeInterest(mmeSession* sharingSession, mmeInterest* interest)
+{
+    /* The one mama subscription, whose callbacks fan out to the subscribers. */
+    mmeSubscriptionCallback localCallback;
+    memset(&localCallback, 0, sizeof(mmeSubscriptionCallback));
+    localCallback.m_onCreate = (wombat_subscriptionCreateCB)mamaEnvSharedSubscription_onCreate;
+    localCallback.m_onError = (wombat_subscriptionErrorCB)mamaEnvSharedSubscription_onError;
+    localCallback.m_onMsgBasic = (wombat_subscriptionOnMsgCB)mamaEnvSharedSubscription_onMsg;
+    mama_status ret = mamaEnvSession_createSubscription(&localCallback, (void*)interest, sharingSession, interest->m_source, interest->m_symbol, interest->m_transport, Basic, NULL, &interest->m_subscription);
+    if (ret != MAMA_STATUS_OK) {
+        return ret;
+    }
+
+    /* The interest keeps the sharing session until it has destroyed its subscription. */
+    interest->m_session = sharingSession;
+    mamaEnvSession_acquire(sharingSession);
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvSharedSubscription_destroyInterest(mmeInterest* interest)
+{
+    /* This waits for any fan out in progress, which is why no lock may be held. */
+    mama_status ret = mamaEnv_destroySubscription(interest->m_session, interest->m_subscription);
+    if (ret != MAMA_STATUS_OK) {
+        mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnvSharedSubscription_destroyInterest - destroy subscription for %s failed with code %X.", interest->m_symbol, ret);
+    }
+
+    mamaEnvSession_release(interest->m_session);
+    mamaEnvSharedSubscription_freeInterest(interest);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mama_status mamaEnvSharedSubscription_releaseSubscriber(mmeSharedSubscriber* subscriber)
+{
+    /* The last reference frees the subscriber on its session queue behind any deliveries still waiting there. */
+    if (__atomic_sub_fetch(&subscriber->m_references, 1, __ATOMIC_ACQ_REL) != 0) {
+        return MAMA_STATUS_OK;
+    }
+
+    mama_status ret = mamaQueue_enqueueEvent(subscriber->m_session->m_queue, (mamaQueueEventCB)mamaEnvSharedSubscription_onSubscriberDestroy, (void*)subscriber);
+    if (ret != MAMA_STATUS_OK) {
+        mama_log(MAMA_LOG_LEVEL_ERROR, "mamaEnvSharedSubscription_releaseSubscriber - enqueue for subscriber %p failed with code %X.", subscriber, ret);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvSharedSubscription_deliver(mmeSharedSubscriber* subscriber, int type, mamaMsg message, mama_status status)
+{
+    /* The caller holds a reference on the subscriber, so it can't be freed meanwhile. */
+    mama_status ret = MAMA_STATUS_NOMEM;
+    mmeSharedDelivery* delivery = (mmeSharedDelivery*)malloc(sizeof(mmeSharedDelivery));
+    if (delivery != NULL) {
+        delivery->m_subscriber = subscriber;
+        delivery->m_type = type;
+        delivery->m_message = message;
+        delivery->m_status = status;
+        ret = mamaQueue_enqueueEvent(subscriber->m_session->m_queue, (mamaQueueEventCB)mamaEnvSharedSubscription_onDelivery, (void*)delivery);
+        if (ret != MAMA_STATUS_OK) {
+            free(delivery);
+        }
+    }
+
+    if (ret != MAMA_STATUS_OK) {
+        if (message != NULL) {
+            mamaMsg_destroy(message);
+        }
+        mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSharedSubscription_deliver - subscriber %p dropped a callback, code %X.", subscriber, ret);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvSharedSubscription_fanOut(mmeInterest* interest, int type, mamaMsg message, mama_status status)
+{
+    /* Take a reference on each subscriber under the interest lock, then copy and enqueue
+     * without it so that a slow queue doesn't hold up subscribers joining or leaving. This
+     * only runs on the sharing session's dispatch thread, so fan outs can't overtake each other.
+     */
+    mmeSharedSubscriber* local[MMEI_FANOUT_STACK];
+    mmeSharedSubscriber** subscribers = local;
+    size_t count = 0;
+
+    pthread_mutex_lock(&interest->m_lock);
+    if (type == MMEI_DELIVER_CREATE) {
+        interest->m_created = 1;
+    }
+    if (interest->m_numberSubscribers > MMEI_FANOUT_STACK) {
+        subscribers = (mmeSharedSubscriber**)malloc(interest->m_numberSubscribers * sizeof(mmeSharedSubscriber*));
+        if (subscribers == NULL) {
+            pthread_mutex_unlock(&interest->m_lock);
+            mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSharedSubscription_fanOut - interest %s dropped a callback, code %X.", interest->m_symbol, MAMA_STATUS_NOMEM);
+            return;
+        }
+    }
+    for (mmeSharedSubscriber* subscriber = interest->m_subscribers; subscriber != NULL; subscriber = subscriber->m_next) {
+        __atomic_add_fetch(&subscriber->m_references, 1, __ATOMIC_RELAXED);
+        subscribers[count++] = subscriber;
+    }
+    pthread_mutex_unlock(&interest->m_lock);
+
+    for (size_t i = 0; i < count; i++) {
+        /* Each subscriber gets its own copy, a message can't be read by two threads at once. */
+        if (message != NULL) {
+            mamaMsg copy = NULL;
+            mama_status ret = mamaMsg_copy(message, &copy);
+            if (ret == MAMA_STATUS_OK) {
+                mamaEnvSharedSubscription_deliver(subscribers[i], type, copy, status);
+            }
+            else {
+                mama_log(MAMA_LOG_LEVEL_WARN, "mamaEnvSharedSubscription_fanOut - copy for subscriber %p failed with code %X.", subscribers[i], ret);
+            }
+        }
+        else {
+            mamaEnvSharedSubscription_deliver(subscribers[i], type, NULL, status);
+        }
+        mamaEnvSharedSubscription_releaseSubscriber(subscribers[i]);
+    }
+
+    if (subscribers != local) {
+        free(subscribers);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSharedSubscription_create(mmeSharedSubscriber* subscriber, mmeSession* session, const char* source, const char* symbol, mamaTransport transport)
+{
+    mmeConnection* connection = session->m_connection;
+    mmeInterestTable* table = &connection->m_interests;
+
+    /* The hidden session that dispatches every shared mama subscription. */
+    mmeSession* sharingSession = NULL;
+    mama_status ret = mamaEnvConnection_getSharingSession(connection, &sharingSession);
+    if (ret != MAMA_STATUS_OK) {
+        return ret;
+    }
+
+    /* Find the interest, or add a pending one, so that a second subscriber to the same key
+     * waits for it rather than creating a second mama subscription.
+     */
+    mama_u32_t hash = mamaEnvInterestTable_hash(transport, source, symbol);
+    pthread_mutex_lock(&table->m_lock);
+    mmeInterest* interest = mamaEnvInterestTable_find(table, hash, transport, source, symbol);
+    if (interest == NULL) {
+        ret = mamaEnvSharedSubscription_allocateInterest(hash, source, symbol, transport, &interest);
+        if (ret == MAMA_STATUS_OK) {
+            ret = mamaEnvHashTable_add(&table->m_interests, &interest->m_node);
+            if (ret != MAMA_STATUS_OK) {
+                mamaEnvSharedSubscription_freeInterest(interest);
+            }
+        }
+        pthread_mutex_unlock(&table->m_lock);
+        if (ret != MAMA_STATUS_OK) {
+            return ret;
+        }
+
+        /* Create the mama subscription without the table lock, so that subscribers to other
+         * keys aren't held up.
+         */
+        ret = mamaEnvSharedSubscription_subscribeInterest(sharingSession, interest);
+
+        /* Publish the outcome to any subscribers that arrived meanwhile, a failed interest
+         * leaves the table and is freed by whoever drops the last reference.
+         */
+        int last = 0;
+        pthread_mutex_lock(&table->m_lock);
+        if (ret == MAMA_STATUS_OK) {
+            interest->m_state = MMEI_READY;
+        }
+        else {
+            interest->m_state = MMEI_FAILED;
+            interest->m_status = ret;
+            mamaEnvHashTable_remove(&table->m_interests, &interest->m_node);
+            last = (--interest->m_references == 0);
+        }
+        pthread_cond_broadcast(&table->m_ready);
+        pthread_mutex_unlock(&table->m_lock);
+        if (ret != MAMA_STATUS_OK) {
+            if (last) {
+                mamaEnvSharedSubscription_freeInterest(interest);
+            }
+            return ret;
+        }
+    }
+    else {
+        /* Join the interest, waiting for it if it is still being created. */
+        interest->m_references++;
+        while (interest->m_state == MMEI_PENDING) {
+            pthread_cond_wait(&table->m_ready, &table->m_lock);
+        }
+        int last = 0;
+        if (interest->m_state == MMEI_FAILED) {
+            ret = interest->m_status;
+            last = (--interest->m_references == 0);
+        }
+        pthread_mutex_unlock(&table->m_lock);
+        if (ret != MAMA_STATUS_OK) {
+            if (last) {
+                mamaEnvSharedSubscription_freeInterest(interest);
+            }
+            return ret;
+        }
+    }
+
+    /* Join the fan out. A create callback that has already been fanned out is enqueued before
+     * the subscriber is linked, so that it is ahead of every message, and one fanned out while
+     * that was being enqueued is caught on the next pass. Nothing is enqueued under the lock.
+     */
+    subscriber->m_interest = interest;
+    subscriber->m_references = 1;
+    int caughtUp = 0;
+    for (;;) {
+        pthread_mutex_lock(&interest->m_lock);
+        if (interest->m_created == caughtUp) {
+            subscriber->m_previous = NULL;
+            subscriber->m_next = interest->m_subscribers;
+            if (interest->m_subscribers != NULL) {
+                interest->m_subscribers->m_previous = subscriber;
+            }
+            interest->m_subscribers = subscriber;
+            interest->m_numberSubscribers++;
+            pthread_mutex_unlock(&interest->m_lock);
+            break;
+        }
+        pthread_mutex_unlock(&interest->m_lock);
+
+        mamaEnvSharedSubscription_deliver(subscriber, MMEI_DELIVER_CREATE, NULL, MAMA_STATUS_OK);
+        caughtUp = 1;
+    }
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSharedSubscription_destroy(mmeSharedSubscriber* subscriber)
+{
+    mmeSession* session = subscriber->m_session;
+    mmeInterest* interest = subscriber->m_interest;
+    mmeInterestTable* table = &session->m_connection->m_interests;
+
+    /* Close the gate and wait for any running callback to return. On the dispatch thread no
+     * callback can be running concurrently so there is nothing to wait for.
+     */
+    mamaEnvGate_close(&subscriber->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL);
+    if (mamaEnvSession_isDispatchThread(session)) {
+        __atomic_fetch_add(&session->m_fastPathDestroys, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_fetch_add(&session->m_slowPathDestroys, 1, __ATOMIC_RELAXED);
+        mamaEnvGate_wait(&subscriber->m_gate);
+    }
+
+    /* Leave the fan out, after which only a fan out already under way enqueues for the subscriber. */
+    pthread_mutex_lock(&interest->m_lock);
+    if (subscriber->m_previous != NULL) {
+        subscriber->m_previous->m_next = subscriber->m_next;
+    }
+    else {
+        interest->m_subscribers = subscriber->m_next;
+    }
+    if (subscriber->m_next != NULL) {
+        subscriber->m_next->m_previous = subscriber->m_previous;
+    }
+    interest->m_numberSubscribers--;
+    pthread_mutex_unlock(&interest->m_lock);
+
+    /* The last subscriber takes the interest out of the table and destroys the mama subscription. */
+    int last = 0;
+    pthread_mutex_lock(&table->m_lock);
+    if (--interest->m_references == 0) {
+        mamaEnvHashTable_remove(&table->m_interests, &interest->m_node);
+        last = 1;
+    }
+    pthread_mutex_unlock(&table->m_lock);
+    if (last) {
+        mamaEnvSharedSubscription_destroyInterest(interest);
+    }
+
+    /* Drop the list's reference, a fan out still enqueuing to the subscriber frees it instead. */
+    return mamaEnvSharedSubscription_releaseSubscriber(subscriber);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSharedSubscription_onCreate(mamaSubscription subscription, void* closure)
+{
+    mamaEnvSharedSubscription_fanOut((mmeInterest*)closure, MMEI_DELIVER_CREATE, NULL, MAMA_STATUS_OK);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSharedSubscription_onError(mamaSubscription subscription, mama_status status, void* platformError, const char* subject, void* closure)
+{
+    mamaEnvSharedSubscription_fanOut((mmeInterest*)closure, MMEI_DELIVER_ERROR, NULL, status);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSharedSubscription_onMsg(mamaSubscription subscription, mamaMsg message, void* closure, void* itemClosure)
+{
+    mamaEnvSharedSubscription_fanOut((mmeInterest*)closure, MMEI_DELIVER_MSG, message, MAMA_STATUS_OK);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSharedSubscription_onDelivery(mamaQueue queue, void* closure)
+{
+    mmeSharedDelivery* delivery = (mmeSharedDelivery*)closure;
+    mmeSharedSubscriber* subscriber = delivery->m_subscriber;
+
+    /* Enter the gate, this fails once the subscriber has been destroyed. While it is open the
+     * subscriber holds its interest, so the shared mama subscription is still there.
+     */
+    mmeGate* previous = NULL;
+    if (mamaEnvGate_enter(&subscriber->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+        mmeInterest* interest = subscriber->m_interest;
+        switch (delivery->m_type) {
+        case MMEI_DELIVER_CREATE:
+            if (subscriber->m_onCreate != NULL) {
+                (subscriber->m_onCreate)(interest->m_subscription, subscriber->m_closure);
+            }
+            break;
+        case MMEI_DELIVER_ERROR:
+            if (subscriber->m_onError != NULL) {
+                (subscriber->m_onError)(interest->m_subscription, delivery->m_status, NULL, interest->m_symbol, subscriber->m_closure);
+            }
+            break;
+        default:
+            if (subscriber->m_onMsg != NULL) {
+                (subscriber->m_onMsg)(interest->m_subscription, delivery->m_message, subscriber->m_closure, NULL);
+            }
+            break;
+        }
+
+        /* Leave the gate. */
+        mamaEnvGate_exit(&subscriber->m_gate, previous);
+    }
+
+    if (delivery->m_message != NULL) {
+        mamaMsg_destroy(delivery->m_message);
+    }
+    free(delivery);
+
+    /* Complete any waiting destroys and keep the queue depth gauge up to date. */
+    mamaEnvSession_afterCallback(subscriber->m_session, (void*)subscriber);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSharedSubscription_onSubscriberDestroy(mamaQueue queue, void* closure)
+{
+    mmeSharedSubscriber* subscriber = (mmeSharedSubscriber*)closure;
+
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - onSubscriberDestroy with subscriber %p.", subscriber);
+
+    /* Every delivery for the subscriber was ahead of this event, so nothing refers to it now. */
+    mmeSession* session = subscriber->m_session;
+    free(subscriber);
+
+    /* Drop the reference this subscriber held on its session. */
+    mamaEnvSession_release(session);
+}
@@ -1,4 +1,18 @@
 #include "mama/mamaEnvSubscription.h"
+#include "mama/mamaEnvSession.h"
+#include "mama/mamaEnvEvent.h"
+#include "mama/mamaEnvPool.h"
+#include "mama/mamaEnvTopicRouter.h"
+#include "mamaEnvGatePrivate.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Everything a basic or wildcard message reads must stay in the first cache line. */
+_Static_assert(offsetof(mmeSubscription, m_gate) + sizeof(mmeGate) <= MAMAENV_CACHE_LINE_SIZE, "m_gate must be in the first cache line");
+_Static_assert(offsetof(mmeSubscription, m_session) + sizeof(struct mmeSession*) <= MAMAENV_CACHE_LINE_SIZE, "m_session must be in the first cache line");
+_Static_assert(offsetof(mmeSubscription, m_closure) + sizeof(void*) <= MAMAENV_CACHE_LINE_SIZE, "m_closure must be in the first cache line");
+_Static_assert(offsetof(mmeSubscription, m_callback.m_onMsgBatch) + sizeof(mamaEnv_onBatchMsgCallback) <= MAMAENV_CACHE_LINE_SIZE, "the message callbacks must be in the first cache line");
+_Static_assert(sizeof(mmeSubscription) % MAMAENV_CACHE_LINE_SIZE == 0, "mmeSubscription must be a whole number of cache lines");
 
 
 /* This static struture holds all of the basic callback function pointers. */
@@ -14,6 +28,45 @@ static mamaMsgCallbacks sg_basicCallbacks =
 };
 
 
+/* This static struture holds the function pointers for a batch subscription. */
+static mamaMsgCallbacks sg_batchCallbacks =
+    {
+        (wombat_subscriptionCreateCB)mamaEnvSubscription_onCreateBasic,
+        (wombat_subscriptionErrorCB)mamaEnvSubscription_onErrorBasic,
+        (wombat_subscriptionOnMsgCB)mamaEnvSubscription_onMsgBatch,
+        NULL,
+        NULL,
+        NULL,
+        (wombat_subscriptionDestroyCB)mamaEnvSubscription_onDestroy
+};
+
+
+/* This static struture holds the function pointers for a conflated subscription. */
+static mamaMsgCallbacks sg_conflatedCallbacks =
+    {
+        (wombat_subscriptionCreateCB)mamaEnvSubscription_onCreateBasic,
+        (wombat_subscriptionErrorCB)mamaEnvSubscription_onErrorBasic,
+        (wombat_subscriptionOnMsgCB)mamaEnvSubscription_onMsgConflated,
+        NULL,
+        NULL,
+        NULL,
+        (wombat_subscriptionDestroyCB)mamaEnvSubscription_onDestroy
+};
+
+
+/* This static struture holds the function pointers for an offloaded subscription. */
+static mamaMsgCallbacks sg_offloadedCallbacks =
+    {
+        (wombat_subscriptionCreateCB)mamaEnvSubscription_onCreateBasic,
+        (wombat_subscriptionErrorCB)mamaEnvSubscription_onErrorBasic,
+        (wombat_subscriptionOnMsgCB)mamaEnvSubscription_onMsgOffloaded,
+        NULL,
+        NULL,
+        NULL,
+        (wombat_subscriptionDestroyCB)mamaEnvSubscription_onDestroy
+};
+
+
 /* This static struture holds all of the wildcard function pointers. */
 static mamaWildCardMsgCallbacks sg_wildcardCallbacks =
     {
@@ -24,6 +77,16 @@ static mamaWildCardMsgCallbacks sg_wildcardCallbacks =
 };
 
 
+/* This static struture holds the function pointers for a routed wildcard subscription. */
+static mamaWildCardMsgCallbacks sg_routedCallbacks =
+    {
+        (wombat_subscriptionCreateCB)mamaEnvSubscription_onCreateBasic,
+        (wombat_subscriptionErrorCB)mamaEnvSubscription_onErrorBasic,
+        (wombat_subscriptionWildCardOnMsgCB)mamaEnvSubscription_onMsgRouted,
+        (wombat_subscriptionDestroyCB)mamaEnvSubscription_onDestroy
+};
+
+
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnvSubscription_allocate(mmeSubscriptionCallback* callback, void* closure, mmeSubscription** subscription)
 {
@@ -31,19 +94,14 @@ mama_status mamaEnvSubscription_allocate(mmeSubscriptionCallback* callback, void
     mama_status ret = MAMA_STATUS_NOMEM;
 
     /* Allocate a new subscription object. */
-    mmeSubscription* localSubscription = (mmeSubscription*)calloc(1, sizeof(mmeSubscription));
+    mmeSubscription* localSubscription = (mmeSubscription*)mamaEnvPool_allocate(mamaEnvSubscriptionObject);
     if (localSubscription != NULL) {
-        /* Create the lock object. */
-        ret = MAMA_STATUS_PLATFORM;
-        localSubscription->m_lock = wlock_create();
-        if (localSubscription->m_lock != NULL) {
-            /* Allocate the mama subscription. */
-            ret = mamaSubscription_allocate(&localSubscription->m_subscription);
-            if (ret == MAMA_STATUS_OK) {
-                /* Save arguments in member variables. */
-                localSubscription->m_closure = closure;
-                memcpy(&localSubscription->m_callback, callback, sizeof(mmeSubscriptionCallback));
-            }
+        /* Allocate the mama subscription, note that the gate starts open. */
+        ret = mamaSubscription_allocate(&localSubscription->m_subscription);
+        if (ret == MAMA_STATUS_OK) {
+            /* Save arguments in member variables. */
+            localSubscription->m_closure = closure;
+            memcpy(&localSubscription->m_callback, callback, sizeof(mmeSubscriptionCallback));
         }
 
         /* If something went wrong then deallocate the subscription. */
@@ -61,7 +119,107 @@ mama_status mamaEnvSubscription_allocate(mmeSubscriptionCallback* callback, void
 
 
 //////////////////////////////////////////////////////////////////////////////
-mama_status mamaEnvSubscription_create(mamaQueue queue, const char* source, mmeSubscription* subscription, const char* symbol, mamaTransport transport, mmeSubscriptionType type)
+static mama_status mamaEnvSubscription_allocateBatch(mamaQueue queue, mmeSubscription* subscription, const mmeSubscriptionOptions* options)
+{
+    if (options == NULL) {
+        return MAMA_STATUS_NULL_ARG;
+    }
+
+    /* Allocate the batch along with room for the largest batch of messages. */
+    mmeSubscriptionBatch* batch = (mmeSubscriptionBatch*)calloc(1, sizeof(mmeSubscriptionBatch));
+    if (batch == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+
+    batch->m_messages = (mamaMsg*)calloc(options->m_maxBatchSize, sizeof(mamaMsg));
+    if (batch->m_messages == NULL) {
+        free(batch);
+        return MAMA_STATUS_NOMEM;
+    }
+
+    /* Save the limits. */
+    batch->m_queue = queue;
+    batch->m_maxSize = options->m_maxBatchSize;
+    batch->m_maxDelay = (mama_u64_t)(options->m_maxBatchDelay * 1000000000.0);
+
+    subscription->m_batch = batch;
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvSubscription_deliverBatch(mmeSubscription* envSubscription)
+{
+    /* The caller has already entered the gate, entering it again here would leave a nested
+     * entry that a destroy from inside the callback could never wait out.
+     */
+    mmeSubscriptionBatch* batch = envSubscription->m_batch;
+    mama_u32_t count = batch->m_count;
+    batch->m_count = 0;
+
+    /* Invoke the original callback function. */
+    if (envSubscription->m_callback.m_onMsgBatch != NULL) {
+        (envSubscription->m_callback.m_onMsgBatch)(envSubscription->m_subscription, batch->m_messages, count, envSubscription->m_closure);
+    }
+
+    /* The messages were detached so they must be destroyed here. */
+    for (mama_u32_t i = 0; i < count; i++) {
+        mamaMsg_destroy(batch->m_messages[i]);
+        batch->m_messages[i] = NULL;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mama_status mamaEnvSubscription_allocateConflation(mamaQueue queue, mmeSubscription* subscription, const mmeSubscriptionOptions* options)
+{
+    if (options == NULL) {
+        return MAMA_STATUS_NULL_ARG;
+    }
+
+    mmeSubscriptionConflation* conflation = (mmeSubscriptionConflation*)calloc(1, sizeof(mmeSubscriptionConflation));
+    if (conflation == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+
+    /* With an interval a timer is created once a message is held back, so an idle subscription
+     * doesn't keep waking the session.
+     */
+    conflation->m_queue = queue;
+    conflation->m_interval = (mama_u64_t)(options->m_conflationInterval * 1000000000.0);
+    conflation->m_seconds = options->m_conflationInterval;
+
+    subscription->m_conflation = conflation;
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvSubscription_deliverConflated(mmeSubscription* envSubscription)
+{
+    /* The caller has already entered the gate, entering it again here would leave a nested
+     * entry that a destroy from inside the callback could never wait out.
+     */
+    mmeSubscriptionConflation* conflation = envSubscription->m_conflation;
+    mamaMsg message = conflation->m_pending;
+    conflation->m_pending = NULL;
+    conflation->m_lastDelivered = mamaEnv_getMonotonicTime();
+
+    /* Invoke the original callback function. */
+    if (envSubscription->m_callback.m_onMsgBasic != NULL) {
+        (envSubscription->m_callback.m_onMsgBasic)(envSubscription->m_subscription, message, envSubscription->m_closure, NULL);
+    }
+    __atomic_store_n(&conflation->m_delivered, conflation->m_delivered + 1, __ATOMIC_RELAXED);
+
+    /* The message was detached so it must be destroyed here. */
+    mamaMsg_destroy(message);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvSubscription_create(mamaQueue queue, const char* source, mmeSubscription* subscription, const char* symbol, mamaTransport transport, mmeSubscriptionType type, const mmeSubscriptionOptions* options)
 {
     /* Returns. */
     mama_status ret = MAMA_STATUS_INVALID_ARG;
@@ -79,6 +237,54 @@ mama_status mamaEnvSubscription_create(mamaQueue queue, const char* source, mmeS
             (void*)subscription);
         break;
 
+    case Batch:
+        ret = mamaEnvSubscription_allocateBatch(queue, subscription, options);
+        if (ret == MAMA_STATUS_OK) {
+            ret = mamaSubscription_createBasic(
+                subscription->m_subscription,
+                transport,
+                queue,
+                &sg_batchCallbacks,
+                symbol,
+                (void*)subscription);
+        }
+        break;
+
+    case Conflated:
+        ret = mamaEnvSubscription_allocateConflation(queue, subscription, options);
+        if (ret == MAMA_STATUS_OK) {
+            ret = mamaSubscription_createBasic(
+                subscription->m_subscription,
+                transport,
+                queue,
+                &sg_conflatedCallbacks,
+                symbol,
+                (void*)subscription);
+        }
+        break;
+
+    case Offloaded:
+        /* The lane must be set before the first message, and is held until the subscription
+         * is freed on it.
+         */
+        ret = MAMA_STATUS_NULL_ARG;
+        if ((options != NULL) && (options->m_lane != NULL)) {
+            subscription->m_lane = options->m_lane;
+            mamaEnvSession_acquire(subscription->m_lane);
+            ret = mamaSubscription_createBasic(
+                subscription->m_subscription,
+                transport,
+                queue,
+                &sg_offloadedCallbacks,
+                symbol,
+                (void*)subscription);
+            if (ret != MAMA_STATUS_OK) {
+                mamaEnvSession_release(subscription->m_lane);
+                subscription->m_lane = NULL;
+            }
+        }
+        break;
+
     case Wildcard:
         ret = mamaSubscription_createBasicWildCard(
             subscription->m_subscription,
@@ -89,6 +295,20 @@ mama_status mamaEnvSubscription_create(mamaQueue queue, const char* source, mmeS
             symbol,
             (void*)subscription);
         break;
+
+    case Routed:
+        ret = mamaEnvTopicRouter_create(&subscription->m_router);
+        if (ret == MAMA_STATUS_OK) {
+            ret = mamaSubscription_createBasicWildCard(
+                subscription->m_subscription,
+                transport,
+                queue,
+                &sg_routedCallbacks,
+                source,
+                symbol,
+                (void*)subscription);
+        }
+        break;
     }
 
     return ret;
@@ -114,10 +334,9 @@ void MAMACALLTYPE mamaEnvSubscription_onSubscriptionDestroy(mamaQueue queue, voi
     /* Cast the closure to a subscription object. */
     mmeSubscription* subscription = (mmeSubscription*)closure;
     if (subscription != NULL) {
-        /* Acquire the lock in case anything else is using the subscription at the moment. */
-        wlock_lock(subscription->m_lock);
-
-        /* Destroy it. */
+        /* Destroy it, the gate was closed before this event was enqueued so no callback
+         * can be running.
+         */
         ret = mamaEnvSubscription_destroy(subscription);
     }
 
@@ -143,18 +362,38 @@ mama_status mamaEnvSubscription_deallocate(mmeSubscription* subscription)
             subscription->m_subscription = NULL;
         }
 
-        /* Destroy the lock. */
-        if (subscription->m_lock != NULL) {
-            wlock_unlock(subscription->m_lock);
-            int rc = wlock_destroy(subscription->m_lock);
-            if (rc != 0) {
-                mama_log(MAMA_LOG_LEVEL_SEVERE, "mamaEnvSubscription_deallocate -- got non-zero rc=%d destoying m_lock", rc);
+        /* Destroy any messages still waiting in a batch. */
+        if (subscription->m_batch != NULL) {
+            for (mama_u32_t i = 0; i < subscription->m_batch->m_count; i++) {
+                mamaMsg_destroy(subscription->m_batch->m_messages[i]);
             }
-            subscription->m_lock = NULL;
+            free(subscription->m_batch->m_messages);
+            free(subscription->m_batch);
+            subscription->m_batch = NULL;
         }
 
-        /* Free the object. */
-        free(subscription);
+        /* Stop the conflation timer and destroy any message still waiting, this is on the
+         * dispatch thread so the timer can't be firing.
+         */
+        if (subscription->m_conflation != NULL) {
+            if (subscription->m_conflation->m_timer != NULL) {
+                mamaTimer_destroy(subscription->m_conflation->m_timer);
+            }
+            if (subscription->m_conflation->m_pending != NULL) {
+                mamaMsg_destroy(subscription->m_conflation->m_pending);
+            }
+            free(subscription->m_conflation);
+            subscription->m_conflation = NULL;
+        }
+
+        /* Free the routes and interned topics. */
+        if (subscription->m_router != NULL) {
+            mamaEnvTopicRouter_destroy(subscription->m_router);
+            subscription->m_router = NULL;
+        }
+
+        /* Return the object to the pool. */
+        mamaEnvPool_free(mamaEnvSubscriptionObject, subscription);
     }
 
     return ret;
@@ -170,17 +409,18 @@ void MAMACALLTYPE mamaEnvSubscription_onCreateBasic(mamaSubscription subscriptio
     /* Cast the closure to the environment subscription object. */
     mmeSubscription* envSubscription = (mmeSubscription*)closure;
     if (envSubscription != NULL) {
-        /* Lock the subscription. */
-        wlock_lock(envSubscription->m_lock);
+        /* Enter the gate, this fails once the subscription has been destroyed. */
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_ALL, &previous)) {
+            /* Invoke the original callback function. */
+            if (envSubscription->m_callback.m_onCreate != NULL) {
+                (envSubscription->m_callback.m_onCreate)(subscription, envSubscription->m_closure);
+            }
 
-        /* Invoke the original callback function. */
-        if (envSubscription->m_callback.m_onCreate != NULL) {
-            (envSubscription->m_callback.m_onCreate)(subscription, envSubscription->m_closure);
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envSubscription->m_gate, previous);
         }
 
-        /* Unlock the subscription. */
-        wlock_unlock(envSubscription->m_lock);
-
         /* Function succeeded. */
         ret = MAMA_STATUS_OK;
     }
@@ -199,8 +439,19 @@ void MAMACALLTYPE mamaEnvSubscription_onDestroy(mamaSubscription subscription, v
     /* Cast the closure to the environment subscription object. */
     mmeSubscription* envSubscription = (mmeSubscription*)closure;
     if (envSubscription != NULL) {
-        /* Deallocate the object now that the subscription has gone. */
-        ret = mamaEnvSubscription_deallocate(envSubscription);
+        /* The destroy may have run on the control lane ahead of messages already on the session
+         * queue, which still refer to the object, so it is freed by an event behind them.
+         */
+        ret = MAMA_STATUS_OK;
+        if (envSubscription->m_session != NULL) {
+            ret = mamaQueue_enqueueEvent(envSubscription->m_session->m_queue, (mamaQueueEventCB)mamaEnvSubscription_onSubscriptionFree, (void*)envSubscription);
+            if (ret != MAMA_STATUS_OK) {
+                mama_log(MAMA_LOG_LEVEL_ERROR, "MamaEnv - Subscription_onDestroy with subscription %p failed to enqueue free with code %X.", envSubscription, ret);  // NOLINT
+            }
+        }
+        if ((envSubscription->m_session == NULL) || (ret != MAMA_STATUS_OK)) {
+            mamaEnvSubscription_onSubscriptionFree(NULL, (void*)envSubscription);
+        }
     }
 
     /* Write a mama log. */
@@ -208,6 +459,41 @@ void MAMACALLTYPE mamaEnvSubscription_onDestroy(mamaSubscription subscription, v
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onSubscriptionFree(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to the environment subscription object, every message queued on the
+     * session before mama destroyed it has now been dispatched.
+     */
+    mmeSubscription* envSubscription = (mmeSubscription*)closure;
+
+    /* An offloaded subscription may still have messages on its lane, so it is freed by an event
+     * behind them.
+     */
+    if (envSubscription->m_lane != NULL) {
+        mama_status eret = mamaQueue_enqueueEvent(envSubscription->m_lane->m_queue, (mamaQueueEventCB)mamaEnvSubscription_onOffloadRetire, (void*)envSubscription);
+        if (eret == MAMA_STATUS_OK) {
+            return;
+        }
+        mama_log(MAMA_LOG_LEVEL_ERROR, "MamaEnv - Subscription_onSubscriptionFree with subscription %p failed to enqueue retire with code %X.", envSubscription, eret);  // NOLINT
+        mamaEnvSession_release(envSubscription->m_lane);
+        envSubscription->m_lane = NULL;
+    }
+
+    /* Deallocate the object now that nothing can refer to it. */
+    struct mmeSession* session = envSubscription->m_session;
+    mama_status ret = mamaEnvSubscription_deallocate(envSubscription);
+
+    /* Drop the reference this object held on its session. */
+    if (session != NULL) {
+        mamaEnvSession_release(session);
+    }
+
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - Subscription_onSubscriptionFree with subscription %p completed with code %X.", envSubscription, ret);  // NOLINT
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 void MAMACALLTYPE mamaEnvSubscription_onErrorBasic(mamaSubscription subscription, mama_status status, void* platformError, const char* subject, void* closure)
 {
@@ -217,17 +503,18 @@ void MAMACALLTYPE mamaEnvSubscription_onErrorBasic(mamaSubscription subscription
     /* Cast the closure to the environment subscription object. */
     mmeSubscription* envSubscription = (mmeSubscription*)closure;
     if (envSubscription != NULL) {
-        /* Lock the subscription. */
-        wlock_lock(envSubscription->m_lock);
+        /* Enter the gate, this fails once the subscription has been destroyed. */
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_ALL, &previous)) {
+            /* Invoke the original callback function. */
+            if (envSubscription->m_callback.m_onError != NULL) {
+                (envSubscription->m_callback.m_onError)(subscription, status, platformError, subject, envSubscription->m_closure);
+            }
 
-        /* Invoke the original callback function. */
-        if (envSubscription->m_callback.m_onError != NULL) {
-            (envSubscription->m_callback.m_onError)(subscription, status, platformError, subject, envSubscription->m_closure);
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envSubscription->m_gate, previous);
         }
 
-        /* Unlock the subscription. */
-        wlock_unlock(envSubscription->m_lock);
-
         /* Function succeeded. */
         ret = MAMA_STATUS_OK;
     }
@@ -243,16 +530,325 @@ void MAMACALLTYPE mamaEnvSubscription_onMsgBasic(mamaSubscription subscription,
     /* Cast the closure to the environment subscription object. */
     mmeSubscription* envSubscription = (mmeSubscription*)closure;
     if (envSubscription != NULL) {
-        /* Lock the subscription. */
-        wlock_lock(envSubscription->m_lock);
+        /* Enter the gate, this fails once the subscription has been shut down or destroyed. */
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            /* Invoke the original callback function. */
+            if (envSubscription->m_callback.m_onMsgBasic != NULL) {
+                (envSubscription->m_callback.m_onMsgBasic)(subscription, message, envSubscription->m_closure, itemClosure);
+            }
 
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envSubscription->m_gate, previous);
+        }
+
+        /* Complete any waiting destroys and keep the queue depth gauge up to date. */
+        if (envSubscription->m_session != NULL) {
+            mamaEnvSession_afterCallback(envSubscription->m_session, envSubscription);
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onMsgOffloaded(mamaSubscription subscription, mamaMsg message, void* closure, void* itemClosure)
+{
+    /* Cast the closure to the environment subscription object. */
+    mmeSubscription* envSubscription = (mmeSubscription*)closure;
+    if ((envSubscription != NULL) && (envSubscription->m_lane != NULL)) {
+        /* Enter the gate, nothing is handed over once the subscription has been shut down or destroyed. */
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            mama_status ret = MAMA_STATUS_NOMEM;
+            mmeOffloadDelivery* delivery = (mmeOffloadDelivery*)malloc(sizeof(mmeOffloadDelivery));
+            if (delivery != NULL) {
+                /* Take ownership of the message so that it outlives this callback. */
+                ret = mamaMsg_detach(message);
+                if (ret == MAMA_STATUS_OK) {
+                    delivery->m_subscription = envSubscription;
+                    delivery->m_message = message;
+                    delivery->m_itemClosure = itemClosure;
+
+                    /* The lane is a queue, so the subscription's messages keep their order. */
+                    ret = mamaQueue_enqueueEvent(envSubscription->m_lane->m_queue, (mamaQueueEventCB)mamaEnvSubscription_onOffloadDelivery, (void*)delivery);
+                    if (ret != MAMA_STATUS_OK) {
+                        mamaMsg_destroy(message);
+                    }
+                }
+                if (ret != MAMA_STATUS_OK) {
+                    free(delivery);
+                }
+            }
+            if (ret != MAMA_STATUS_OK) {
+                mama_log(MAMA_LOG_LEVEL_ERROR, "MamaEnv - Subscription_onMsgOffloaded with subscription %p failed to hand over message with code %X.", envSubscription, ret);
+            }
+
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envSubscription->m_gate, previous);
+        }
+
+        /* Complete any waiting destroys and keep the queue depth gauge up to date. */
+        if (envSubscription->m_session != NULL) {
+            mamaEnvSession_afterCallback(envSubscription->m_session, envSubscription);
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onOffloadDelivery(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to the delivery. */
+    mmeOffloadDelivery* delivery = (mmeOffloadDelivery*)closure;
+    mmeSubscription* envSubscription = delivery->m_subscription;
+
+    /* Enter the gate, this fails once the subscription has been shut down or destroyed, and
+     * a destroy on another thread waits for the callback to return.
+     */
+    mmeGate* previous = NULL;
+    if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
         /* Invoke the original callback function. */
         if (envSubscription->m_callback.m_onMsgBasic != NULL) {
-            (envSubscription->m_callback.m_onMsgBasic)(subscription, message, envSubscription->m_closure, itemClosure);
+            (envSubscription->m_callback.m_onMsgBasic)(envSubscription->m_subscription, delivery->m_message, envSubscription->m_closure, delivery->m_itemClosure);
+        }
+
+        /* Leave the gate. */
+        mamaEnvGate_exit(&envSubscription->m_gate, previous);
+    }
+
+    mamaMsg_destroy(delivery->m_message);
+    free(delivery);
+
+    /* Keep the lane's queue depth gauge up to date. */
+    mamaEnvSession_afterCallback(envSubscription->m_lane, NULL);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onOffloadRetire(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to the environment subscription object, every message it handed to
+     * the lane was enqueued ahead of this so none can still refer to it.
+     */
+    mmeSubscription* envSubscription = (mmeSubscription*)closure;
+    struct mmeSession* session = envSubscription->m_session;
+    struct mmeSession* lane = envSubscription->m_lane;
+    mama_status ret = mamaEnvSubscription_deallocate(envSubscription);
+
+    /* Drop the references this object held on its session and its lane. */
+    if (session != NULL) {
+        mamaEnvSession_release(session);
+    }
+    mamaEnvSession_release(lane);
+
+    /* Write a mama log. */
+    mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - Subscription_onOffloadRetire with subscription %p completed with code %X.", envSubscription, ret);  // NOLINT
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onMsgBatch(mamaSubscription subscription, mamaMsg message, void* closure, void* itemClosure)
+{
+    /* Cast the closure to the environment subscription object. */
+    mmeSubscription* envSubscription = (mmeSubscription*)closure;
+    if ((envSubscription != NULL) && (envSubscription->m_batch != NULL)) {
+        mmeSubscriptionBatch* batch = envSubscription->m_batch;
+
+        /* Stay inside the gate until any flush event has been enqueued, so that a destroy
+         * from another thread is always enqueued after it.
+         */
+        mmeGate* previous = NULL;
+        if (!mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            return;
+        }
+
+        /* Take ownership of the message so that it outlives this callback. */
+        mama_status ret = mamaMsg_detach(message);
+        if (ret == MAMA_STATUS_OK) {
+            /* Add the message to the batch. */
+            mama_u64_t now = mamaEnv_getMonotonicTime();
+            if (batch->m_count == 0) {
+                batch->m_started = now;
+            }
+            batch->m_messages[batch->m_count++] = message;
+
+            /* Deliver now if the batch is full or the oldest message has waited long enough. */
+            if ((batch->m_count >= batch->m_maxSize) || ((batch->m_maxDelay > 0) && (now - batch->m_started >= batch->m_maxDelay))) {
+                mamaEnvSubscription_deliverBatch(envSubscription);
+            }
+
+            /* Otherwise flush once the events already on the queue have been dispatched. */
+            else if (!batch->m_flushPending) {
+                ret = mamaQueue_enqueueEvent(batch->m_queue, (mamaQueueEventCB)mamaEnvSubscription_onBatchFlush, (void*)envSubscription);
+                if (ret == MAMA_STATUS_OK) {
+                    batch->m_flushPending = 1;
+                }
+                else {
+                    mamaEnvSubscription_deliverBatch(envSubscription);
+                }
+            }
+        }
+        else {
+            mama_log(MAMA_LOG_LEVEL_ERROR, "MamaEnv - Subscription_onMsgBatch with subscription %p failed to detach message with code %X.", envSubscription, ret);
+        }
+
+        /* Leave the gate. */
+        mamaEnvGate_exit(&envSubscription->m_gate, previous);
+
+        /* Complete any waiting destroys and keep the queue depth gauge up to date. */
+        if (envSubscription->m_session != NULL) {
+            mamaEnvSession_afterCallback(envSubscription->m_session, envSubscription);
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onBatchFlush(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to the environment subscription object. */
+    mmeSubscription* envSubscription = (mmeSubscription*)closure;
+    if ((envSubscription != NULL) && (envSubscription->m_batch != NULL)) {
+        /* Deliver whatever has accumulated since the flush was enqueued, this fails once the
+         * subscription has been shut down or destroyed and the messages are then destroyed with it.
+         */
+        envSubscription->m_batch->m_flushPending = 0;
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            if (envSubscription->m_batch->m_count > 0) {
+                mamaEnvSubscription_deliverBatch(envSubscription);
+            }
+
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envSubscription->m_gate, previous);
         }
+    }
+}
 
-        /* Unlock the subscription. */
-        wlock_unlock(envSubscription->m_lock);
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onMsgConflated(mamaSubscription subscription, mamaMsg message, void* closure, void* itemClosure)
+{
+    /* Cast the closure to the environment subscription object. */
+    mmeSubscription* envSubscription = (mmeSubscription*)closure;
+    if ((envSubscription != NULL) && (envSubscription->m_conflation != NULL)) {
+        mmeSubscriptionConflation* conflation = envSubscription->m_conflation;
+
+        /* Stay inside the gate until any flush event has been enqueued, so that a destroy
+         * from another thread is always enqueued after it.
+         */
+        mmeGate* previous = NULL;
+        if (!mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            return;
+        }
+        __atomic_store_n(&conflation->m_received, conflation->m_received + 1, __ATOMIC_RELAXED);
+
+        /* Take ownership of the message so that it outlives this callback, replacing any
+         * older message that has not been delivered yet.
+         */
+        mama_status ret = mamaMsg_detach(message);
+        if (ret == MAMA_STATUS_OK) {
+            if (conflation->m_pending != NULL) {
+                mamaMsg_destroy(conflation->m_pending);
+                __atomic_store_n(&conflation->m_conflated, conflation->m_conflated + 1, __ATOMIC_RELAXED);
+            }
+            conflation->m_pending = message;
+
+            /* With an interval deliver now if the last delivery was long enough ago, otherwise
+             * the timer delivers the latest message once it is.
+             */
+            if (conflation->m_interval > 0) {
+                if (mamaEnv_getMonotonicTime() - conflation->m_lastDelivered >= conflation->m_interval) {
+                    mamaEnvSubscription_deliverConflated(envSubscription);
+                }
+                else if (conflation->m_timer == NULL) {
+                    ret = mamaTimer_create(&conflation->m_timer, conflation->m_queue, (mamaTimerCb)mamaEnvSubscription_onConflationTimer, conflation->m_seconds, (void*)envSubscription);
+                    if (ret != MAMA_STATUS_OK) {
+                        conflation->m_timer = NULL;
+                        mama_log(MAMA_LOG_LEVEL_ERROR, "MamaEnv - Subscription_onMsgConflated with subscription %p failed to create timer with code %X.", envSubscription, ret);
+                        mamaEnvSubscription_deliverConflated(envSubscription);
+                    }
+                }
+            }
+
+            /* Otherwise deliver once the events already on the queue, (including any more
+             * messages for this subscription), have been dispatched.
+             */
+            else if (!conflation->m_flushPending) {
+                ret = mamaQueue_enqueueEvent(conflation->m_queue, (mamaQueueEventCB)mamaEnvSubscription_onConflationFlush, (void*)envSubscription);
+                if (ret == MAMA_STATUS_OK) {
+                    conflation->m_flushPending = 1;
+                }
+                else {
+                    mamaEnvSubscription_deliverConflated(envSubscription);
+                }
+            }
+        }
+        else {
+            mama_log(MAMA_LOG_LEVEL_ERROR, "MamaEnv - Subscription_onMsgConflated with subscription %p failed to detach message with code %X.", envSubscription, ret);
+        }
+
+        /* Leave the gate. */
+        mamaEnvGate_exit(&envSubscription->m_gate, previous);
+
+        /* Complete any waiting destroys and keep the queue depth gauge up to date. */
+        if (envSubscription->m_session != NULL) {
+            mamaEnvSession_afterCallback(envSubscription->m_session, envSubscription);
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onConflationFlush(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to the environment subscription object. */
+    mmeSubscription* envSubscription = (mmeSubscription*)closure;
+    if ((envSubscription != NULL) && (envSubscription->m_conflation != NULL)) {
+        /* Deliver the latest message received since the flush was enqueued, this fails once the
+         * subscription has been shut down or destroyed and the message is then destroyed with it.
+         */
+        envSubscription->m_conflation->m_flushPending = 0;
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            if (envSubscription->m_conflation->m_pending != NULL) {
+                mamaEnvSubscription_deliverConflated(envSubscription);
+            }
+
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envSubscription->m_gate, previous);
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onConflationTimer(mamaTimer timer, void* closure)
+{
+    /* Cast the closure to the environment subscription object. */
+    mmeSubscription* envSubscription = (mmeSubscription*)closure;
+    if ((envSubscription != NULL) && (envSubscription->m_conflation != NULL)) {
+        /* Deliver a message the interval held back, once the interval has passed. */
+        mmeSubscriptionConflation* conflation = envSubscription->m_conflation;
+        int open = 0;
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            open = 1;
+            if ((conflation->m_pending != NULL) && (mamaEnv_getMonotonicTime() - conflation->m_lastDelivered >= conflation->m_interval)) {
+                mamaEnvSubscription_deliverConflated(envSubscription);
+            }
+
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envSubscription->m_gate, previous);
+        }
+
+        /* Stop the timer once nothing is held back, (or nothing more can be delivered), the
+         * next held message starts it again.
+         */
+        if (((conflation->m_pending == NULL) || (open == 0)) && (conflation->m_timer != NULL)) {
+            mamaTimer_destroy(conflation->m_timer);
+            conflation->m_timer = NULL;
+        }
     }
 }
 
@@ -263,16 +859,67 @@ void MAMACALLTYPE mamaEnvSubscription_onMsgWildcard(mamaSubscription subscriptio
     /* Cast the closure to the environment subscription object. */
     mmeSubscription* envSubscription = (mmeSubscription*)closure;
     if (envSubscription != NULL) {
-        /* Lock the subscription. */
-        wlock_lock(envSubscription->m_lock);
+        /* Enter the gate, this fails once the subscription has been shut down or destroyed. */
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            /* Invoke the original callback function. */
+            if (envSubscription->m_callback.m_onMsgWildcard != NULL) {
+                (envSubscription->m_callback.m_onMsgWildcard)(subscription, message, topic, envSubscription->m_closure, itemClosure);
+            }
 
-        /* Invoke the original callback function. */
-        if (envSubscription->m_callback.m_onMsgWildcard != NULL) {
-            (envSubscription->m_callback.m_onMsgWildcard)(subscription, message, topic, envSubscription->m_closure, itemClosure);
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envSubscription->m_gate, previous);
+        }
+
+        /* Complete any waiting destroys and keep the queue depth gauge up to date. */
+        if (envSubscription->m_session != NULL) {
+            mamaEnvSession_afterCallback(envSubscription->m_session, envSubscription);
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvSubscription_onMsgRouted(mamaSubscription subscription, mamaMsg message, const char* topic, void* closure, void* itemClosure)
+{
+    /* Cast the closure to the environment subscription object. */
+    mmeSubscription* envSubscription = (mmeSubscription*)closure;
+    if ((envSubscription != NULL) && (envSubscription->m_router != NULL)) {
+        /* Enter the gate, this fails once the subscription has been shut down or destroyed. */
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&envSubscription->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            /* No route callback is running now, so routes removed since the last message can go. */
+            mamaEnvTopicRouter_reclaim(envSubscription->m_router);
+
+            /* The item closure is the interned topic once mama has seen the topic, the first
+             * message for a topic interns it and hands the entry back to mama as the topic's
+             * closure, so a repeated topic costs nothing more than this NULL check.
+             */
+            mmeTopicEntry* entry = (mmeTopicEntry*)itemClosure;
+            if ((entry == NULL) && (topic != NULL)) {
+                entry = mamaEnvTopicRouter_intern(envSubscription->m_router, topic);
+                if (entry != NULL) {
+                    mamaSubscription_setTopicClosure(subscription, entry);
+                }
+            }
+
+            /* Invoke the route's callback, or the original callback function. */
+            mmeTopicRoute* route = (entry != NULL) ? mamaEnvTopicRouter_route(envSubscription->m_router, entry) : NULL;
+            if (route != NULL) {
+                (route->m_callback)(subscription, message, topic, route->m_closure);
+            }
+            else if (envSubscription->m_callback.m_onMsgWildcard != NULL) {
+                (envSubscription->m_callback.m_onMsgWildcard)(subscription, message, topic, envSubscription->m_closure, NULL);
+            }
+
+            /* Leave the gate. */
+            mamaEnvGate_exit(&envSubscription->m_gate, previous);
         }
 
-        /* Unlock the subscription. */
-        wlock_unlock(envSubscription->m_lock);
+        /* Complete any waiting destroys and keep the queue depth gauge up to date. */
+        if (envSubscription->m_session != NULL) {
+            mamaEnvSession_afterCallback(envSubscription->m_session, envSubscription);
+        }
     }
 }
 
@@ -280,10 +927,9 @@ void MAMACALLTYPE mamaEnvSubscription_onMsgWildcard(mamaSubscription subscriptio
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnvSubscription_shutdown(mmeSubscription* subscription)
 {
-    wlock_lock(subscription->m_lock);
-    subscription->m_callback.m_onMsgBasic = NULL;
-    subscription->m_callback.m_onMsgWildcard = NULL;
-    wlock_unlock(subscription->m_lock);
+    /* Stop any further message callbacks and wait for a running one to return. */
+    mamaEnvGate_close(&subscription->m_gate, MMEG_CLOSED_MSG);
+    mamaEnvGate_wait(&subscription->m_gate);
 
     return MAMA_STATUS_OK;
 }
@@ -1,4 +1,11 @@
 #include "mama/mamaEnvTimer.h"
+#include "mama/mamaEnvSession.h"
+#include "mama/mamaEnvPool.h"
+#include "mamaEnvGatePrivate.h"
+#include <stddef.h>
+
+/* Everything a tick reads must stay in the first cache line. */
+_Static_assert(offsetof(mmeTimer, m_session) + sizeof(struct mmeSession*) <= MAMAENV_CACHE_LINE_SIZE, "the fields read on every tick must be in the first cache line");
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -7,34 +14,15 @@ mama_status mamaEnvTimer_allocate(mamaTimerCb callback, void* closure, mmeTimer*
     /* Returns. */
     mama_status ret = MAMA_STATUS_NOMEM;
 
-    /* Allocate a new timer object. */
-    mmeTimer* sessionTimer = (mmeTimer*)calloc(1, sizeof(mmeTimer));
+    /* Allocate a new timer object, note that the gate starts open. */
+    mmeTimer* sessionTimer = (mmeTimer*)mamaEnvPool_allocate(mamaEnvTimerObject);
     if (sessionTimer != NULL) {
-        /* Create the lock objects. */
-        ret = MAMA_STATUS_PLATFORM;
-        sessionTimer->m_lock = wlock_create();
-        if (sessionTimer->m_lock != NULL) {
-            /* Save arguments in member variables. */
-            sessionTimer->m_callback = callback;
-            sessionTimer->m_closure = closure;
-
-            /* Success. */
-            ret = MAMA_STATUS_OK;
-        }
-        sessionTimer->m_destroyLock = NULL;
-        if (ret == MAMA_STATUS_OK) {
-            sessionTimer->m_destroyLock = wlock_create();
-            if (sessionTimer->m_destroyLock != NULL) {
-                /* Success. */
-                ret = MAMA_STATUS_OK;
-            }
-        }
+        /* Save arguments in member variables. */
+        sessionTimer->m_callback = callback;
+        sessionTimer->m_closure = closure;
 
-        /* If something went wrong then destroy the timer. */
-        if (ret != MAMA_STATUS_OK) {
-            mamaEnvTimer_destroy(sessionTimer);
-            sessionTimer = NULL;
-        }
+        /* Success. */
+        ret = MAMA_STATUS_OK;
     }
 
     /* Write back data. */
@@ -56,26 +44,8 @@ mama_status mamaEnvTimer_destroy(mmeTimer* timer)
             timer->m_timer = NULL;
         }
 
-        /* Destroy the locks. */
-        if (timer->m_lock != NULL) {
-            wlock_unlock(timer->m_lock);
-            int rc = wlock_destroy(timer->m_lock);
-            if (rc != 0) {
-                mama_log(MAMA_LOG_LEVEL_SEVERE, "mamaEnvTimer_destroy -- got non-zero rc=%d destoying m_lock", rc);
-            }
-            timer->m_lock = NULL;
-        }
-        if (timer->m_destroyLock != NULL) {
-            wlock_unlock(timer->m_destroyLock);
-            int rc = wlock_destroy(timer->m_destroyLock);
-            if (rc != 0) {
-                mama_log(MAMA_LOG_LEVEL_SEVERE, "mamaEnvTimer_destroy -- got non-zero rc=%d destoying m_destroyLock", rc);
-            }
-            timer->m_destroyLock = NULL;
-        }
-
-        /* Free the session timer object. */
-        free(timer);
+        /* Return the session timer object to the pool. */
+        mamaEnvPool_free(mamaEnvTimerObject, timer);
     }
 
     return ret;
@@ -91,14 +61,23 @@ void MAMACALLTYPE mamaEnvTimer_onTimerDestroy(mamaQueue queue, void* closure)
     /* Cast the closure to a timer object. */
     mmeTimer* timer = (mmeTimer*)closure;
     if (timer != NULL) {
-        /* Acquire the lock in case anything else is using the timer at the moment. */
-        wlock_lock(timer->m_destroyLock);
-        wlock_lock(timer->m_lock);
-
-        /* Destroy it. */
-        ret = mamaEnvTimer_destroy(timer);
+        /* Destroy the mama timer, the gate was closed before this event was enqueued so no
+         * callback can be running.
+         */
+        ret = MAMA_STATUS_OK;
+        if (timer->m_timer != NULL) {
+            ret = mamaTimer_destroy(timer->m_timer);
+            timer->m_timer = NULL;
+        }
 
-        /* Note that we do not release the lock as it has now been destroyed. */
+        /* This may have run on the control lane ahead of events already on the session queue,
+         * which still refer to the object, so it is freed by an event behind them.
+         */
+        mama_status eret = mamaQueue_enqueueEvent(queue, (mamaQueueEventCB)mamaEnvTimer_onTimerFree, (void*)timer);
+        if (eret != MAMA_STATUS_OK) {
+            mama_log(MAMA_LOG_LEVEL_ERROR, "MamaEnv - onTimerDestroy with timer %p failed to enqueue free with code %X.", timer, eret);   // NOLINT
+            mamaEnvTimer_onTimerFree(queue, (void*)timer);
+        }
     }
 
     /* Write a mama log. */
@@ -106,26 +85,45 @@ void MAMACALLTYPE mamaEnvTimer_onTimerDestroy(mamaQueue queue, void* closure)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+void MAMACALLTYPE mamaEnvTimer_onTimerFree(mamaQueue queue, void* closure)
+{
+    /* Cast the closure to a timer object, the mama timer has already been destroyed. */
+    mmeTimer* timer = (mmeTimer*)closure;
+    struct mmeSession* session = timer->m_session;
+    mamaEnvTimer_destroy(timer);
+
+    /* Drop the reference this object held on its session. */
+    if (session != NULL) {
+        mamaEnvSession_release(session);
+    }
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 void MAMACALLTYPE mamaEnvTimer_onTimerTick(mamaTimer timer, void* closure)
 {
     /* Cast the closure to the session timer object. */
     mmeTimer* sessionTimer = (mmeTimer*)closure;
     if (sessionTimer != NULL) {
-        /* Lock the timer. */
-        wlock_lock(sessionTimer->m_lock);
+        /* Enter the gate, this fails once the timer has been shut down or destroyed. Closing
+         * the gate cannot be held off by ticks, so destroy no longer needs a second lock.
+         */
+        mmeGate* previous = NULL;
+        if (mamaEnvGate_enter(&sessionTimer->m_gate, MMEG_CLOSED_MSG | MMEG_CLOSED_ALL, &previous)) {
+            /* Invoke the original callback function. */
+            if (sessionTimer->m_callback != NULL) {
+                (sessionTimer->m_callback)(timer, sessionTimer->m_closure);
+            }
 
-        /* Invoke the original callback function. */
-        if (sessionTimer->m_callback != NULL) {
-            (sessionTimer->m_callback)(timer, sessionTimer->m_closure);
+            /* Leave the gate. */
+            mamaEnvGate_exit(&sessionTimer->m_gate, previous);
         }
 
-        /* Unlock the timer. */
-        wlock_unlock(sessionTimer->m_lock);
-
-        /* Allow destroy function to grab the main lock */
-        wlock_lock(sessionTimer->m_destroyLock);
-        wlock_unlock(sessionTimer->m_destroyLock);
+        /* Complete any waiting destroys and keep the queue depth gauge up to date. */
+        if (sessionTimer->m_session != NULL) {
+            mamaEnvSession_afterCallback(sessionTimer->m_session, sessionTimer);
+        }
     }
 }
 
@@ -133,9 +131,9 @@ void MAMACALLTYPE mamaEnvTimer_onTimerTick(mamaTimer timer, void* closure)
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnvTimer_shutdown(mmeTimer* timer)
 {
-    wlock_lock(timer->m_lock);
-    timer->m_callback = NULL;
-    wlock_unlock(timer->m_lock);
+    /* Stop further ticks and wait for any running callback to return. */
+    mamaEnvGate_close(&timer->m_gate, MMEG_CLOSED_MSG);
+    mamaEnvGate_wait(&timer->m_gate);
 
     return MAMA_STATUS_OK;
 }
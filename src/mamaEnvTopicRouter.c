@@ -0,0 +1,322 @@
+#include "mama/mamaEnvTopicRouter.h"
+#include "mama/mamaEnvSubscription.h"
+#include "mama/mamaEnvSession.h"
+#include <string.h>
+
+
+/* The arguments of a route change, passed to the map callbacks below. */
+typedef struct mmeTopicRouteChange
+{
+    mamaEnvRouteType m_type;
+    const char* m_topic;
+    mamaEnv_onRoutedMsgCallback m_callback;
+    void* m_closure;
+
+} mmeTopicRouteChange;
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mama_status mamaEnv_addTopicRouteCallback(void* data, void* closure)
+{
+    mmeSubscription* envSubscription = (mmeSubscription*)data;
+    mmeTopicRouteChange* change = (mmeTopicRouteChange*)closure;
+    if (envSubscription->m_router == NULL) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    return mamaEnvTopicRouter_addRoute(envSubscription->m_router, change->m_type, change->m_topic, change->m_callback, change->m_closure);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mama_status mamaEnv_removeTopicRouteCallback(void* data, void* closure)
+{
+    mmeSubscription* envSubscription = (mmeSubscription*)data;
+    mmeTopicRouteChange* change = (mmeTopicRouteChange*)closure;
+    if (envSubscription->m_router == NULL) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    return mamaEnvTopicRouter_removeRoute(envSubscription->m_router, change->m_type, change->m_topic);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_addTopicRoute(mamaEnvSession session, mamaSubscription subscription, mamaEnvRouteType type, const char* topic, mamaEnv_onRoutedMsgCallback callback, void* closure)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (subscription != NULL) && (topic != NULL) && (callback != NULL)) {
+        /* Cast the session. */
+        mmeSession* envSession = (mmeSession*)session;
+
+        /* Change the routes under the map's lock, so that the subscription can't be destroyed meanwhile. */
+        mmeTopicRouteChange change = { type, topic, callback, closure };
+        ret = synchronizedMap_for(mamaEnv_addTopicRouteCallback, (void*)subscription, envSession->m_subscriptions, (void*)&change);
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - addTopicRoute with session %p, subscription %p and topic %s completed with code %X.", envSession, subscription, topic, ret);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_removeTopicRoute(mamaEnvSession session, mamaSubscription subscription, mamaEnvRouteType type, const char* topic)
+{
+    /* Returns. */
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (subscription != NULL) && (topic != NULL)) {
+        /* Cast the session. */
+        mmeSession* envSession = (mmeSession*)session;
+
+        /* Change the routes under the map's lock, so that the subscription can't be destroyed meanwhile. */
+        mmeTopicRouteChange change = { type, topic, NULL, NULL };
+        ret = synchronizedMap_for(mamaEnv_removeTopicRouteCallback, (void*)subscription, envSession->m_subscriptions, (void*)&change);
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - removeTopicRoute with session %p, subscription %p and topic %s completed with code %X.", envSession, subscription, topic, ret);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static mmeTopicKey* mamaEnvTopicTable_find(mmeHashTable* table, mama_u32_t hash, const char* topic)
+{
+    /* The key is the first member of each node, and the hash node the first member of the key. */
+    for (mmeHashNode* node = mamaEnvHashTable_bucket(table, hash); node != NULL; node = node->m_next) {
+        if ((node->m_hash == hash) && (strcmp(((mmeTopicKey*)node)->m_topic, topic) == 0)) {
+            return (mmeTopicKey*)node;
+        }
+    }
+
+    return NULL;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvTopicTable_freeNode(mmeHashNode* node)
+{
+    free(((mmeTopicKey*)node)->m_topic);
+    free(node);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+static void mamaEnvTopicRouter_retire(mmeTopicRouter* router, mmeTopicRoute* route)
+{
+    /* The lock must be held, the list is also read without it by mamaEnvTopicRouter_reclaim. */
+    route->m_nextRoute = router->m_retired;
+    __atomic_store_n(&router->m_retired, route, __ATOMIC_RELEASE);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvTopicRouter_create(mmeTopicRouter** router)
+{
+    mmeTopicRouter* localRouter = (mmeTopicRouter*)calloc(1, sizeof(mmeTopicRouter));
+    if (localRouter == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+    pthread_mutex_init(&localRouter->m_lock, NULL);
+    mamaEnvHashTable_init(&localRouter->m_routes, MMER_INITIAL_BUCKETS);
+    mamaEnvHashTable_init(&localRouter->m_topics, MMER_INITIAL_BUCKETS);
+
+    /* Entries start at generation 0 so each resolves its route the first time it is used. */
+    localRouter->m_generation = 1;
+
+    *router = localRouter;
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvTopicRouter_destroy(mmeTopicRouter* router)
+{
+    mamaEnvHashTable_destroy(&router->m_topics, mamaEnvTopicTable_freeNode);
+    mamaEnvHashTable_destroy(&router->m_routes, mamaEnvTopicTable_freeNode);
+
+    mmeTopicRoute* lists[2] = { router->m_prefixes, router->m_retired };
+    for (int i = 0; i < 2; i++) {
+        mmeTopicRoute* next = lists[i];
+        while (next != NULL) {
+            mmeTopicRoute* route = next;
+            next = next->m_nextRoute;
+            free(route->m_key.m_topic);
+            free(route);
+        }
+    }
+
+    pthread_mutex_destroy(&router->m_lock);
+    free(router);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvTopicRouter_addRoute(mmeTopicRouter* router, mamaEnvRouteType type, const char* topic, mamaEnv_onRoutedMsgCallback callback, void* closure)
+{
+    if ((type != mamaEnvRouteTopic) && (type != mamaEnvRoutePrefix)) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    mmeTopicRoute* route = (mmeTopicRoute*)calloc(1, sizeof(mmeTopicRoute));
+    if (route == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+    route->m_key.m_topic = strdup(topic);
+    if (route->m_key.m_topic == NULL) {
+        free(route);
+        return MAMA_STATUS_NOMEM;
+    }
+    route->m_key.m_node.m_hash = mamaEnvHash_string(MMEH_FNV_OFFSET_BASIS, topic);
+    route->m_length = strlen(topic);
+    route->m_callback = callback;
+    route->m_closure = closure;
+
+    /* A route for the same topic or prefix is replaced. */
+    mama_status ret = MAMA_STATUS_OK;
+    pthread_mutex_lock(&router->m_lock);
+    if (type == mamaEnvRouteTopic) {
+        mmeTopicRoute* existing = (mmeTopicRoute*)mamaEnvTopicTable_find(&router->m_routes, route->m_key.m_node.m_hash, topic);
+        if (existing != NULL) {
+            mamaEnvHashTable_remove(&router->m_routes, &existing->m_key.m_node);
+            mamaEnvTopicRouter_retire(router, existing);
+        }
+        ret = mamaEnvHashTable_add(&router->m_routes, &route->m_key.m_node);
+    }
+    else {
+        mmeTopicRoute** link = &router->m_prefixes;
+        while ((*link != NULL) && ((*link)->m_length > route->m_length)) {
+            link = &(*link)->m_nextRoute;
+        }
+        while ((*link != NULL) && ((*link)->m_length == route->m_length)) {
+            if (strcmp((*link)->m_key.m_topic, topic) == 0) {
+                mmeTopicRoute* existing = *link;
+                *link = existing->m_nextRoute;
+                mamaEnvTopicRouter_retire(router, existing);
+                break;
+            }
+            link = &(*link)->m_nextRoute;
+        }
+        route->m_nextRoute = *link;
+        *link = route;
+    }
+    if (ret == MAMA_STATUS_OK) {
+        __atomic_store_n(&router->m_generation, router->m_generation + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&router->m_lock);
+
+    if (ret != MAMA_STATUS_OK) {
+        free(route->m_key.m_topic);
+        free(route);
+    }
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvTopicRouter_removeRoute(mmeTopicRouter* router, mamaEnvRouteType type, const char* topic)
+{
+    mama_status ret = MAMA_STATUS_NOT_FOUND;
+
+    pthread_mutex_lock(&router->m_lock);
+    if (type == mamaEnvRouteTopic) {
+        mmeTopicRoute* existing = (mmeTopicRoute*)mamaEnvTopicTable_find(&router->m_routes, mamaEnvHash_string(MMEH_FNV_OFFSET_BASIS, topic), topic);
+        if (existing != NULL) {
+            mamaEnvHashTable_remove(&router->m_routes, &existing->m_key.m_node);
+            mamaEnvTopicRouter_retire(router, existing);
+            ret = MAMA_STATUS_OK;
+        }
+    }
+    else {
+        for (mmeTopicRoute** link = &router->m_prefixes; *link != NULL; link = &(*link)->m_nextRoute) {
+            if (strcmp((*link)->m_key.m_topic, topic) == 0) {
+                mmeTopicRoute* existing = *link;
+                *link = existing->m_nextRoute;
+                mamaEnvTopicRouter_retire(router, existing);
+                ret = MAMA_STATUS_OK;
+                break;
+            }
+        }
+    }
+    if (ret == MAMA_STATUS_OK) {
+        __atomic_store_n(&router->m_generation, router->m_generation + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&router->m_lock);
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvTopicRouter_freeRetired(mmeTopicRouter* router)
+{
+    /* Take the whole list, every entry still pointing at one of these routes was cached at an
+     * older generation so it resolves again before using the route.
+     */
+    pthread_mutex_lock(&router->m_lock);
+    mmeTopicRoute* next = router->m_retired;
+    router->m_retired = NULL;
+    pthread_mutex_unlock(&router->m_lock);
+
+    while (next != NULL) {
+        mmeTopicRoute* route = next;
+        next = next->m_nextRoute;
+        free(route->m_key.m_topic);
+        free(route);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mmeTopicEntry* mamaEnvTopicRouter_intern(mmeTopicRouter* router, const char* topic)
+{
+    /* Only the dispatch thread uses the topic table so no lock is needed. */
+    __atomic_store_n(&router->m_lookups, router->m_lookups + 1, __ATOMIC_RELAXED);
+    mama_u32_t hash = mamaEnvHash_string(MMEH_FNV_OFFSET_BASIS, topic);
+    mmeTopicEntry* entry = (mmeTopicEntry*)mamaEnvTopicTable_find(&router->m_topics, hash, topic);
+    if (entry != NULL) {
+        return entry;
+    }
+
+    entry = (mmeTopicEntry*)calloc(1, sizeof(mmeTopicEntry));
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->m_key.m_topic = strdup(topic);
+    entry->m_key.m_node.m_hash = hash;
+    if ((entry->m_key.m_topic == NULL) || (mamaEnvHashTable_add(&router->m_topics, &entry->m_key.m_node) != MAMA_STATUS_OK)) {
+        free(entry->m_key.m_topic);
+        free(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvTopicRouter_resolve(mmeTopicRouter* router, mmeTopicEntry* entry)
+{
+    /* A topic route wins over a prefix route, and a longer prefix over a shorter one. */
+    pthread_mutex_lock(&router->m_lock);
+    __atomic_store_n(&router->m_lookups, router->m_lookups + 1, __ATOMIC_RELAXED);
+    const char* topic = entry->m_key.m_topic;
+    mmeTopicRoute* route = (mmeTopicRoute*)mamaEnvTopicTable_find(&router->m_routes, entry->m_key.m_node.m_hash, topic);
+    if (route == NULL) {
+        for (mmeTopicRoute* prefix = router->m_prefixes; prefix != NULL; prefix = prefix->m_nextRoute) {
+            if (strncmp(topic, prefix->m_key.m_topic, prefix->m_length) == 0) {
+                route = prefix;
+                break;
+            }
+        }
+    }
+    entry->m_route = route;
+    entry->m_generation = router->m_generation;
+    pthread_mutex_unlock(&router->m_lock);
+}
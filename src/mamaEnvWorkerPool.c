@@ -0,0 +1,143 @@
+#include "mama/mamaEnvWorkerPool.h"
+#include "mama/mamaEnvSession.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvWorkerPool_create(mama_u32_t numberWorkers, mmeWorkerPool** pool)
+{
+    /* Allocate the pool and its thread array. */
+    mmeWorkerPool* localPool = (mmeWorkerPool*)calloc(1, sizeof(mmeWorkerPool));
+    if (localPool == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+    localPool->m_threads = (pthread_t*)calloc(numberWorkers, sizeof(pthread_t));
+    if (localPool->m_threads == NULL) {
+        free(localPool);
+        return MAMA_STATUS_NOMEM;
+    }
+    pthread_mutex_init(&localPool->m_lock, NULL);
+    pthread_cond_init(&localPool->m_ready, NULL);
+    pthread_cond_init(&localPool->m_released, NULL);
+
+    /* Start the workers, they wait for sessions to be scheduled. */
+    mama_status ret = MAMA_STATUS_OK;
+    for (mama_u32_t i = 0; i < numberWorkers; i++) {
+        if (pthread_create(&localPool->m_threads[i], NULL, mamaEnvWorkerPool_workerThread, (void*)localPool) != 0) {
+            ret = MAMA_STATUS_PLATFORM;
+            break;
+        }
+        localPool->m_numberThreads++;
+    }
+
+    /* If something went wrong then stop whatever was started. */
+    if (ret != MAMA_STATUS_OK) {
+        mamaEnvWorkerPool_destroy(localPool);
+        localPool = NULL;
+    }
+
+    /* Write the pool back. */
+    *pool = localPool;
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnvWorkerPool_destroy(mmeWorkerPool* pool)
+{
+    /* Every session using the pool has been destroyed, so the run queue is empty. */
+    pthread_mutex_lock(&pool->m_lock);
+    pool->m_stop = 1;
+    pthread_cond_broadcast(&pool->m_ready);
+    pthread_mutex_unlock(&pool->m_lock);
+
+    for (mama_u32_t i = 0; i < pool->m_numberThreads; i++) {
+        pthread_join(pool->m_threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->m_released);
+    pthread_cond_destroy(&pool->m_ready);
+    pthread_mutex_destroy(&pool->m_lock);
+    free(pool->m_threads);
+    free(pool);
+
+    return MAMA_STATUS_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvWorkerPool_schedule(mmeWorkerPool* pool, struct mmeSession* session)
+{
+    /* Add the session to the back of the run queue and wake a worker for it. */
+    pthread_mutex_lock(&pool->m_lock);
+    session->m_nextScheduled = NULL;
+    if (pool->m_tail != NULL) {
+        pool->m_tail->m_nextScheduled = session;
+    }
+    else {
+        pool->m_head = session;
+    }
+    pool->m_tail = session;
+    pthread_cond_signal(&pool->m_ready);
+    pthread_mutex_unlock(&pool->m_lock);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void mamaEnvWorkerPool_waitClosed(mmeWorkerPool* pool, struct mmeSession* session)
+{
+    /* Wait for the worker holding the session to let it go idle, so that it can be closed. Only
+     * the schedule state is touched under the pool lock, an enqueue takes the pool lock from
+     * within the queue.
+     */
+    pthread_mutex_lock(&pool->m_lock);
+    __atomic_add_fetch(&pool->m_waiters, 1, __ATOMIC_SEQ_CST);
+    while (mamaEnvSession_closeSchedule(session) != MAMA_STATUS_OK) {
+        pthread_cond_wait(&pool->m_released, &pool->m_lock);
+    }
+    __atomic_sub_fetch(&pool->m_waiters, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&pool->m_lock);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+void* mamaEnvWorkerPool_workerThread(void* closure)
+{
+    mmeWorkerPool* pool = (mmeWorkerPool*)closure;
+
+    pthread_mutex_lock(&pool->m_lock);
+    while (pool->m_stop == 0) {
+        /* Wait for a session with events. */
+        mmeSession* session = pool->m_head;
+        if (session == NULL) {
+            pthread_cond_wait(&pool->m_ready, &pool->m_lock);
+            continue;
+        }
+        pool->m_head = session->m_nextScheduled;
+        if (pool->m_head == NULL) {
+            pool->m_tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->m_lock);
+
+        /* A session is only ever on the run queue once, so no other worker can be
+         * dispatching it now.
+         */
+        if (mamaEnvSession_runScheduled(session)) {
+            mamaEnvWorkerPool_schedule(pool, session);
+            pthread_mutex_lock(&pool->m_lock);
+            continue;
+        }
+
+        /* The session went idle, wake anyone waiting to close it. The session is not touched,
+         * it may already have been destroyed.
+         */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&pool->m_lock);
+        if (__atomic_load_n(&pool->m_waiters, __ATOMIC_RELAXED) > 0) {
+            pthread_cond_broadcast(&pool->m_released);
+        }
+    }
+    pthread_mutex_unlock(&pool->m_lock);
+
+    return NULL;
+}
@@ -36,7 +36,7 @@ mama_status mamaEnv_shutdownSession(mamaEnvConnection connection, mamaEnvSession
 mama_status mamaEnv_shutdownSubscriptionCallback(void* data, void* closure)
 {
     mmeSubscription* subscription = (mmeSubscription*)data;
-    return mamaEnvSubscription_shutdown(subscription);
+    return mamaEnvSession_shutdownSubscription((mmeSession*)closure, subscription);
 }
 
 
@@ -47,7 +47,7 @@ mama_status mamaEnv_shutdownSubscription(mamaEnvSession session, mamaSubscriptio
     if ((session != NULL) && (subscription != NULL)) {
         // use _for here to ensure that callback is done under control of map's mutex
         // this avoids a race when an event object is being shutdown at the same time it is being deleted from its parent session
-        ret = synchronizedMap_for(mamaEnv_shutdownSubscriptionCallback, subscription, session->m_subscriptions, NULL);
+        ret = synchronizedMap_for(mamaEnv_shutdownSubscriptionCallback, subscription, session->m_subscriptions, (void*)session);
 
         /* Write a mama log. */
         mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - shutdownSubscription with session %p and subscription %p completed with code %X.", session, subscription, ret);
@@ -56,11 +56,33 @@ mama_status mamaEnv_shutdownSubscription(mamaEnvSession session, mamaSubscriptio
     return ret;
 }
 
+
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_shutdownSubscriptions(mamaEnvSession session, mamaSubscription* subscriptions, mama_u32_t count)
+{
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (subscriptions != NULL)) {
+        mama_status* statuses = (mama_status*)calloc(count + 1, sizeof(mama_status));
+        if (statuses == NULL) {
+            return MAMA_STATUS_NOMEM;
+        }
+
+        /* As mamaEnv_shutdownSubscription, but each map lock is taken once for the whole array. */
+        ret = synchronizedMap_forEachKey(mamaEnv_shutdownSubscriptionCallback, (void**)subscriptions, count, session->m_subscriptions, (void*)session, statuses);
+        free(statuses);
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - shutdownSubscriptions with session %p and %u subscriptions completed with code %X.", session, count, ret);
+    }
+
+    return ret;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnv_shutdownInboxCallback(void* data, void* closure)
 {
     mmeInbox* inbox = (mmeInbox*)data;
-    return mamaEnvInbox_shutdown(inbox);
+    return mamaEnvSession_shutdownInbox((mmeSession*)closure, inbox);
 }
 
 
@@ -72,7 +94,7 @@ mama_status mamaEnv_shutdownInbox(mamaEnvSession session, mamaInbox inbox)
     if ((session != NULL) && (inbox != NULL)) {
         // use _for here to ensure that callback is done under control of map's mutex
         // this avoids a race when an event object is being shutdown at the same time it is being deleted from its parent session
-        ret = synchronizedMap_for(mamaEnv_shutdownInboxCallback, inbox, session->m_inboxes, NULL);
+        ret = synchronizedMap_for(mamaEnv_shutdownInboxCallback, inbox, session->m_inboxes, (void*)session);
 
         /* Write a mama log. */
         mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - shutdownInbox with session %p and inbox %p completed with code %X.", session, inbox, ret);
@@ -82,11 +104,33 @@ mama_status mamaEnv_shutdownInbox(mamaEnvSession session, mamaInbox inbox)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_shutdownInboxes(mamaEnvSession session, mamaInbox* inboxes, mama_u32_t count)
+{
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (inboxes != NULL)) {
+        mama_status* statuses = (mama_status*)calloc(count + 1, sizeof(mama_status));
+        if (statuses == NULL) {
+            return MAMA_STATUS_NOMEM;
+        }
+
+        /* As mamaEnv_shutdownInbox, but each map lock is taken once for the whole array. */
+        ret = synchronizedMap_forEachKey(mamaEnv_shutdownInboxCallback, (void**)inboxes, count, session->m_inboxes, (void*)session, statuses);
+        free(statuses);
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - shutdownInboxes with session %p and %u inboxes completed with code %X.", session, count, ret);
+    }
+
+    return ret;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 mama_status mamaEnv_shutdownTimerCallback(void* data, void* closure)
 {
     mmeTimer* timer = (mmeTimer*)data;
-    return mamaEnvTimer_shutdown(timer);
+    return mamaEnvSession_shutdownTimer((mmeSession*)closure, timer);
 }
 
 
@@ -97,7 +141,7 @@ mama_status mamaEnv_shutdownTimer(mamaEnvSession session, mamaTimer timer)
     if ((session != NULL) && (timer != NULL)) {
         // use _for here to ensure that callback is done under control of map's mutex
         // this avoids a race when an event object is being shutdown at the same time it is being deleted from its parent session
-        ret = synchronizedMap_for(mamaEnv_shutdownTimerCallback, timer, session->m_timers, NULL);
+        ret = synchronizedMap_for(mamaEnv_shutdownTimerCallback, timer, session->m_timers, (void*)session);
 
         /* Write a mama log. */
         mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - shutdownTimer with session %p and timer %p completed with code %X.", session, timer, ret);
@@ -107,3 +151,25 @@ mama_status mamaEnv_shutdownTimer(mamaEnvSession session, mamaTimer timer)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+mama_status mamaEnv_shutdownTimers(mamaEnvSession session, mamaTimer* timers, mama_u32_t count)
+{
+    mama_status ret = MAMA_STATUS_NULL_ARG;
+    if ((session != NULL) && (timers != NULL)) {
+        mama_status* statuses = (mama_status*)calloc(count + 1, sizeof(mama_status));
+        if (statuses == NULL) {
+            return MAMA_STATUS_NOMEM;
+        }
+
+        /* As mamaEnv_shutdownTimer, but each map lock is taken once for the whole array. */
+        ret = synchronizedMap_forEachKey(mamaEnv_shutdownTimerCallback, (void**)timers, count, session->m_timers, (void*)session, statuses);
+        free(statuses);
+
+        /* Write a mama log. */
+        mama_log(MAMA_LOG_LEVEL_FINER, "MamaEnv - shutdownTimers with session %p and %u timers completed with code %X.", session, count, ret);
+    }
+
+    return ret;
+}
+
+
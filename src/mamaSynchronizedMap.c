@@ -3,6 +3,26 @@
 /* ********************************************************** */
 #include "mama/mamaSynchronizedMap.h"
 #include <assert.h>
+#include <stdint.h>
+
+/* ********************************************************** */
+/* Definitions. */
+/* ********************************************************** */
+
+/* The number of slots allocated when the first entry is added to a hash table. */
+#define MSM_MIN_CAPACITY 16
+
+/* The number of old table slots migrated on each insert or remove while the
+ * table is being grown. This must be at least 4/3 so that the migration always
+ * completes before the new table itself needs to grow.
+ */
+#define MSM_REHASH_STEP 4
+
+/* Marks a removed slot in the old table so that probe sequences are not broken,
+ * (entries are only ever removed from the old table, never inserted).
+ */
+static char sg_tombstone;
+#define MSM_TOMBSTONE ((void*)&sg_tombstone)
 
 /* ********************************************************** */
 /* Private Function Prototypes. */
@@ -33,11 +53,441 @@ int synchronizedMap_compare(RedBlackTreeEntry* lhs, RedBlackTreeEntry* rhs)
     return ret;
 }
 
+static uint64_t synchronizedMap_hash(void* key)
+{
+    /* Pointers are aligned so the low bits carry no information, mix all of the
+     * bits so that the low bits of the result can be used as the slot index.
+     */
+    uint64_t h = (uint64_t)(uintptr_t)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+static size_t synchronizedMap_shardIndex(void* key, SynchronizedMap* map)
+{
+    /* Use the high bits so the shard is independent of the slot within the shard. */
+    return (size_t)(synchronizedMap_hash(key) >> 32) & (map->m_numberShards - 1);
+}
+
+static SynchronizedMap* synchronizedMap_shard(void* key, SynchronizedMap* map)
+{
+    return map->m_shards[synchronizedMap_shardIndex(key, map)];
+}
+
+static PointerHashSlot* synchronizedMap_tableFind(PointerHashTable* table, void* key)
+{
+    if (table->m_used == 0) {
+        return NULL;
+    }
+
+    /* Probe from the home slot until the key or an empty slot is found. */
+    size_t mask = table->m_capacity - 1;
+    size_t index = (size_t)synchronizedMap_hash(key) & mask;
+    while (table->m_slots[index].m_key != NULL) {
+        if (table->m_slots[index].m_key == key) {
+            return &table->m_slots[index];
+        }
+        index = (index + 1) & mask;
+    }
+
+    return NULL;
+}
+
+static int synchronizedMap_tableInsert(PointerHashTable* table, void* key, void* data)
+{
+    /* Probe from the home slot, the caller guarantees that there is a free slot. */
+    size_t mask = table->m_capacity - 1;
+    size_t index = (size_t)synchronizedMap_hash(key) & mask;
+    while (table->m_slots[index].m_key != NULL) {
+        /* If the key is already present just replace the data. */
+        if (table->m_slots[index].m_key == key) {
+            table->m_slots[index].m_data = data;
+            return 0;
+        }
+        index = (index + 1) & mask;
+    }
+
+    table->m_slots[index].m_key = key;
+    table->m_slots[index].m_data = data;
+    table->m_used++;
+
+    return 1;
+}
+
+static void synchronizedMap_tableErase(PointerHashTable* table, PointerHashSlot* slot)
+{
+    /* Backward shift deletion, move any following entries that would no longer be
+     * reachable from their home slot into the hole, so that no tombstones are needed.
+     */
+    size_t mask = table->m_capacity - 1;
+    size_t hole = (size_t)(slot - table->m_slots);
+    size_t next = hole;
+    for (;;) {
+        next = (next + 1) & mask;
+        void* key = table->m_slots[next].m_key;
+        if (key == NULL) {
+            break;
+        }
+
+        /* Leave the entry where it is if its home slot lies cyclically in (hole, next]. */
+        size_t home = (size_t)synchronizedMap_hash(key) & mask;
+        if ((hole <= next) ? ((hole < home) && (home <= next)) : ((hole < home) || (home <= next))) {
+            continue;
+        }
+
+        table->m_slots[hole] = table->m_slots[next];
+        hole = next;
+    }
+
+    table->m_slots[hole].m_key = NULL;
+    table->m_slots[hole].m_data = NULL;
+    table->m_used--;
+}
+
+static void synchronizedMap_rehashStep(SynchronizedMap* map, size_t steps)
+{
+    PointerHashTable* old = &map->m_oldTable;
+    while ((old->m_slots != NULL) && (steps > 0)) {
+        /* Free the old table once every slot has been migrated. */
+        if ((map->m_rehashIndex >= old->m_capacity) || (old->m_used == 0)) {
+            free(old->m_slots);
+            memset(old, 0, sizeof(PointerHashTable));
+            map->m_rehashIndex = 0;
+            break;
+        }
+
+        /* Move a live entry into the new table, leaving a tombstone behind. */
+        PointerHashSlot* slot = &old->m_slots[map->m_rehashIndex++];
+        if ((slot->m_key != NULL) && (slot->m_key != MSM_TOMBSTONE)) {
+            synchronizedMap_tableInsert(&map->m_table, slot->m_key, slot->m_data);
+            slot->m_key = MSM_TOMBSTONE;
+            slot->m_data = NULL;
+            old->m_used--;
+        }
+
+        steps--;
+    }
+}
+
+static mama_status synchronizedMap_hashGrow(SynchronizedMap* map)
+{
+    /* Complete any outstanding migration so there is only ever one old table. */
+    if (map->m_oldTable.m_slots != NULL) {
+        synchronizedMap_rehashStep(map, map->m_oldTable.m_capacity + 1);
+    }
+
+    /* Double the capacity. */
+    size_t capacity = (map->m_table.m_capacity == 0) ? MSM_MIN_CAPACITY : (map->m_table.m_capacity * 2);
+    PointerHashSlot* slots = (PointerHashSlot*)calloc(capacity, sizeof(PointerHashSlot));
+    if (slots == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+
+    /* The current table becomes the old table and is migrated incrementally. */
+    if (map->m_table.m_used > 0) {
+        map->m_oldTable = map->m_table;
+        map->m_rehashIndex = 0;
+    }
+    else {
+        free(map->m_table.m_slots);
+    }
+
+    map->m_table.m_slots = slots;
+    map->m_table.m_capacity = capacity;
+    map->m_table.m_used = 0;
+
+    return MAMA_STATUS_OK;
+}
+
+static mama_status synchronizedMap_hashInsert(void* data, void* key, SynchronizedMap* map, int* added)
+{
+    /* Grow the table when it would become more than three quarters full. */
+    if ((map->m_table.m_used + 1) * 4 > map->m_table.m_capacity * 3) {
+        mama_status ret = synchronizedMap_hashGrow(map);
+        if (ret != MAMA_STATUS_OK) {
+            return ret;
+        }
+    }
+
+    /* Spread the cost of any migration across the calls. */
+    synchronizedMap_rehashStep(map, MSM_REHASH_STEP);
+
+    /* A key still waiting to be migrated is moved across now. */
+    int existing = 0;
+    PointerHashSlot* slot = synchronizedMap_tableFind(&map->m_oldTable, key);
+    if (slot != NULL) {
+        slot->m_key = MSM_TOMBSTONE;
+        slot->m_data = NULL;
+        map->m_oldTable.m_used--;
+        existing = 1;
+    }
+
+    *added = synchronizedMap_tableInsert(&map->m_table, key, data) && !existing;
+
+    return MAMA_STATUS_OK;
+}
+
+static int synchronizedMap_hashRemove(void* key, SynchronizedMap* map, void** data)
+{
+    synchronizedMap_rehashStep(map, MSM_REHASH_STEP);
+
+    /* Look in the current table first. */
+    PointerHashSlot* slot = synchronizedMap_tableFind(&map->m_table, key);
+    if (slot != NULL) {
+        *data = slot->m_data;
+        synchronizedMap_tableErase(&map->m_table, slot);
+        return 1;
+    }
+
+    /* Then in the table being migrated. */
+    slot = synchronizedMap_tableFind(&map->m_oldTable, key);
+    if (slot != NULL) {
+        *data = slot->m_data;
+        slot->m_key = MSM_TOMBSTONE;
+        slot->m_data = NULL;
+        map->m_oldTable.m_used--;
+        return 1;
+    }
+
+    return 0;
+}
+
+static PointerHashSlot* synchronizedMap_hashFind(void* key, SynchronizedMap* map)
+{
+    PointerHashSlot* slot = synchronizedMap_tableFind(&map->m_table, key);
+    if (slot == NULL) {
+        slot = synchronizedMap_tableFind(&map->m_oldTable, key);
+    }
+
+    return slot;
+}
+
+static mama_status synchronizedMap_tableForeach(PointerHashTable* table, synchronizedMap_Callback callback, void* closure, int ignoreErrors, mama_status* ret)
+{
+    for (size_t i = 0; (table->m_slots != NULL) && (i < table->m_capacity); i++) {
+        PointerHashSlot* slot = &table->m_slots[i];
+        if ((slot->m_key == NULL) || (slot->m_key == MSM_TOMBSTONE)) {
+            continue;
+        }
+
+        /* Invoke the callback function for this entry. */
+        mama_status cbret = MAMA_STATUS_OK;
+        if (NULL != callback) {
+            cbret = (*callback)(slot->m_data, closure);
+        }
+
+        /* Save the return code. */
+        if (MAMA_STATUS_OK == *ret) {
+            *ret = cbret;
+        }
+
+        /* Quit out if we are not ignoring errors. */
+        if ((0 == ignoreErrors) && (MAMA_STATUS_OK != *ret)) {
+            break;
+        }
+    }
+
+    return *ret;
+}
+
+static mama_status synchronizedMap_linkEntry(RedBlackTreeEntry* treeEntry, void* data, void* key, SynchronizedMap* map)
+{
+    /* Save the data in the entry. */
+    treeEntry->m_data = data;
+    treeEntry->m_key = key;
+
+    /* Acquire the lock first. */
+    wlock_lock(map->m_lock);
+
+    /* Add the data object to the tree. */
+    RB_INSERT(mamaEnvSynchMap_, &map->m_tree, treeEntry);
+
+    /* Increment the number of entries. */
+    map->m_numberEntries++; // NOLINT
+
+    /* Release the lock. */
+    wlock_unlock(map->m_lock);
+
+    return MAMA_STATUS_OK;
+}
+
+/* One operation of a batch, called with the lock of the map, (or shard), already held. */
+typedef void* (*synchronizedMap_BatchKey)(size_t index, void* context);
+typedef mama_status (*synchronizedMap_BatchOp)(SynchronizedMap* map, size_t index, void* context);
+
+static mama_status synchronizedMap_batch(SynchronizedMap* map, size_t count, synchronizedMap_BatchKey key, synchronizedMap_BatchOp op, void* context, mama_status* results)
+{
+    /* Returns the first error. */
+    mama_status ret = MAMA_STATUS_OK;
+
+    if (map->m_shards == NULL) {
+        wlock_lock(map->m_lock);
+        for (size_t i = 0; i < count; i++) {
+            results[i] = (*op)(map, i, context);
+            if ((results[i] != MAMA_STATUS_OK) && (ret == MAMA_STATUS_OK)) {
+                ret = results[i];
+            }
+        }
+        wlock_unlock(map->m_lock);
+
+        return ret;
+    }
+
+    /* Each shard is locked once, taking its operations in their original order. */
+    size_t* shards = (size_t*)malloc((count + 1) * sizeof(size_t));
+    if (shards == NULL) {
+        for (size_t i = 0; i < count; i++) {
+            results[i] = MAMA_STATUS_NOMEM;
+        }
+        return MAMA_STATUS_NOMEM;
+    }
+    for (size_t i = 0; i < count; i++) {
+        shards[i] = synchronizedMap_shardIndex((*key)(i, context), map);
+    }
+
+    for (size_t shard = 0; shard < map->m_numberShards; shard++) {
+        SynchronizedMap* shardMap = map->m_shards[shard];
+        int locked = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (shards[i] == shard) {
+                if (!locked) {
+                    wlock_lock(shardMap->m_lock);
+                    locked = 1;
+                }
+                results[i] = (*op)(shardMap, i, context);
+                if ((results[i] != MAMA_STATUS_OK) && (ret == MAMA_STATUS_OK)) {
+                    ret = results[i];
+                }
+            }
+        }
+        if (locked) {
+            wlock_unlock(shardMap->m_lock);
+        }
+    }
+
+    free(shards);
+
+    return ret;
+}
+
+typedef struct synchronizedMap_InsertBatch
+{
+    void** m_keys;
+    void** m_data;
+} synchronizedMap_InsertBatch;
+
+static void* synchronizedMap_insertKey(size_t index, void* context)
+{
+    return ((synchronizedMap_InsertBatch*)context)->m_keys[index];
+}
+
+static mama_status synchronizedMap_insertOp(SynchronizedMap* map, size_t index, void* context)
+{
+    synchronizedMap_InsertBatch* batch = (synchronizedMap_InsertBatch*)context;
+    if (map->m_type == HashTableMap) {
+        int added = 0;
+        mama_status ret = synchronizedMap_hashInsert(batch->m_data[index], batch->m_keys[index], map, &added);
+        if (added) {
+            map->m_numberEntries++;
+        }
+        return ret;
+    }
+
+    RedBlackTreeEntry* entry = (RedBlackTreeEntry*)calloc(1, sizeof(RedBlackTreeEntry));
+    if (entry == NULL) {
+        return MAMA_STATUS_NOMEM;
+    }
+    entry->m_data = batch->m_data[index];
+    entry->m_key = batch->m_keys[index];
+    RB_INSERT(mamaEnvSynchMap_, &map->m_tree, entry);
+    map->m_numberEntries++;
+
+    return MAMA_STATUS_OK;
+}
+
+typedef struct synchronizedMap_RemoveBatch
+{
+    void** m_keys;
+    void** m_data;
+} synchronizedMap_RemoveBatch;
+
+static void* synchronizedMap_removeKey(size_t index, void* context)
+{
+    return ((synchronizedMap_RemoveBatch*)context)->m_keys[index];
+}
+
+static mama_status synchronizedMap_removeOp(SynchronizedMap* map, size_t index, void* context)
+{
+    synchronizedMap_RemoveBatch* batch = (synchronizedMap_RemoveBatch*)context;
+    void* key = batch->m_keys[index];
+    batch->m_data[index] = NULL;
+
+    if (map->m_type == HashTableMap) {
+        if (synchronizedMap_hashRemove(key, map, &batch->m_data[index])) {
+            map->m_numberEntries--;
+            return MAMA_STATUS_OK;
+        }
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    RedBlackTreeEntry tempNode;
+    tempNode.m_key = key;
+    RedBlackTreeEntry* treeEntry = RB_FIND(mamaEnvSynchMap_, &map->m_tree, &tempNode);
+    if (treeEntry == NULL) {
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    RB_REMOVE(mamaEnvSynchMap_, &map->m_tree, treeEntry);
+    batch->m_data[index] = treeEntry->m_data;
+    free(treeEntry);
+    map->m_numberEntries--;
+
+    return MAMA_STATUS_OK;
+}
+
+typedef struct synchronizedMap_ForBatch
+{
+    synchronizedMap_Callback m_callback;
+    void** m_keys;
+    void* m_closure;
+} synchronizedMap_ForBatch;
+
+static void* synchronizedMap_forKey(size_t index, void* context)
+{
+    return ((synchronizedMap_ForBatch*)context)->m_keys[index];
+}
+
+static mama_status synchronizedMap_forOp(SynchronizedMap* map, size_t index, void* context)
+{
+    synchronizedMap_ForBatch* batch = (synchronizedMap_ForBatch*)context;
+    void* key = batch->m_keys[index];
+
+    if (map->m_type == HashTableMap) {
+        PointerHashSlot* slot = synchronizedMap_hashFind(key, map);
+        return (slot != NULL) ? (*batch->m_callback)(slot->m_data, batch->m_closure) : MAMA_STATUS_NOT_FOUND;
+    }
+
+    RedBlackTreeEntry tempNode;
+    tempNode.m_key = key;
+    RedBlackTreeEntry* treeEntry = RB_FIND(mamaEnvSynchMap_, &map->m_tree, &tempNode);
+    return (treeEntry != NULL) ? (*batch->m_callback)(treeEntry->m_data, batch->m_closure) : MAMA_STATUS_NOT_FOUND;
+}
+
 /* ********************************************************** */
 /* Public Functions. */
 /* ********************************************************** */
 
 SynchronizedMap* synchronizedMap_create(void)
+{
+    return synchronizedMap_createWithType(RedBlackTreeMap);
+}
+
+SynchronizedMap* synchronizedMap_createWithType(SynchronizedMapType type)
 {
     /* Allocate the structure. */
     SynchronizedMap* ret = (SynchronizedMap*)calloc(1, sizeof(SynchronizedMap));
@@ -51,6 +501,9 @@ SynchronizedMap* synchronizedMap_create(void)
             /* Initialise the root of the red black tree to NULL. */
             RB_INIT(&ret->m_tree);
 
+            /* The hash table slots are allocated when the first entry is added. */
+            ret->m_type = type;
+
             success = 1;
         }
 
@@ -64,12 +517,60 @@ SynchronizedMap* synchronizedMap_create(void)
     return ret;
 }
 
+SynchronizedMap* synchronizedMap_createSharded(SynchronizedMapType type, size_t numberShards)
+{
+    /* Round the number of shards up to a power of 2. */
+    size_t shards = 1;
+    while (shards < numberShards) {
+        shards *= 2;
+    }
+
+    /* The sharded map itself is only a container and has no lock of its own. */
+    SynchronizedMap* ret = (SynchronizedMap*)calloc(1, sizeof(SynchronizedMap));
+    if (ret != NULL) {
+        ret->m_type = type;
+        ret->m_shards = (SynchronizedMap**)calloc(shards, sizeof(SynchronizedMap*));
+        if (ret->m_shards != NULL) {
+            ret->m_numberShards = shards;
+
+            /* Each shard is a separate allocation so that their locks are not shared. */
+            for (size_t i = 0; i < shards; i++) {
+                ret->m_shards[i] = synchronizedMap_createWithType(type);
+                if (ret->m_shards[i] == NULL) {
+                    synchronizedMap_destroy(ret);
+                    ret = NULL;
+                    break;
+                }
+            }
+        }
+        else {
+            free(ret);
+            ret = NULL;
+        }
+    }
+
+    return ret;
+}
+
 void synchronizedMap_destroy(SynchronizedMap* map)
 {
-    if (map != NULL) {
+    if ((map != NULL) && (map->m_shards != NULL)) {
+        /* Destroy each of the shards in turn. */
+        for (size_t i = 0; i < map->m_numberShards; i++) {
+            synchronizedMap_destroy(map->m_shards[i]);
+        }
+        free(map->m_shards);
+        free(map);
+    }
+
+    else if (map != NULL) {
         /* Destroy the tree by clearing the root pointer. */
         RB_INIT(&map->m_tree);
 
+        /* Free the hash table slots. */
+        free(map->m_table.m_slots);
+        free(map->m_oldTable.m_slots);
+
         /* Destroy the lock. */
         if (map->m_lock != NULL) {
             //wlock_unlock(map->m_lock); wrong thread!
@@ -90,9 +591,30 @@ mama_status synchronizedMap_foreach(synchronizedMap_Callback callback, void* clo
     /* Returns. */
     mama_status ret = MAMA_STATUS_OK;
 
+    /* Walk the shards in order, each one under its own lock. */
+    if (map->m_shards != NULL) {
+        for (size_t i = 0; i < map->m_numberShards; i++) {
+            mama_status sfe = synchronizedMap_foreach(callback, closure, ignoreErrors, map->m_shards[i]);
+            if (MAMA_STATUS_OK == ret) {
+                ret = sfe;
+            }
+            if ((0 == ignoreErrors) && (MAMA_STATUS_OK != ret)) {
+                break;
+            }
+        }
+
+        return ret;
+    }
+
     /* Acquire the lock first. */
     wlock_lock(map->m_lock);
-    {
+    if (map->m_type == HashTableMap) {
+        /* Enumerate the current table and then anything not yet migrated. */
+        if ((synchronizedMap_tableForeach(&map->m_table, callback, closure, ignoreErrors, &ret) == MAMA_STATUS_OK) || ignoreErrors) {
+            synchronizedMap_tableForeach(&map->m_oldTable, callback, closure, ignoreErrors, &ret);
+        }
+    }
+    else {
         /* Enumerate all entries in the red and black tree. */
         RedBlackTreeEntry* nextEntry = NULL;
         RB_FOREACH(nextEntry, mamaEnvSynchMap_, &map->m_tree)
@@ -123,30 +645,54 @@ mama_status synchronizedMap_insert(void* data, void* key, SynchronizedMap* map)
     /* Returns. */
     mama_status ret = MAMA_STATUS_NOMEM;
 
+    if (map->m_shards != NULL) {
+        return synchronizedMap_insert(data, key, synchronizedMap_shard(key, map));
+    }
+
+    /* Hash table entries live in the table itself so nothing is allocated per entry. */
+    if (map->m_type == HashTableMap) {
+        int added = 0;
+
+        wlock_lock(map->m_lock);
+        ret = synchronizedMap_hashInsert(data, key, map, &added);
+        if (added) {
+            map->m_numberEntries++;
+        }
+        wlock_unlock(map->m_lock);
+
+        return ret;
+    }
+
     /* Allocate a new red black tree node. */
     RedBlackTreeEntry* treeEntry = (RedBlackTreeEntry*)calloc(1, sizeof(RedBlackTreeEntry));
     if (treeEntry != NULL) {
-        /* Save the data in the entry. */
-        treeEntry->m_data = data;
-        treeEntry->m_key = key;
-
-        /* Acquire the lock first. */
-        wlock_lock(map->m_lock);
+        /* Add the node to the tree. */
+        ret = synchronizedMap_linkEntry(treeEntry, data, key, map);
+    }
 
-        /* Add the data object to the tree. */
-        RB_INSERT(mamaEnvSynchMap_, &map->m_tree, treeEntry);
+    return ret;
+}
 
-        /* Increment the number of entries. */
-        map->m_numberEntries++; // NOLINT
+mama_status synchronizedMap_insertEntries(void** keys, void** data, size_t count, SynchronizedMap* map, mama_status* results)
+{
+    synchronizedMap_InsertBatch batch = { keys, data };
+    return synchronizedMap_batch(map, count, synchronizedMap_insertKey, synchronizedMap_insertOp, (void*)&batch, results);
+}
 
-        /* Release the lock. */
-        wlock_unlock(map->m_lock);
+mama_status synchronizedMap_removeEntries(void** keys, size_t count, SynchronizedMap* map, void** data, mama_status* results)
+{
+    synchronizedMap_RemoveBatch batch = { keys, data };
+    return synchronizedMap_batch(map, count, synchronizedMap_removeKey, synchronizedMap_removeOp, (void*)&batch, results);
+}
 
-        /* Function success. */
-        ret = MAMA_STATUS_OK;
+mama_status synchronizedMap_forEachKey(synchronizedMap_Callback callback, void** keys, size_t count, SynchronizedMap* map, void* closure, mama_status* results)
+{
+    if (callback == NULL || keys == NULL || map == NULL) {
+        return MAMA_STATUS_NULL_ARG;
     }
 
-    return ret;
+    synchronizedMap_ForBatch batch = { callback, keys, closure };
+    return synchronizedMap_batch(map, count, synchronizedMap_forKey, synchronizedMap_forOp, (void*)&batch, results);
 }
 
 mama_status synchronizedMap_remove(void* key, SynchronizedMap* map, void** data)
@@ -154,6 +700,21 @@ mama_status synchronizedMap_remove(void* key, SynchronizedMap* map, void** data)
     /* Returns. */
     mama_status ret = MAMA_STATUS_INVALID_ARG;
 
+    if (map->m_shards != NULL) {
+        return synchronizedMap_remove(key, synchronizedMap_shard(key, map), data);
+    }
+
+    if (map->m_type == HashTableMap) {
+        wlock_lock(map->m_lock);
+        if (synchronizedMap_hashRemove(key, map, data)) {
+            map->m_numberEntries--;
+            ret = MAMA_STATUS_OK;
+        }
+        wlock_unlock(map->m_lock);
+
+        return ret;
+    }
+
     /* Create a temporary node structure to look up the map. */
     RedBlackTreeEntry tempNode;
     tempNode.m_key = key;
@@ -198,9 +759,19 @@ mama_status synchronizedMap_for(synchronizedMap_Callback callback, void* key, Sy
         return MAMA_STATUS_NULL_ARG;
     }
 
+    if (map->m_shards != NULL) {
+        return synchronizedMap_for(callback, key, synchronizedMap_shard(key, map), closure);
+    }
+
     wlock_lock(map->m_lock);
     mama_status ret = MAMA_STATUS_NOT_FOUND;
-    {
+    if (map->m_type == HashTableMap) {
+        PointerHashSlot* slot = synchronizedMap_hashFind(key, map);
+        if (slot != NULL) {
+            ret = (*callback)(slot->m_data, closure);
+        }
+    }
+    else {
         /* Create a temporary node structure to look up the map. */
         RedBlackTreeEntry tempNode;
         tempNode.m_key = key;
@@ -222,6 +793,40 @@ mama_status synchronizedMap_removeAll(synchronizedMap_Callback callback, void* c
     /* Returns. */
     mama_status ret = MAMA_STATUS_OK;
 
+    /* Empty the shards in order, note that the return code will be preserved. */
+    if (map->m_shards != NULL) {
+        for (size_t i = 0; i < map->m_numberShards; i++) {
+            mama_status sra = synchronizedMap_removeAll(callback, closure, map->m_shards[i]);
+            if (MAMA_STATUS_OK == ret) {
+                ret = sra;
+            }
+        }
+
+        return ret;
+    }
+
+    if (map->m_type == HashTableMap) {
+        /* Take ownership of the slots under the lock, the callbacks are then invoked
+         * without holding the lock as with the tree below.
+         */
+        wlock_lock(map->m_lock);
+        PointerHashTable table = map->m_table;
+        PointerHashTable oldTable = map->m_oldTable;
+        memset(&map->m_table, 0, sizeof(PointerHashTable));
+        memset(&map->m_oldTable, 0, sizeof(PointerHashTable));
+        map->m_rehashIndex = 0;
+        map->m_numberEntries = 0;
+        wlock_unlock(map->m_lock);
+
+        synchronizedMap_tableForeach(&table, callback, closure, 1, &ret);
+        synchronizedMap_tableForeach(&oldTable, callback, closure, 1, &ret);
+
+        free(table.m_slots);
+        free(oldTable.m_slots);
+
+        return ret;
+    }
+
     /* A copy of the tree must be made under the lock, once this has been done the lock can be released to prevent
 	 * race conditions while the items are removed from the tree.
 	 */